@@ -0,0 +1,350 @@
+/*
+ * um_cache.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Implementation of the um_cache.h interface. Each set holds its ways as
+ * line numbers (address divided by the line size, plus one so that 0
+ * marks an empty way) with the time each was last used; the least
+ * recently used way is the one replaced. Counts per segment id and per
+ * offset in segment 0 are kept in arrays grown like the profile's.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "um_cache.h"
+
+#define T Cache_T
+
+/* macros ================================================================== */
+#define HOT_ROWS 20     /* segments and offsets listed in the report */
+#define COUNT_HINT 1024
+
+/* struct definition ======================================================= */
+
+/* accesses and misses, kept per segment id or per offset */
+typedef struct Counts {
+    uint64_t *accesses;
+    uint64_t *misses;
+    uint32_t length;    /* of both arrays */
+} Counts;
+
+struct T {
+    FILE *out;
+    uint32_t size, line, ways;
+    uint32_t num_sets;
+    unsigned line_bits;
+    uint64_t *lines;    /* ways of every set, set by set; 0 is empty */
+    uint64_t *used;     /* when each way was last used */
+    uint64_t clock;     /* accesses so far */
+    uint64_t loads, stores;
+    uint64_t load_misses, store_misses;
+    Counts segments;    /* by segment id */
+    Counts pcs;         /* by offset of the instruction in segment 0 */
+};
+
+/* function declarations =================================================== */
+static bool lookup(T cache, uintptr_t address);
+static void counts_init(Counts *counts);
+static void counts_add(Counts *counts, uint32_t index, bool miss);
+static int hottest(const uint64_t *counts, uint32_t length, uint32_t *hot);
+static double percent(uint64_t part, uint64_t whole);
+
+/* function definitions ==================================================== */
+
+/* cache_new
+ *
+ *      Purpose: Create an empty cache of the given shape.
+ *
+ *   Parameters: Report stream, capacity in bytes, line size in bytes and
+ *               number of ways.
+ *
+ *      Returns: New instance of Cache_T.
+ *
+ * Expectations: out is not null. size and line are powers of two, and size
+ *               is a multiple of line times ways.
+*/
+extern T cache_new(FILE *out, uint32_t size, uint32_t line, uint32_t ways)
+{
+    assert(out != NULL);
+    assert(line != 0 && (line & (line - 1)) == 0);
+    assert(size != 0 && (size & (size - 1)) == 0);
+    assert(ways != 0 && size % ((uint64_t)line * ways) == 0);
+
+    T cache = calloc(1, sizeof(*cache));
+    assert(cache != NULL);
+
+    cache->out = out;
+    cache->size = size;
+    cache->line = line;
+    cache->ways = ways;
+    cache->num_sets = size / line / ways;
+    cache->line_bits = __builtin_ctz(line);
+
+    cache->lines = calloc((size_t)cache->num_sets * ways, sizeof(uint64_t));
+    cache->used = calloc((size_t)cache->num_sets * ways, sizeof(uint64_t));
+    assert(cache->lines != NULL && cache->used != NULL);
+
+    counts_init(&cache->segments);
+    counts_init(&cache->pcs);
+    return cache;
+}
+
+/* cache_free
+ *
+ *      Purpose: Free the cache and its counters. The report stream is left
+ *               open.
+ *
+ *   Parameters: Pointer to an instance of Cache_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: cache and *cache are not null.
+*/
+extern void cache_free(T *cache)
+{
+    assert(cache != NULL && *cache != NULL);
+
+    free((*cache)->lines);
+    free((*cache)->used);
+    free((*cache)->segments.accesses);
+    free((*cache)->segments.misses);
+    free((*cache)->pcs.accesses);
+    free((*cache)->pcs.misses);
+    free(*cache);
+    *cache = NULL;
+}
+
+/* cache_access
+ *
+ *      Purpose: Run one load or store through the cache and count whether
+ *               it missed.
+ *
+ *   Parameters: Instance of Cache_T, offset of the instruction in segment
+ *               0, id of the segment holding the word, the word's address,
+ *               and whether it is a store.
+ *
+ *      Returns: None
+ *
+ * Expectations: word points at the word the instruction reads or writes.
+*/
+extern void cache_access(T cache, uint32_t pc, uint32_t id,
+                         const uint32_t *word, bool store)
+{
+    bool miss = !lookup(cache, (uintptr_t)word);
+
+    if (store) {
+        cache->stores++;
+        cache->store_misses += miss;
+    } else {
+        cache->loads++;
+        cache->load_misses += miss;
+    }
+
+    counts_add(&cache->segments, id, miss);
+    counts_add(&cache->pcs, pc, miss);
+}
+
+/* cache_report
+ *
+ *      Purpose: Write the shape of the cache, the overall miss rates, the
+ *               segments accessed most and the offsets missing most.
+ *
+ *   Parameters: Instance of Cache_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+extern void cache_report(T cache)
+{
+    FILE *out = cache->out;
+    uint64_t accesses = cache->loads + cache->stores;
+    uint64_t misses = cache->load_misses + cache->store_misses;
+
+    fprintf(out, "um cache: %u bytes, %u-byte lines, %u ways, %u sets, LRU, "
+            "write-allocate\n", cache->size, cache->line, cache->ways,
+            cache->num_sets);
+    fprintf(out, "%llu accesses, %llu misses (%.2f%%)\n",
+            (unsigned long long)accesses, (unsigned long long)misses,
+            percent(misses, accesses));
+    fprintf(out, "  loads  %16llu, misses %16llu (%.2f%%)\n",
+            (unsigned long long)cache->loads,
+            (unsigned long long)cache->load_misses,
+            percent(cache->load_misses, cache->loads));
+    fprintf(out, "  stores %16llu, misses %16llu (%.2f%%)\n",
+            (unsigned long long)cache->stores,
+            (unsigned long long)cache->store_misses,
+            percent(cache->store_misses, cache->stores));
+
+    uint32_t hot[HOT_ROWS];
+    int num_hot = hottest(cache->segments.accesses, cache->segments.length,
+                          hot);
+
+    fprintf(out, "\n%-10s %16s %7s %16s %9s\n", "segment", "accesses",
+            "share", "misses", "miss rate");
+    for (int i = 0; i < num_hot; i++) {
+        uint64_t count = cache->segments.accesses[hot[i]];
+        uint64_t missed = cache->segments.misses[hot[i]];
+        fprintf(out, "%-10u %16llu %6.2f%% %16llu %8.2f%%\n", hot[i],
+                (unsigned long long)count, percent(count, accesses),
+                (unsigned long long)missed, percent(missed, count));
+    }
+
+    num_hot = hottest(cache->pcs.misses, cache->pcs.length, hot);
+
+    fprintf(out, "\n%-10s %16s %16s %7s %9s\n", "pc", "accesses", "misses",
+            "share", "miss rate");
+    for (int i = 0; i < num_hot; i++) {
+        uint64_t count = cache->pcs.accesses[hot[i]];
+        uint64_t missed = cache->pcs.misses[hot[i]];
+        fprintf(out, "%-10u %16llu %16llu %6.2f%% %8.2f%%\n", hot[i],
+                (unsigned long long)count, (unsigned long long)missed,
+                percent(missed, misses), percent(missed, count));
+    }
+
+    fflush(out);
+}
+
+/* static function definitions============================================== */
+
+/* lookup
+ *
+ *      Purpose: Find the line holding an address, filling it in over the
+ *               least recently used way of its set when it isn't there.
+ *
+ *   Parameters: Instance of Cache_T and the address.
+ *
+ *      Returns: true for a hit, false for a miss.
+ *
+ * Expectations: None
+*/
+static bool lookup(T cache, uintptr_t address)
+{
+    uint64_t line = ((uint64_t)address >> cache->line_bits) + 1;
+    size_t first = (size_t)(line % cache->num_sets) * cache->ways;
+    uint64_t *lines = cache->lines + first;
+    uint64_t *used = cache->used + first;
+    uint32_t victim = 0;
+
+    cache->clock++;
+    for (uint32_t way = 0; way < cache->ways; way++) {
+        if (lines[way] == line) {
+            used[way] = cache->clock;
+            return true;
+        }
+        if (used[way] < used[victim]) {
+            victim = way;
+        }
+    }
+
+    lines[victim] = line;
+    used[victim] = cache->clock;
+    return false;
+}
+
+/* counts_init
+ *
+ *      Purpose: Start a pair of count arrays out zeroed.
+ *
+ *   Parameters: The counts to set up.
+ *
+ *      Returns: None
+ *
+ * Expectations: Memory is allocated successfully.
+*/
+static void counts_init(Counts *counts)
+{
+    counts->accesses = calloc(COUNT_HINT, sizeof(uint64_t));
+    counts->misses = calloc(COUNT_HINT, sizeof(uint64_t));
+    assert(counts->accesses != NULL && counts->misses != NULL);
+    counts->length = COUNT_HINT;
+}
+
+/* counts_add
+ *
+ *      Purpose: Count an access, and maybe a miss, at an index, growing the
+ *               arrays to hold it first.
+ *
+ *   Parameters: The counts, the index, and whether the access missed.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void counts_add(Counts *counts, uint32_t index, bool miss)
+{
+    if (index >= counts->length) {
+        uint64_t length = counts->length;
+        while (length <= index) {
+            length *= 2;
+        }
+
+        counts->accesses = realloc(counts->accesses,
+                                   length * sizeof(uint64_t));
+        counts->misses = realloc(counts->misses, length * sizeof(uint64_t));
+        assert(counts->accesses != NULL && counts->misses != NULL);
+
+        size_t added = (length - counts->length) * sizeof(uint64_t);
+        memset(counts->accesses + counts->length, 0, added);
+        memset(counts->misses + counts->length, 0, added);
+        counts->length = (uint32_t)length;
+    }
+
+    counts->accesses[index]++;
+    counts->misses[index] += miss;
+}
+
+/* hottest
+ *
+ *      Purpose: Pick the indexes with the largest counts by insertion into
+ *               a short sorted list.
+ *
+ *   Parameters: The counts, how many there are, and room for HOT_ROWS
+ *               indexes.
+ *
+ *      Returns: How many indexes were picked, largest count first.
+ *
+ * Expectations: None
+*/
+static int hottest(const uint64_t *counts, uint32_t length, uint32_t *hot)
+{
+    int num_hot = 0;
+
+    for (uint32_t index = 0; index < length; index++) {
+        uint64_t count = counts[index];
+        if (count == 0 ||
+            (num_hot == HOT_ROWS && count <= counts[hot[num_hot - 1]])) {
+            continue;
+        }
+
+        int i = (num_hot < HOT_ROWS) ? num_hot++ : HOT_ROWS - 1;
+        while (i > 0 && counts[hot[i - 1]] < count) {
+            hot[i] = hot[i - 1];
+            i--;
+        }
+        hot[i] = index;
+    }
+
+    return num_hot;
+}
+
+/* percent
+ *
+ *      Purpose: Share of a count in a total, as a percentage.
+ *
+ *   Parameters: The count and the total.
+ *
+ *      Returns: The percentage, 0 for an empty total.
+ *
+ * Expectations: None
+*/
+static double percent(uint64_t part, uint64_t whole)
+{
+    return (whole == 0) ? 0.0 : 100.0 * (double)part / (double)whole;
+}
+
+#undef T
@@ -0,0 +1,49 @@
+/*
+ * um_cache.h
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Provides an interface for simulating a data cache. The cache engine
+ * (execute_cache() in um_execution.h) hands a Cache_T the segment id and
+ * host address of every word SLOAD reads and SSTORE writes.
+ * The model is a set-associative cache with LRU replacement that allocates
+ * on stores as well as loads. Since the addresses are where um_segments.c
+ * really put the words, the misses follow its layout. At HALT it reports
+ * miss rates overall, for the most used segment ids and for the offsets in
+ * segment 0 with the most misses.
+*/
+
+#ifndef UM_CACHE_
+#define UM_CACHE_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define T Cache_T
+typedef struct T *T; /* pointer to a simulated cache and its counters */
+
+/*
+ * Takes in where to write the report, the capacity in bytes, the line size
+ *      in bytes and the number of ways, and returns an empty cache. The
+ *      capacity and line size must be powers of two, and the capacity a
+ *      multiple of the line size times the ways.
+ */
+extern T cache_new(FILE *out, uint32_t size, uint32_t line, uint32_t ways);
+
+/* Takes in a pointer to a cache and frees it, leaving the stream open */
+extern void cache_free(T *cache);
+
+/*
+ * Takes in a cache, the offset in segment 0 of the instruction, the id of
+ *      the segment it accesses, the address of the word, and whether it is a
+ *      store, and runs the access through the cache.
+ */
+extern void cache_access(T cache, uint32_t pc, uint32_t id,
+                         const uint32_t *word, bool store);
+
+/* Takes in a cache and writes its report */
+extern void cache_report(T cache);
+
+#undef T
+#endif
@@ -0,0 +1,64 @@
+/*
+ * um_decode.h
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Provides the decoded form of a UM instruction. Segment 0 is kept decoded
+ * alongside its words (see um_segments.c) so the engines never have to pull
+ * the opcode and registers out of a word more than once. Words are decoded
+ * the first time they are reached, so a zeroed array stands for a segment
+ * that has not been decoded at all.
+*/
+
+#ifndef UM_DECODE_
+#define UM_DECODE_
+
+#include <stdint.h>
+
+#define T Instruction_T
+typedef struct T *T; /* pointer to a decoded instruction */
+
+/*
+ * Decoded opcodes are one more than the opcode field of the word, which
+ * leaves 0 to mark an entry whose word has not been decoded yet.
+ */
+typedef enum Um_opcode { /* way to map numbers to global variables */
+        NOT_DECODED = 0,
+        CMOV, SLOAD, SSTORE, ADD, MUL, DIV,
+        NAND, HALT, ACTIVATE, INACTIVATE, OUT, IN, LOADP, LV
+} Um_opcode;
+
+/*
+ * A decoded word. For LV only register_A and value are used, for every other
+ * opcode value is 0. Opcodes 14 and 15 (decoded as 15 and 16) are kept as
+ * is, since segment 0 may hold data that is never executed.
+ */
+struct T {
+    uint8_t opcode, register_A, register_B, register_C;
+    uint32_t value;
+};
+
+/* Takes in a word and returns it split into opcode, registers and value */
+static inline struct T decode_word(uint32_t word)
+{
+    struct T instruction;
+
+    instruction.opcode = (word >> 28) + 1;
+
+    if (instruction.opcode == LV) {
+        instruction.register_A = (word >> 25) & 0x7;
+        instruction.register_B = 0;
+        instruction.register_C = 0;
+        instruction.value = word & 0x1ffffff;
+    } else {
+        instruction.register_A = (word >> 6) & 0x7;
+        instruction.register_B = (word >> 3) & 0x7;
+        instruction.register_C = word & 0x7;
+        instruction.value = 0;
+    }
+
+    return instruction;
+}
+
+#undef T
+#endif
@@ -0,0 +1,459 @@
+/*
+ * um_dispatch_bench.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Microbenchmarks for instruction dispatch, run through a "main()". The
+ * first table times the pieces in isolation: decode_word() and direct calls
+ * to the handlers in um_instructions.c. The second times every engine built
+ * into the tree (switch, threaded and native where the host allows) on
+ * programs made of one opcode repeated, and on two mixes, so the cost per
+ * instruction includes fetch, decode and dispatch.
+ *
+ * Times are ns per instruction. Cycles are read from the time stamp
+ * counter on x86, which ticks at a fixed rate rather than the core clock,
+ * and are left out elsewhere. Every engine run happens in a child that
+ * reports back through a pipe, so each starts from a fresh heap.
+ *
+ * Usage: um_dispatch_bench [instructions]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+
+#include "um_decode.h"
+#include "um_encode.h"
+#include "um_segments.h"
+#include "um_instructions.h"
+#include "um_execution.h"
+#include "um_jit.h"
+#include "um_io.h"
+
+/* macros ================================================================== */
+#define DEFAULT_INSTRUCTIONS 50000000
+#define BODY 1000           /* instructions in the body of each loop */
+#define MAX_ITERATIONS ((1 << 25) - 1)
+#define DATA_WORDS 64       /* length of the segment SLOAD and SSTORE use */
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_TSC 1
+#define read_cycles() __builtin_ia32_rdtsc()
+#else
+#define read_cycles() 0
+#endif
+
+/* struct definition ======================================================= */
+typedef Exec_status (*Engine)(Memory_T program, uint32_t *registers,
+                              int *prog_counter, Io_T io, Exec_stats *stats);
+
+/* what a child sends back once its program halts */
+typedef struct Timing {
+    double seconds;
+    uint64_t cycles;
+    uint64_t instructions;
+} Timing;
+
+/* an opcode, or run of opcodes, that a loop body repeats */
+typedef struct Pattern {
+    const char *name;
+    const char *steps;      /* one letter per step, see append_step */
+} Pattern;
+
+static const struct {
+    const char *name;
+    Engine run;
+} engines[] = {
+    { "switch", execute_switch },
+#ifdef UM_HAVE_THREADED
+    { "threaded", execute_threaded },
+#endif
+#ifdef UM_HAVE_JIT
+    { "native", execute_jit },
+#endif
+};
+
+#define NUM_ENGINES (int)(sizeof(engines) / sizeof(engines[0]))
+
+static const Pattern patterns[] = {
+    { "cmov",           "c" },
+    { "add",            "a" },
+    { "mul",            "m" },
+    { "div",            "d" },
+    { "nand",           "n" },
+    { "lv",             "v" },
+    { "sload",          "l" },
+    { "sstore",         "s" },
+    { "map+unmap",      "u" },
+    { "lv+loadp",       "j" },
+    { "out",            "o" },
+    { "arith mix",      "avanmcavnd" },
+    { "memory mix",     "lasvlnsalu" },
+};
+
+#define NUM_PATTERNS (int)(sizeof(patterns) / sizeof(patterns[0]))
+
+/* state of the child, read by report_child */
+static struct timespec child_start;
+static uint64_t child_cycles;
+static Exec_stats child_stats;
+static int child_pipe = -1;
+
+/* keeps isolated loops from being optimized away */
+static volatile uint32_t sink;
+
+/* function declarations =================================================== */
+static void bench_isolated(uint64_t count);
+static void print_isolated(const char *name, uint64_t count,
+                           double seconds, uint64_t cycles);
+static bool bench_engine(Engine run, const Pattern *pattern, uint64_t count,
+                         Timing *timing);
+static void run_child(Engine run, const Pattern *pattern, uint64_t count);
+static void report_child(void);
+static int build_program(uint32_t *words, const char *steps,
+                         uint32_t iterations);
+static int append_step(uint32_t *words, int at, char step);
+static double now(void);
+
+/* function definitions ==================================================== */
+int main(int argc, char *argv[])
+{
+    uint64_t count = (argc > 1) ? strtoull(argv[1], NULL, 0)
+                                : DEFAULT_INSTRUCTIONS;
+
+    bench_isolated(count);
+
+    printf("\n%-14s", "pattern");
+    for (int e = 0; e < NUM_ENGINES; e++) {
+        printf(" %10s ns %8s cyc", engines[e].name, "");
+    }
+    printf("\n");
+
+    for (int p = 0; p < NUM_PATTERNS; p++) {
+        printf("%-14s", patterns[p].name);
+        fflush(stdout);
+
+        for (int e = 0; e < NUM_ENGINES; e++) {
+            Timing timing;
+            if (!bench_engine(engines[e].run, &patterns[p], count,
+                              &timing)) {
+                printf(" %13s %12s", "failed", "");
+                continue;
+            }
+
+            double n = (double)timing.instructions;
+            printf(" %13.3f", timing.seconds * 1e9 / n);
+#ifdef HAVE_TSC
+            printf(" %12.2f", (double)timing.cycles / n);
+#else
+            printf(" %12s", "-");
+#endif
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
+
+/* bench_isolated
+ *
+ *      Purpose: Time decode_word and direct handler calls in C loops, with
+ *               no fetch or dispatch around them.
+ *
+ *   Parameters: How many calls of each to time.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void bench_isolated(uint64_t count)
+{
+    uint32_t registers[8] = { 0, 1, 3, 7, 1, 0, 0, 0 };
+    Memory_T memory = segment_new();
+    segment_map(memory, DATA_WORDS);
+    registers[4] = segment_map(memory, DATA_WORDS);
+
+    uint32_t words[1024];
+    for (int i = 0; i < 1024; i++) {
+        words[i] = encode_word(i % 14 + 1, i & 7, (i >> 3) & 7,
+                               (i >> 6) & 7);
+    }
+
+    printf("%-24s %12s %10s %10s\n", "isolated", "calls", "ns/call",
+           "cyc/call");
+
+    double start = now();
+    uint64_t cycles = read_cycles();
+    uint32_t sum = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        struct Instruction_T decoded = decode_word(words[i & 1023]);
+        sum += decoded.opcode + decoded.register_C;
+    }
+    sink = sum;
+    print_isolated("decode_word", count, now() - start,
+                   read_cycles() - cycles);
+
+/* times count calls of one handler, arguments fixed */
+#define TIME_HANDLER(name, call) do {                                       \
+        start = now();                                                      \
+        cycles = read_cycles();                                             \
+        for (uint64_t i = 0; i < count; i++) {                              \
+            call;                                                           \
+        }                                                                   \
+        sink = registers[1];                                                \
+        print_isolated(name, count, now() - start, read_cycles() - cycles); \
+    } while (0)
+
+    TIME_HANDLER("conditional_move", conditional_move(registers, 1, 2, 3));
+    TIME_HANDLER("addition", addition(registers, 1, 2, 3));
+    TIME_HANDLER("multiplication", multiplication(registers, 1, 2, 3));
+    TIME_HANDLER("division", division(registers, 1, 2, 3));
+    TIME_HANDLER("bitwise_nand", bitwise_nand(registers, 1, 2, 3));
+    TIME_HANDLER("load_value", load_value(registers, 1, 0, 0, 42));
+    TIME_HANDLER("segmented_load", segmented_load(registers, 1, 4, 2,
+                                                  memory));
+    TIME_HANDLER("segmented_store", segmented_store(registers, 4, 2, 3,
+                                                    memory));
+    TIME_HANDLER("map_segment+unmap", (map_segment(registers, 0, 1, 3,
+                                                   memory),
+                                       unmap_segment(registers, 0, 0, 1,
+                                                     memory)));
+#undef TIME_HANDLER
+
+    segment_free(memory);
+}
+
+/* print_isolated
+ *
+ *      Purpose: Print one line of the isolated table.
+ *
+ *   Parameters: Name, calls timed, seconds and cycles taken.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void print_isolated(const char *name, uint64_t count,
+                           double seconds, uint64_t cycles)
+{
+    printf("%-24s %12llu %10.3f", name, (unsigned long long)count,
+           seconds * 1e9 / (double)count);
+#ifdef HAVE_TSC
+    printf(" %10.2f\n", (double)cycles / (double)count);
+#else
+    (void)cycles;
+    printf(" %10s\n", "-");
+#endif
+}
+
+/* bench_engine
+ *
+ *      Purpose: Run a pattern under an engine in a child process and
+ *               collect its timing.
+ *
+ *   Parameters: The engine, the pattern, about how many instructions to
+ *               run, and where to put the timing.
+ *
+ *      Returns: false if the child failed.
+ *
+ * Expectations: None
+*/
+static bool bench_engine(Engine run, const Pattern *pattern, uint64_t count,
+                         Timing *timing)
+{
+    int fds[2];
+    if (pipe(fds) != 0) {
+        return false;
+    }
+
+    fflush(stdout);
+    pid_t child = fork();
+    if (child == 0) {
+        close(fds[0]);
+        child_pipe = fds[1];
+        run_child(run, pattern, count);
+        _exit(1); /* run_child exits at HALT, so this is a failure */
+    }
+    close(fds[1]);
+
+    ssize_t got = (child > 0) ? read(fds[0], timing, sizeof(*timing)) : -1;
+    close(fds[0]);
+
+    int status = 0;
+    if (child > 0) {
+        waitpid(child, &status, 0);
+    }
+    return got == (ssize_t)sizeof(*timing) && WIFEXITED(status) &&
+           WEXITSTATUS(status) == 0 && timing->instructions > 0;
+}
+
+/* run_child
+ *
+ *      Purpose: Build the program for a pattern and run it, leaving the
+ *               report to report_child once it halts.
+ *
+ *   Parameters: The engine, the pattern and about how many instructions to
+ *               run.
+ *
+ *      Returns: Only if the program failed to halt.
+ *
+ * Expectations: Called in a child process.
+*/
+static void run_child(Engine run, const Pattern *pattern, uint64_t count)
+{
+    uint64_t iterations = count / BODY + 1;
+    if (iterations > MAX_ITERATIONS) {
+        iterations = MAX_ITERATIONS;
+    }
+
+    uint32_t words[4 * BODY + 16];
+    int length = build_program(words, pattern->steps, (uint32_t)iterations);
+
+    /* segment 0 first, then the one SLOAD and SSTORE use */
+    Memory_T memory = segment_new();
+    segment_map(memory, length);
+    memcpy(segment_words(memory, 0), words, length * sizeof(uint32_t));
+    uint32_t registers[8] = { 0, 1, 3, 7, 0, 0, 0, 0 };
+    registers[4] = segment_map(memory, DATA_WORDS);
+
+    Io_T io = io_new(open("/dev/null", O_RDONLY),
+                     open("/dev/null", O_WRONLY));
+    int prog_counter = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &child_start);
+    child_cycles = read_cycles();
+    if (run(memory, registers, &prog_counter, io, &child_stats) ==
+        EXEC_HALTED) {
+        report_child();
+        _exit(0);
+    }
+}
+
+/* report_child
+ *
+ *      Purpose: Send the time taken and instructions run to the parent.
+ *
+ *   Parameters: None
+ *
+ *      Returns: None
+ *
+ * Expectations: Called in the child as soon as its program halts.
+*/
+static void report_child(void)
+{
+    struct timespec end;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    Timing timing = {
+        (double)(end.tv_sec - child_start.tv_sec) +
+        (double)(end.tv_nsec - child_start.tv_nsec) / 1e9,
+        read_cycles() - child_cycles,
+        child_stats.instructions
+    };
+
+    if (write(child_pipe, &timing, sizeof(timing)) != sizeof(timing)) {
+        _exit(1);
+    }
+}
+
+/* build_program
+ *
+ *      Purpose: Write a loop whose body repeats steps until it holds about
+ *               BODY instructions, run iterations times, then HALT.
+ *
+ *   Parameters: Room for the words, the steps, and how many iterations.
+ *
+ *      Returns: The number of words written.
+ *
+ * Expectations: iterations fits in a load value. The body only writes r1;
+ *               r4 holds the id of a DATA_WORDS segment, r2 and r3 hold 3
+ *               and 7, r0 stays 0 and r5 to r7 run the loop.
+*/
+static int build_program(uint32_t *words, const char *steps,
+                         uint32_t iterations)
+{
+    int at = 0;
+    int num_steps = strlen(steps);
+
+    words[at++] = encode_lv(5, iterations);
+    int top = at;
+
+    for (int i = 0; at - top < BODY; i++) {
+        at = append_step(words, at, steps[i % num_steps]);
+    }
+
+    /* r5 = r5 - 1, and back to the top unless it reached 0 */
+    int exit = at + 6;
+    words[at++] = encode_word(NAND, 7, 0, 0);
+    words[at++] = encode_word(ADD, 5, 5, 7);
+    words[at++] = encode_lv(6, exit);
+    words[at++] = encode_lv(7, top);
+    words[at++] = encode_word(CMOV, 6, 7, 5);
+    words[at++] = encode_word(LOADP, 0, 0, 6);
+    words[at++] = encode_word(HALT, 0, 0, 0);
+
+    return at;
+}
+
+/* append_step
+ *
+ *      Purpose: Write the instructions for one step of a pattern.
+ *
+ *   Parameters: The words, where to write, and the step: c cmov, a add,
+ *               m mul, d div, n nand, v lv, l sload, s sstore, u map then
+ *               unmap, j lv then a LOADP to the next word, o out.
+ *
+ *      Returns: Where the next step goes.
+ *
+ * Expectations: None
+*/
+static int append_step(uint32_t *words, int at, char step)
+{
+    switch (step) {
+    case 'c': words[at++] = encode_word(CMOV, 1, 2, 3);             break;
+    case 'a': words[at++] = encode_word(ADD, 1, 2, 3);              break;
+    case 'm': words[at++] = encode_word(MUL, 1, 2, 3);              break;
+    case 'd': words[at++] = encode_word(DIV, 1, 2, 3);              break;
+    case 'n': words[at++] = encode_word(NAND, 1, 2, 3);             break;
+    case 'v': words[at++] = encode_lv(1, 42);                       break;
+    case 'l': words[at++] = encode_word(SLOAD, 1, 4, 2);            break;
+    case 's': words[at++] = encode_word(SSTORE, 4, 2, 3);           break;
+    case 'u':
+        words[at++] = encode_word(ACTIVATE, 0, 1, 3);
+        words[at++] = encode_word(INACTIVATE, 0, 0, 1);
+        break;
+    case 'j':
+        words[at] = encode_lv(1, at + 2);
+        at++;
+        words[at++] = encode_word(LOADP, 0, 0, 1);
+        break;
+    case 'o': words[at++] = encode_word(OUT, 0, 0, 2);              break;
+    default:
+        fprintf(stderr, "unknown step %c\n", step);
+        _exit(1);
+    }
+    return at;
+}
+
+/* now
+ *
+ *      Purpose: Read the monotonic clock.
+ *
+ *   Parameters: None
+ *
+ *      Returns: Seconds since some fixed point.
+ *
+ * Expectations: None
+*/
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
@@ -0,0 +1,34 @@
+/*
+ * um_encode.h
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Provides the inverse of decoding: building the words of a UM program from
+ * the decoded opcodes of um_decode.h. Tests and benchmarks use it to write
+ * the programs they run; the engines never encode anything, so everything
+ * here is inline.
+*/
+
+#ifndef UM_ENCODE_
+#define UM_ENCODE_
+
+#include <stdint.h>
+#include "um_decode.h"
+
+/*
+ * Takes in a decoded opcode other than LV and registers A, B and C, and
+ *      returns the word
+ */
+static inline uint32_t encode_word(Um_opcode op, unsigned a, unsigned b,
+                                   unsigned c)
+{
+    return ((uint32_t)(op - 1) << 28) | (a << 6) | (b << 3) | c;
+}
+
+/* Takes in register A and a value below 2^25, and returns the LV word */
+static inline uint32_t encode_lv(unsigned a, uint32_t value)
+{
+    return ((uint32_t)(LV - 1) << 28) | (a << 25) | value;
+}
+
+#endif
@@ -7,66 +7,619 @@
  * keeps track of these instructions, and contains a switch statement to
  * call certain functions from um_instructions.h in accordance with a specified
  * input.
+ *
+ * Two engines are built from this file, both running from the decoded copy
+ * of segment 0 kept by um_segments.c. The switch engine calls out to
+ * um_instructions.c for every instruction. The threaded engine (GNU C only)
+ * keeps the registers and program counter in locals and jumps straight from
+ * one handler to the next. execute() runs the switch engine unless compiled
+ * with -DUM_THREADED, or with -DUM_JIT for the native engine in um_jit.c.
+ *
+ * execute_profile() is the switch engine with a Profile_T counting every
+ * instruction, execute_trace() the switch engine with a Tracer_T
+ * recording every instruction, and execute_segments() the switch engine
+ * timing every map and unmap for a Seghist_T, and execute_cache() the switch
+ * engine running every SLOAD and SSTORE through a Cache_T. All five come
+ * from one always-inlined loop, and execute_switch() passes constant NULLs,
+ * so its copy has none of them left in it. execute_sample() needs nothing
+ * from the loop: it runs execute() while a Sampler_T reads the block each
+ * engine already publishes in Exec_stats at every LOADP.
+ *
+ * Every engine returns to its caller at HALT, and at a fault (division by
+ * zero, OUT of a value over 255, an invalid opcode, a segment id or offset
+ * um_segments.c turns down) without running the instruction, leaving memory
+ * and I/O for the caller to wind up. A LOADP past the end of segment 0 is
+ * caught where it jumps, with one compare per LOADP, and running off the
+ * end by the entry past it that segment_decode refuses. Given a budget in
+ * Exec_stats, an engine also returns after the first LOADP past it, the
+ * one point where all of them already stop to count, so a budget costs a
+ * compare per block and calling the engine again resumes the program.
 */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
 #include <assert.h>
 
-#include "bitpack.h"
 #include "um_instructions.h"
 #include "um_execution.h"
+#include "um_jit.h"
+#include "um_profile.h"
+#include "um_sample.h"
+#include "um_trace.h"
+#include "um_seghist.h"
+#include "um_cache.h"
 
 #define T Instruction_T
 
-/* instruction declarations ================================================ */
-static inline void switch_commands(T instruction, Memory_T memory,
-                                   uint32_t *registers, int *prog_counter);
-static inline T pack_instruction(T instruction, uint32_t word);
+#if defined(UM_THREADED) && !defined(UM_HAVE_THREADED)
+#error "UM_THREADED requires computed goto (GNU C)"
+#endif
 
-/* struct definition ======================================================= */
-struct T {
-    unsigned opcode, register_A, register_B, register_C;
-};
+#if defined(UM_JIT) && !defined(UM_HAVE_JIT)
+#error "UM_JIT requires an x86-64 host with mmap"
+#endif
 
-typedef enum Um_opcode { /* way to map numbers to global variables */
-        CMOV = 0, SLOAD, SSTORE, ADD, MUL, DIV,
-        NAND, HALT, ACTIVATE, INACTIVATE, OUT, IN, LOADP, LV
-} Um_opcode;
+/* instruction declarations ================================================ */
+static inline Exec_status run_switch(Memory_T program, uint32_t *registers,
+                                     int *prog_counter, Io_T io,
+                                     Exec_stats *stats, Profile_T profile,
+                                     Tracer_T tracer, Seghist_T seghist,
+                                     Cache_T cache)
+                                     __attribute__((always_inline));
+static inline Exec_status switch_commands(T instruction, Memory_T memory,
+                                          uint32_t *registers,
+                                          int *prog_counter, Io_T io)
+                                          __attribute__((always_inline));
 
 /* function definition ===================================================== */
 
 /* execute
  *
- *      Purpose: Call proper functions to execute instructions in segment 0.
+ *      Purpose: Call proper functions to execute instructions in segment 0,
+ *               using whichever engine was selected at build time.
  *
  *   Parameters: Instance of program memory, pointer to an array of
- *               registers, and a pointer to program counter to keep track of
- *               instructions.
+ *               registers, a pointer to program counter to keep track of
+ *               instructions, the I/O state for IN and OUT, and the counters
+ *               to keep up to date.
  *
- *      Returns: None
+ *      Returns: Why it stopped.
  *
  * Expectations: None
 */
-extern void execute(Memory_T program, uint32_t *registers, int *prog_counter)
+extern Exec_status execute(Memory_T program, uint32_t *registers,
+                           int *prog_counter, Io_T io, Exec_stats *stats)
 {
-    uint32_t word;
+#if defined(UM_JIT)
+    return execute_jit(program, registers, prog_counter, io, stats);
+#elif defined(UM_THREADED)
+    return execute_threaded(program, registers, prog_counter, io, stats);
+#else
+    return execute_switch(program, registers, prog_counter, io, stats);
+#endif
+}
 
-    /* allocate space for instruction struct */
-    T instruction = malloc(sizeof(*instruction));
+/* exec_status_name
+ *
+ *      Purpose: Describe why an engine stopped, for error messages.
+ *
+ *   Parameters: The status an engine returned.
+ *
+ *      Returns: A constant string.
+ *
+ * Expectations: None
+*/
+extern const char *exec_status_name(Exec_status status)
+{
+    switch (status) {
+        case EXEC_RUNNING:          return "running";
+        case EXEC_OUT_OF_BUDGET:    return "out of budget";
+        case EXEC_BLOCKED:          return "waiting for input";
+        case EXEC_HALTED:           return "halted";
+        case EXEC_DIVIDE_BY_ZERO:   return "division by zero";
+        case EXEC_BAD_OUTPUT:       return "output of a value over 255";
+        case EXEC_BAD_OPCODE:       return "invalid opcode";
+        case EXEC_BAD_PC:           return "pc past the end of segment 0";
+        case EXEC_BAD_SEGMENT:      return "bad segment access";
+    }
+    return "unknown status";
+}
 
-    /* runs until halt is reached or a failed case */
-    while (true) {
-        word = segment_load(program, 0, *prog_counter);
-        instruction = pack_instruction(instruction, word);
-        switch_commands(instruction, program, registers, prog_counter);
-        (*prog_counter)++; /* moves to next instruction */
+/* execute_switch
+ *
+ *      Purpose: Reference engine. Dispatches one decoded instruction at a
+ *               time through switch_commands.
+ *
+ *   Parameters: Instance of program memory, pointer to an array of
+ *               registers, a pointer to program counter to keep track of
+ *               instructions, the I/O state for IN and OUT, and the counters
+ *               to keep up to date.
+ *
+ *      Returns: Why it stopped.
+ *
+ * Expectations: None
+*/
+extern Exec_status execute_switch(Memory_T program, uint32_t *registers,
+                                  int *prog_counter, Io_T io,
+                                  Exec_stats *stats)
+{
+    return run_switch(program, registers, prog_counter, io, stats, NULL, NULL,
+                      NULL, NULL);
+}
+
+/* execute_profile
+ *
+ *      Purpose: Profiling engine. Runs like execute_switch, counting each
+ *               instruction before it is retired and writing the report
+ *               just before HALT.
+ *
+ *   Parameters: Instance of program memory, pointer to an array of
+ *               registers, a pointer to program counter to keep track of
+ *               instructions, the I/O state for IN and OUT, the counters to
+ *               keep up to date, and the profile to count into.
+ *
+ *      Returns: Why it stopped.
+ *
+ * Expectations: profile is not null. It is left to the caller to free.
+*/
+extern Exec_status execute_profile(Memory_T program, uint32_t *registers,
+                                   int *prog_counter, Io_T io,
+                                   Exec_stats *stats, Profile_T profile)
+{
+    assert(profile != NULL);
+    return run_switch(program, registers, prog_counter, io, stats, profile,
+                      NULL, NULL, NULL);
+}
+
+/* execute_sample
+ *
+ *      Purpose: Sampling engine. Runs execute() with a SIGPROF timer
+ *               sampling the block being run, and writes the folded stacks
+ *               once the program halts.
+ *
+ *   Parameters: Instance of program memory, pointer to an array of
+ *               registers, a pointer to program counter to keep track of
+ *               instructions, the I/O state for IN and OUT, the counters to
+ *               keep up to date, and the sampler to record into.
+ *
+ *      Returns: Why it stopped.
+ *
+ * Expectations: sampler is not null. It is left to the caller to free.
+*/
+extern Exec_status execute_sample(Memory_T program, uint32_t *registers,
+                                  int *prog_counter, Io_T io,
+                                  Exec_stats *stats, Sampler_T sampler)
+{
+    assert(sampler != NULL);
+
+    /* every engine publishes the block it enters in stats, which is all
+     * the signal handler needs; called again after EXEC_BLOCKED, it carries
+     * on */
+    sampler_start(sampler, stats);
+    Exec_status status = execute(program, registers, prog_counter, io,
+                                 stats);
+
+    if (status == EXEC_HALTED) {
+        sampler_report(sampler);
     }
+    return status;
+}
 
+/* execute_trace
+ *
+ *      Purpose: Tracing engine. Runs like execute_switch, recording each
+ *               instruction after it is retired and writing out the last of
+ *               the trace just before HALT.
+ *
+ *   Parameters: Instance of program memory, pointer to an array of
+ *               registers, a pointer to program counter to keep track of
+ *               instructions, the I/O state for IN and OUT, the counters to
+ *               keep up to date, and the recorder to trace into.
+ *
+ *      Returns: Why it stopped.
+ *
+ * Expectations: tracer is not null. It is left to the caller to free.
+*/
+extern Exec_status execute_trace(Memory_T program, uint32_t *registers,
+                                 int *prog_counter, Io_T io,
+                                 Exec_stats *stats, Tracer_T tracer)
+{
+    assert(tracer != NULL);
+    return run_switch(program, registers, prog_counter, io, stats, NULL,
+                      tracer, NULL, NULL);
+}
+
+/* execute_segments
+ *
+ *      Purpose: Segment census engine. Runs like execute_switch, keeping
+ *               the census clock on the current instruction so every map,
+ *               unmap and load program is timed exactly, and writing the
+ *               report just before HALT.
+ *
+ *   Parameters: Instance of program memory, pointer to an array of
+ *               registers, a pointer to program counter to keep track of
+ *               instructions, the I/O state for IN and OUT, the counters to
+ *               keep up to date, and the census program memory feeds.
+ *
+ *      Returns: Why it stopped.
+ *
+ * Expectations: seghist is not null and already handed to segment_observe.
+ *               It is left to the caller to free.
+*/
+extern Exec_status execute_segments(Memory_T program, uint32_t *registers,
+                                    int *prog_counter, Io_T io,
+                                    Exec_stats *stats, Seghist_T seghist)
+{
+    assert(seghist != NULL);
+    return run_switch(program, registers, prog_counter, io, stats, NULL,
+                      NULL, seghist, NULL);
+}
+
+/* execute_cache
+ *
+ *      Purpose: Cache simulation engine. Runs like execute_switch, passing
+ *               the word every SLOAD and SSTORE touches to the cache model
+ *               and writing its report just before HALT.
+ *
+ *   Parameters: Instance of program memory, pointer to an array of
+ *               registers, a pointer to program counter to keep track of
+ *               instructions, the I/O state for IN and OUT, the counters to
+ *               keep up to date, and the cache to simulate.
+ *
+ *      Returns: Why it stopped.
+ *
+ * Expectations: cache is not null. It is left to the caller to free.
+*/
+extern Exec_status execute_cache(Memory_T program, uint32_t *registers,
+                                 int *prog_counter, Io_T io,
+                                 Exec_stats *stats, Cache_T cache)
+{
+    assert(cache != NULL);
+    return run_switch(program, registers, prog_counter, io, stats, NULL,
+                      NULL, NULL, cache);
 }
 
+#ifdef UM_HAVE_THREADED
+/* execute_threaded
+ *
+ *      Purpose: Threaded engine. Works on a local copy of the registers and
+ *               program counter and ends every handler with its own indirect
+ *               jump to the next handler, so each opcode gets its own
+ *               dispatch site.
+ *
+ *   Parameters: Instance of program memory, pointer to an array of
+ *               registers, a pointer to program counter to keep track of
+ *               instructions, the I/O state for IN and OUT, and the counters
+ *               to keep up to date.
+ *
+ *      Returns: Why it stopped.
+ *
+ * Expectations: None
+*/
+extern Exec_status execute_threaded(Memory_T program, uint32_t *registers,
+                                    int *prog_counter, Io_T io,
+                                    Exec_stats *stats)
+{
+    static void *const dispatch[17] = {
+        &&do_decode,
+        &&do_cmov, &&do_sload, &&do_sstore, &&do_add, &&do_mul, &&do_div,
+        &&do_nand, &&do_halt, &&do_map, &&do_unmap, &&do_out, &&do_in,
+        &&do_loadp, &&do_lv, &&do_invalid, &&do_invalid
+    };
+
+    uint32_t r[8];
+    T code = segment_program(program);
+    uint32_t code_length = segment_length(program, 0);
+    T instruction;
+    uint32_t pc = (uint32_t)*prog_counter;
+    uint32_t block_start = pc;
+    unsigned a, b, c;
+    Exec_status status;
+
+    if (pc >= code_length) {
+        return EXEC_BAD_PC;
+    }
+    memcpy(r, registers, sizeof(r));
+
+/* fetches the decoded instruction at pc and jumps to its handler */
+#define DISPATCH() do {                                                     \
+        instruction = &code[pc++];                                          \
+        a = instruction->register_A;                                        \
+        b = instruction->register_B;                                        \
+        c = instruction->register_C;                                        \
+        goto *dispatch[instruction->opcode];                                \
+    } while (0)
+
+    DISPATCH();
+
+do_decode:
+    /* first time this word is reached since segment 0 was loaded, or the
+     * end of segment 0 */
+    instruction = segment_decode(program, pc - 1);
+    if (instruction == NULL) {
+        status = EXEC_BAD_PC;
+        goto stop;
+    }
+    a = instruction->register_A;
+    b = instruction->register_B;
+    c = instruction->register_C;
+    goto *dispatch[instruction->opcode];
+
+do_cmov:
+    if (r[c] != 0) {
+        r[a] = r[b];
+    }
+    DISPATCH();
+
+do_sload:
+    if (!segment_load(program, r[b], r[c], &r[a])) {
+        status = EXEC_BAD_SEGMENT;
+        goto stop;
+    }
+    DISPATCH();
+
+do_sstore:
+    if (!segment_store(program, r[a], r[b], r[c])) {
+        status = EXEC_BAD_SEGMENT;
+        goto stop;
+    }
+    DISPATCH();
+
+do_add:
+    r[a] = r[b] + r[c];
+    DISPATCH();
+
+do_mul:
+    r[a] = r[b] * r[c];
+    DISPATCH();
+
+do_div:
+    if (r[c] == 0) {
+        status = EXEC_DIVIDE_BY_ZERO;
+        goto stop;
+    }
+    r[a] = r[b] / r[c];
+    DISPATCH();
+
+do_nand:
+    r[a] = ~(r[b] & r[c]);
+    DISPATCH();
+
+do_map:
+    r[b] = segment_map(program, r[c]);
+    DISPATCH();
+
+do_unmap:
+    if (!segment_unmap(program, r[c])) {
+        status = EXEC_BAD_SEGMENT;
+        goto stop;
+    }
+    DISPATCH();
+
+do_out:
+    if (r[c] > 255) {
+        status = EXEC_BAD_OUTPUT;
+        goto stop;
+    }
+    output(r, a, b, c, io);
+    DISPATCH();
+
+do_in:
+    if (!input(r, a, b, c, io)) {
+        status = EXEC_BLOCKED;
+        goto stop;
+    }
+    DISPATCH();
+
+do_loadp:
+    /* checked before it is counted, since a fault doesn't run */
+    if (r[b] != 0 && !segment_mapped(program, r[b])) {
+        status = EXEC_BAD_SEGMENT;
+        goto stop;
+    }
+
+    /* pc is already past the LOADP, which ends the block */
+    stats_loadp(stats, program, pc - block_start, pc - 1);
+    stats_checkpoint(stats, program, r, pc - 1);
+
+    /* segment 0 is only replaced for a nonzero id, so reload code after */
+    if (r[b] != 0) {
+        segment_load_program(program, r[b]);
+        code = segment_program(program);
+        code_length = segment_length(program, 0);
+    }
+    pc = r[c];
+    block_start = pc;
+    stats_enter(stats, pc, r[b] != 0);
+
+    if (pc >= code_length) {
+        memcpy(registers, r, sizeof(r));
+        *prog_counter = (int)pc;
+        return EXEC_BAD_PC;
+    }
+    if (stats_out_of_budget(stats)) {
+        memcpy(registers, r, sizeof(r));
+        *prog_counter = (int)pc;
+        return EXEC_OUT_OF_BUDGET;
+    }
+    DISPATCH();
+
+do_lv:
+    r[a] = instruction->value;
+    DISPATCH();
+
+do_halt:
+    /* hand the machine state back with the pc left on the HALT */
+    memcpy(registers, r, sizeof(r));
+    *prog_counter = (int)(pc - 1);
+    stats_halt(stats, program, pc - block_start);
+    stats_checkpoint(stats, program, r, pc - 1);
+    return EXEC_HALTED;
+
+do_invalid:
+    status = EXEC_BAD_OPCODE;
+
+stop:
+    /* a fault or an IN with nothing to read; pc - 1 didn't run */
+    memcpy(registers, r, sizeof(r));
+    *prog_counter = (int)(pc - 1);
+    stats_halt(stats, program, pc - 1 - block_start);
+    return status;
+
+#undef DISPATCH
+}
+#endif
+
 /* static function definitions============================================== */
 
+/* run_switch
+ *
+ *      Purpose: Loop shared by the switch and profiling engines, decoding
+ *               each instruction the first time it is reached.
+ *
+ *   Parameters: Instance of program memory, pointer to an array of
+ *               registers, a pointer to program counter, the I/O state, the
+ *               counters, the profile to count into or NULL, the recorder
+ *               to trace into or NULL, the segment census to keep the clock
+ *               of or NULL, and the cache to simulate loads and stores in or
+ *               NULL.
+ *
+ *      Returns: Why it stopped.
+ *
+ * Expectations: Always inlined, so a NULL profile, tracer, census or cache
+ *               compiles to nothing.
+*/
+static inline Exec_status run_switch(Memory_T program, uint32_t *registers,
+                                     int *prog_counter, Io_T io,
+                                     Exec_stats *stats, Profile_T profile,
+                                     Tracer_T tracer, Seghist_T seghist,
+                                     Cache_T cache)
+{
+    T code = segment_program(program);
+    uint32_t block_start = (uint32_t)*prog_counter;
+
+    if (block_start >= (uint32_t)segment_length(program, 0)) {
+        return EXEC_BAD_PC;
+    }
+
+    /* runs until halt is reached or a fault */
+    while (true) {
+        T instruction = &code[*prog_counter];
+
+        /* the entry past the end of segment 0 never decodes */
+        if (instruction->opcode == NOT_DECODED) {
+            instruction = segment_decode(program, *prog_counter);
+            if (instruction == NULL) {
+                stats_halt(stats, program,
+                           (uint32_t)*prog_counter - block_start);
+                return EXEC_BAD_PC;
+            }
+        }
+
+        if (profile != NULL) {
+            profile_count(profile, (uint32_t)*prog_counter, instruction,
+                          registers);
+            if (instruction->opcode == HALT) {
+                profile_report(profile);
+            }
+        }
+
+        /* HALT doesn't come back, so its record is written first */
+        if (tracer != NULL && instruction->opcode == HALT) {
+            tracer_step(tracer, (uint32_t)*prog_counter, instruction,
+                        registers);
+            tracer_flush(tracer);
+        }
+
+        bool loads_program = (instruction->opcode == LOADP);
+        uint32_t pc = (uint32_t)*prog_counter;
+
+        /* stats only catch up at the end of the block, so add the rest */
+        if (seghist != NULL) {
+            if (instruction->opcode == ACTIVATE ||
+                instruction->opcode == INACTIVATE || loads_program) {
+                seghist_clock(seghist, stats->instructions +
+                                       (pc - block_start));
+            } else if (instruction->opcode == HALT) {
+                seghist_report(seghist);
+            }
+        }
+
+        /* LOADP can free the decoded array and SSTORE rewrite it */
+        struct Instruction_T retired = *instruction;
+
+        /* a LOADP of a segment that isn't mapped faults before it counts */
+        if (loads_program && registers[retired.register_B] != 0 &&
+            !segment_mapped(program, registers[retired.register_B])) {
+            stats_halt(stats, program, pc - block_start);
+            return EXEC_BAD_SEGMENT;
+        }
+
+        /* LOADP and HALT end the block that started at block_start */
+        if (loads_program) {
+            stats_loadp(stats, program, pc - block_start + 1, pc);
+            stats_checkpoint(stats, program, registers, pc);
+        } else if (instruction->opcode == HALT) {
+            stats_halt(stats, program, pc - block_start + 1);
+            stats_checkpoint(stats, program, registers, pc);
+        }
+
+        if (cache != NULL && instruction->opcode == HALT) {
+            cache_report(cache);
+        }
+
+        /* the load may overwrite its own id or offset, so they are kept */
+        uint32_t load_id = registers[retired.register_B];
+        uint32_t load_offset = registers[retired.register_C];
+
+        Exec_status status = switch_commands(instruction, program,
+                                             registers, prog_counter, io);
+
+        /* HALT was counted with its block above; the rest didn't run */
+        if (status != EXEC_RUNNING) {
+            if (status != EXEC_HALTED) {
+                stats_halt(stats, program, pc - block_start);
+            }
+            return status;
+        }
+
+        /* only looked up once the access is known to be in a segment, and
+         * after a store, which may give its segment a new copy */
+        if (cache != NULL && retired.opcode == SLOAD) {
+            cache_access(cache, pc, load_id,
+                         &segment_words(program, load_id)[load_offset], false);
+        } else if (cache != NULL && retired.opcode == SSTORE) {
+            uint32_t id = registers[retired.register_A];
+            cache_access(cache, pc, id, &segment_words(program, id)
+                         [registers[retired.register_B]], true);
+        }
+
+        if (tracer != NULL) {
+            tracer_step(tracer, pc, &retired, registers);
+        }
+
+        (*prog_counter)++; /* moves to next instruction */
+
+        /* a load program may have replaced segment 0, and jumped past it */
+        if (loads_program) {
+            code = segment_program(program);
+            block_start = (uint32_t)*prog_counter;
+            stats_enter(stats, block_start,
+                        registers[retired.register_B] != 0);
+
+            if (block_start >= (uint32_t)segment_length(program, 0)) {
+                return EXEC_BAD_PC;
+            }
+            if (stats_out_of_budget(stats)) {
+                return EXEC_OUT_OF_BUDGET;
+            }
+        }
+    }
+
+}
+
 /* switch_commands
  *
  *      Purpose: Command loop to execute instruction based on given opcode.
@@ -75,12 +628,15 @@ extern void execute(Memory_T program, uint32_t *registers, int *prog_counter)
  *               pointer to an array of registers, and a pointer to program
  *               counter to keep track of instructions.
  *
- *      Returns: None
+ *      Returns: EXEC_RUNNING, or EXEC_HALTED or the fault that kept the
+ *               instruction from running.
  *
- * Expectations: None
+ * Expectations: Always inlined, so the status folds into the loop's own
+ *               branches rather than being returned and tested.
 */
-static inline void switch_commands(T instruction, Memory_T memory,
-                                  uint32_t *registers, int *prog_counter)
+static inline Exec_status switch_commands(T instruction, Memory_T memory,
+                                          uint32_t *registers,
+                                          int *prog_counter, Io_T io)
 {
     (void)prog_counter;
 
@@ -92,15 +648,19 @@ static inline void switch_commands(T instruction, Memory_T memory,
             break;
 
         case SLOAD:
-            segmented_load(registers, instruction->register_A,
-                            instruction->register_B, instruction->register_C,
-                            memory);
+            if (!segmented_load(registers, instruction->register_A,
+                                instruction->register_B,
+                                instruction->register_C, memory)) {
+                return EXEC_BAD_SEGMENT;
+            }
             break;
 
         case SSTORE:
-            segmented_store(registers, instruction->register_A,
-                            instruction->register_B, instruction->register_C,
-                            memory);
+            if (!segmented_store(registers, instruction->register_A,
+                                 instruction->register_B,
+                                 instruction->register_C, memory)) {
+                return EXEC_BAD_SEGMENT;
+            }
             break;
 
         case ADD:
@@ -114,6 +674,9 @@ static inline void switch_commands(T instruction, Memory_T memory,
             break;
 
         case DIV:
+            if (registers[instruction->register_C] == 0) {
+                return EXEC_DIVIDE_BY_ZERO;
+            }
             division(registers, instruction->register_A,
                     instruction->register_B, instruction->register_C);
             break;
@@ -124,9 +687,7 @@ static inline void switch_commands(T instruction, Memory_T memory,
             break;
 
         case HALT:
-            free(instruction);
-            halt(memory);
-            break;
+            return EXEC_HALTED;
 
         case ACTIVATE:
             map_segment(registers, instruction->register_A,
@@ -135,19 +696,27 @@ static inline void switch_commands(T instruction, Memory_T memory,
             break;
 
         case INACTIVATE:
-            unmap_segment(registers, instruction->register_A,
-                           instruction->register_B, instruction->register_C,
-                           memory);
+            if (!unmap_segment(registers, instruction->register_A,
+                               instruction->register_B,
+                               instruction->register_C, memory)) {
+                return EXEC_BAD_SEGMENT;
+            }
             break;
 
         case OUT:
+            if (registers[instruction->register_C] > 255) {
+                return EXEC_BAD_OUTPUT;
+            }
             output(registers, instruction->register_A,
-                    instruction->register_B, instruction->register_C);
+                    instruction->register_B, instruction->register_C, io);
             break;
 
         case IN:
-            input(registers, instruction->register_A,
-                    instruction->register_B, instruction->register_C);
+            if (!input(registers, instruction->register_A,
+                       instruction->register_B, instruction->register_C,
+                       io)) {
+                return EXEC_BLOCKED;
+            }
             break;
 
         case LOADP:
@@ -159,40 +728,12 @@ static inline void switch_commands(T instruction, Memory_T memory,
         case LV:
             load_value(registers, instruction->register_A,
                         instruction->register_B, instruction->register_C,
-                        (uint32_t)instruction->register_C);
+                        instruction->value);
             break;
-    }
-
-}
-
-/* pack_instruction
- *
- *      Purpose: Command loop to execute instruction based on given opcode.
- *
- *   Parameters: Instance of instruction struct, a word that is passed in
- *               which holds an instruction.
- *
- *      Returns: A fully extracted instruction (instruction_T).
- *
- * Expectations: Valid opcode numbered 0 through 13.
-*/
-static inline T pack_instruction(T instruction, uint32_t word)
-{
-    /* pack opcode and make sure no bigger than 14 */
-    instruction->opcode = Bitpack_getu(word, 4, 28);
-    assert(instruction->opcode < 14);
-
-    if (instruction->opcode == 13) {
-        instruction->register_A = Bitpack_getu(word, 3, 25);
-        instruction->register_B = 0;
 
-        /* give register C the value of the instruction */
-        instruction->register_C = Bitpack_getu(word, 25, 0);
-    } else {
-        instruction->register_A = Bitpack_getu(word, 3, 6);
-        instruction->register_B = Bitpack_getu(word, 3, 3);
-        instruction->register_C = Bitpack_getu(word, 3, 0);
+        default:
+            return EXEC_BAD_OPCODE;
     }
 
-    return instruction; /* return packed instruction */
+    return EXEC_RUNNING;
 }
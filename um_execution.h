@@ -4,24 +4,205 @@
  * um
  *
  * Provides an interface for the declaration of a function to execute the
- * final program. Contains pointer to an incomplete struct to keep track of
- * individual functions.
+ * final program. Instructions are run from their decoded form, Instruction_T
+ * (see um_decode.h).
 */
 
 #ifndef UM_EXECUTION_
 #define UM_EXECUTION_
 
 #include <stdint.h>
+#include <stdbool.h>
 #include "um_segments.h"
+#include "um_io.h"
+#include "um_profile.h"
+#include "um_sample.h"
+#include "um_trace.h"
+#include "um_seghist.h"
+#include "um_cache.h"
 
-#define T Instruction_T
-typedef struct T *T; /* pointer to an incomplete struct */
+/*
+ * Counts kept by every engine. Between LOADPs a program only runs straight
+ * ahead, so the engines bring these up to date once per block, at each
+ * LOADP and at HALT, rather than once per instruction. The engine is the
+ * only writer; other threads and signal handlers may read them at any time
+ * (see um_live.h and um_sample.h).
+ */
+typedef struct Exec_stats Exec_stats;
+
+/*
+ * Called by every engine at a LOADP or HALT, before running it, once
+ *      instructions has reached next_checkpoint, with the machine's state
+ *      and the offset of that LOADP or HALT. It decides when it is next due.
+ */
+typedef void (*Exec_checkpoint)(Exec_stats *stats, Memory_T memory,
+                                const uint32_t *registers, uint32_t pc);
+
+struct Exec_stats {
+    uint64_t instructions;   /* retired */
+    uint64_t loadps;
+    Segment_usage segments;  /* refreshed every STATS_REFRESH + 1 LOADPs */
+    Exec_checkpoint checkpoint;   /* NULL unless someone is watching */
+    uint64_t next_checkpoint;
+    uint64_t budget_end;     /* return at a LOADP once reached; 0 for never */
+    uint32_t last_loadp;     /* offset of the last LOADP run */
+    uint32_t block_start;    /* where it jumped to, the block running now */
+};
+
+#define STATS_REFRESH 1023
+#define STATS_PROGRAM_LOAD 0x80000000u /* in last_loadp if it replaced 0 */
+
+/*
+ * Takes in counters, memory, the length of a block ending in LOADP and the
+ *      offset of that LOADP
+ */
+static inline void stats_loadp(Exec_stats *stats, Memory_T memory,
+                               uint32_t block_length, uint32_t pc)
+{
+    stats->last_loadp = pc;
+    stats->instructions += block_length;
+    if ((stats->loadps++ & STATS_REFRESH) == 0) {
+        stats->segments = segment_usage(memory);
+    }
+}
+
+/*
+ * Takes in counters, the pc a LOADP jumped to and whether it replaced
+ *      segment 0. Called once the jump is made, where the engine already
+ *      holds the pc, so publishing it costs the LOADP nothing more than
+ *      the store.
+ */
+static inline void stats_enter(Exec_stats *stats, uint32_t pc,
+                               bool loads_program)
+{
+    stats->block_start = pc;
+    if (loads_program) {
+        stats->last_loadp |= STATS_PROGRAM_LOAD;
+    }
+}
+
+/* Takes in counters, memory and the length of the block ending in HALT */
+static inline void stats_halt(Exec_stats *stats, Memory_T memory,
+                              uint32_t block_length)
+{
+    stats->instructions += block_length;
+    stats->segments = segment_usage(memory);
+}
+
+/* Takes in counters, memory, registers and the pc of a LOADP or HALT */
+static inline void stats_checkpoint(Exec_stats *stats, Memory_T memory,
+                                    const uint32_t *registers, uint32_t pc)
+{
+    if (stats->checkpoint != NULL &&
+        stats->instructions >= stats->next_checkpoint) {
+        stats->checkpoint(stats, memory, registers, pc);
+    }
+}
+
+/*
+ * Takes in counters after a LOADP and returns whether the engine should
+ *      return to its caller, so a runaway program is stopped at most one
+ *      straight-line block past its budget. A budget_end of 0 wraps round
+ *      to the largest count, leaving one comparison per LOADP either way.
+ */
+static inline bool stats_out_of_budget(const Exec_stats *stats)
+{
+    return stats->instructions - 1 >= stats->budget_end - 1;
+}
+
+/*
+ * Why an engine returned. Every engine leaves the registers and program
+ * counter as they were at the instruction it stopped on, which it didn't
+ * run unless it was HALT; memory and I/O are left for the caller to free.
+ * Out of budget, that instruction is the target of the LOADP just run;
+ * blocked, it is the IN that found no input. Either way calling the engine
+ * again carries on from there. At a bad pc there is no instruction: the pc
+ * is the LOADP target past the end of segment 0, or its length when a
+ * program ran off the end.
+ */
+typedef enum Exec_status {
+    EXEC_RUNNING = 0,       /* hasn't stopped */
+    EXEC_OUT_OF_BUDGET,     /* stopped at a LOADP past budget_end */
+    EXEC_BLOCKED,           /* stopped at an IN with no input ready yet */
+    EXEC_HALTED,
+    EXEC_DIVIDE_BY_ZERO,
+    EXEC_BAD_OUTPUT,        /* OUT of a value over 255 */
+    EXEC_BAD_OPCODE,        /* opcode 14 or 15 */
+    EXEC_BAD_PC,            /* pc past the end of segment 0 */
+    EXEC_BAD_SEGMENT        /* id not mapped, offset past its end, or an
+                               UNMAP of segment 0 */
+} Exec_status;
+
+/* Takes in a status and returns a description of it */
+extern const char *exec_status_name(Exec_status status);
+
+/* the threaded engine needs computed goto */
+#ifdef __GNUC__
+#define UM_HAVE_THREADED 1
+#endif
 
 /*
- * Takes in inputted program memory, active registers, and a program counter
- *      to execute a chain of instructions.
+ * Takes in inputted program memory, active registers, a program counter,
+ *      the machine's I/O state and counters to execute a chain of
+ *      instructions until HALT, a fault or the first LOADP once the
+ *      counters reach budget_end, returning why it stopped. Runs the native
+ *      engine when built with -DUM_JIT, the threaded engine with
+ *      -DUM_THREADED and the switch engine otherwise.
  */
-extern void execute(Memory_T program, uint32_t *registers, int *prog_counter);
+extern Exec_status execute(Memory_T program, uint32_t *registers,
+                           int *prog_counter, Io_T io, Exec_stats *stats);
+
+/* Same as execute(), always using the reference switch engine */
+extern Exec_status execute_switch(Memory_T program, uint32_t *registers,
+                                  int *prog_counter, Io_T io,
+                                  Exec_stats *stats);
+
+/*
+ * Same as execute_switch(), counting every instruction into profile and
+ *      writing its report at HALT
+ */
+extern Exec_status execute_profile(Memory_T program, uint32_t *registers,
+                                   int *prog_counter, Io_T io,
+                                   Exec_stats *stats, Profile_T profile);
+
+/*
+ * Same as execute(), sampling the block being run into sampler and writing
+ *      its folded stacks at HALT
+ */
+extern Exec_status execute_sample(Memory_T program, uint32_t *registers,
+                                  int *prog_counter, Io_T io, Exec_stats *stats,
+                                  Sampler_T sampler);
+
+/*
+ * Same as execute_switch(), recording every instruction into tracer and
+ *      writing out the rest of the trace at HALT
+ */
+extern Exec_status execute_trace(Memory_T program, uint32_t *registers,
+                                 int *prog_counter, Io_T io, Exec_stats *stats,
+                                 Tracer_T tracer);
+
+/*
+ * Same as execute_switch(), timing every map, unmap and load program for
+ *      seghist, which program memory must already feed, and writing its
+ *      report at HALT
+ */
+extern Exec_status execute_segments(Memory_T program, uint32_t *registers,
+                                    int *prog_counter, Io_T io,
+                                    Exec_stats *stats, Seghist_T seghist);
+
+/*
+ * Same as execute_switch(), running the word every SLOAD and SSTORE touches
+ *      through cache and writing its report at HALT
+ */
+extern Exec_status execute_cache(Memory_T program, uint32_t *registers,
+                                 int *prog_counter, Io_T io,
+                                 Exec_stats *stats, Cache_T cache);
+
+#ifdef UM_HAVE_THREADED
+/* Same as execute(), always using the computed-goto threaded engine */
+extern Exec_status execute_threaded(Memory_T program, uint32_t *registers,
+                                    int *prog_counter, Io_T io,
+                                    Exec_stats *stats);
+#endif
 
-#undef T
 #endif
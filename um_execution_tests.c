@@ -0,0 +1,302 @@
+/*
+ * um_execution_tests.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Contains all declarations and definitions of functions to test the
+ * engines of the um_execution.h interface directly, with the memory and
+ * I/O state a caller like um_main.c hands them. Tests through a "main()"
+ * that every engine, the analysis engines included, can be called again
+ * after stopping at an IN with nothing to read and carry on to HALT, and
+ * publishes each block it enters for the sampler.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "um_execution.h"
+#include "um_encode.h"
+
+/* macros ================================================================== */
+#define NUM_ENGINES 8
+
+/* function declarations =================================================== */
+void test_engines_resume();
+void test_engines_publish();
+static Exec_status run_engine(int engine, Memory_T memory,
+                              uint32_t *registers, int *prog_counter,
+                              Io_T io, Exec_stats *stats, FILE *report,
+                              int trace_fd);
+static void resume_engine(int engine);
+static void publish_engine(int engine);
+
+/* function definitions ==================================================== */
+int main()
+{
+    test_engines_resume();
+    test_engines_publish();
+
+    return 0;
+}
+
+/* test_engines_resume
+ *
+ *    Purpose: Test that every engine carries on after EXEC_BLOCKED
+ *
+ * Parameters: None
+ *    Returns: None
+ *
+ *      Tests: Each engine stops at an IN on an empty non-blocking pipe,
+ *             then is called again once a byte comes, echoes it and halts,
+ *             writing its report on the way
+ *
+*/
+void test_engines_resume()
+{
+    for (int engine = 0; engine < NUM_ENGINES; engine++) {
+        resume_engine(engine);
+    }
+}
+
+/* test_engines_publish
+ *
+ *    Purpose: Test that every engine publishes the blocks it enters
+ *
+ * Parameters: None
+ *    Returns: None
+ *
+ *      Tests: After a LOADP within segment 0 and one loading a new program,
+ *             each engine leaves the last LOADP's offset, marked as a
+ *             program load, and the block it jumped to in the counters
+ *
+*/
+void test_engines_publish()
+{
+    for (int engine = 0; engine < NUM_ENGINES; engine++) {
+        publish_engine(engine);
+    }
+}
+
+/* static function definitions============================================== */
+
+/* resume_engine
+ *
+ *    Purpose: Run one engine into a blocked IN and out again to HALT
+ *
+ * Parameters: Which engine, as numbered by run_engine
+ *    Returns: None
+ *
+*/
+static void resume_engine(int engine)
+{
+    const uint32_t echo[] = {
+        encode_word(IN, 0, 0, 1),
+        encode_word(OUT, 0, 0, 1),
+        encode_word(HALT, 0, 0, 0)
+    };
+    Memory_T memory = segment_new();
+    uint32_t segment_0 = segment_map(memory, 3);
+    memcpy(segment_words(memory, segment_0), echo, sizeof(echo));
+
+    int ends[2];
+    int made = pipe(ends);
+    assert(made == 0);
+    int set = fcntl(ends[0], F_SETFL, O_NONBLOCK);
+    assert(set == 0);
+    FILE *output = tmpfile();
+    FILE *report = tmpfile();
+    FILE *trace = tmpfile();
+    assert(output != NULL && report != NULL && trace != NULL);
+
+    Io_T io = io_new(ends[0], fileno(output));
+    uint32_t registers[8] = { 0 };
+    int prog_counter = 0;
+    Exec_stats stats = { 0 };
+
+    Exec_status status = run_engine(engine, memory, registers, &prog_counter,
+                                    io, &stats, report, fileno(trace));
+    assert(status == EXEC_BLOCKED);
+    assert(prog_counter == 0 && stats.instructions == 0);
+
+    ssize_t wrote = write(ends[1], "h", 1);
+    assert(wrote == 1);
+    status = run_engine(engine, memory, registers, &prog_counter, io,
+                        &stats, report, fileno(trace));
+    assert(status == EXEC_HALTED);
+    assert(prog_counter == 2 && stats.instructions == 3);
+    assert(registers[1] == 'h');
+
+    io_free(&io);
+    segment_free(memory);
+
+    char text[2] = { 0 };
+    rewind(output);
+    size_t got = fread(text, 1, 2, output);
+    assert(got == 1 && text[0] == 'h');
+
+    close(ends[0]);
+    close(ends[1]);
+    fclose(output);
+    fclose(report);
+    fclose(trace);
+}
+
+/* publish_engine
+ *
+ *    Purpose: Run one engine through two LOADPs to HALT
+ *
+ * Parameters: Which engine, as numbered by run_engine
+ *    Returns: None
+ *
+*/
+static void publish_engine(int engine)
+{
+    const uint32_t program[] = {
+        encode_lv(1, 3),
+        encode_word(LOADP, 0, 0, 1),            /* loadp 3 */
+        encode_word(HALT, 0, 0, 0),
+        encode_lv(2, 1),
+        encode_lv(1, 1),
+        encode_word(LOADP, 0, 2, 1)             /* load 1, jump to 1 */
+    };
+    const uint32_t loaded[] = {
+        encode_word(HALT, 0, 0, 0),
+        encode_word(HALT, 0, 0, 0)
+    };
+    Memory_T memory = segment_new();
+    uint32_t segment_0 = segment_map(memory, 6);
+    memcpy(segment_words(memory, segment_0), program, sizeof(program));
+    uint32_t segment_1 = segment_map(memory, 2);
+    memcpy(segment_words(memory, segment_1), loaded, sizeof(loaded));
+
+    FILE *output = tmpfile();
+    FILE *report = tmpfile();
+    FILE *trace = tmpfile();
+    assert(output != NULL && report != NULL && trace != NULL);
+
+    Io_T io = io_new(STDIN_FILENO, fileno(output));
+    uint32_t registers[8] = { 0 };
+    int prog_counter = 0;
+    Exec_stats stats = { 0 };
+
+    Exec_status status = run_engine(engine, memory, registers, &prog_counter,
+                                    io, &stats, report, fileno(trace));
+    assert(status == EXEC_HALTED);
+    assert(prog_counter == 1 && stats.loadps == 2);
+    assert(stats.last_loadp == (5 | STATS_PROGRAM_LOAD));
+    assert(stats.block_start == 1);
+
+    io_free(&io);
+    segment_free(memory);
+    fclose(output);
+    fclose(report);
+    fclose(trace);
+}
+
+/* run_engine
+ *
+ *    Purpose: Call one engine, making its analysis state on the first call
+ *             and freeing it once the program has halted
+ *
+ * Parameters: Which engine, 0 for execute() through 7, the machine's
+ *             memory, registers, pc, I/O and counters, and where reports
+ *             and the trace go
+ *    Returns: The status the engine returned
+ *
+*/
+static Exec_status run_engine(int engine, Memory_T memory,
+                              uint32_t *registers, int *prog_counter,
+                              Io_T io, Exec_stats *stats, FILE *report,
+                              int trace_fd)
+{
+    static Profile_T profile = NULL;
+    static Sampler_T sampler = NULL;
+    static Tracer_T tracer = NULL;
+    static Seghist_T seghist = NULL;
+    static Cache_T cache = NULL;
+    Exec_status status = EXEC_RUNNING;
+
+    switch (engine) {
+        case 0:
+            status = execute(memory, registers, prog_counter, io, stats);
+            break;
+
+        case 1:
+            status = execute_switch(memory, registers, prog_counter, io,
+                                    stats);
+            break;
+
+        case 2:
+#ifdef UM_HAVE_THREADED
+            status = execute_threaded(memory, registers, prog_counter, io,
+                                      stats);
+#else
+            status = execute_switch(memory, registers, prog_counter, io,
+                                    stats);
+#endif
+            break;
+
+        case 3:
+            if (profile == NULL) {
+                profile = profile_new(report);
+            }
+            status = execute_profile(memory, registers, prog_counter, io,
+                                     stats, profile);
+            if (status == EXEC_HALTED) {
+                profile_free(&profile);
+            }
+            break;
+
+        case 4:
+            if (sampler == NULL) {
+                sampler = sampler_new(report);
+            }
+            status = execute_sample(memory, registers, prog_counter, io,
+                                    stats, sampler);
+            if (status == EXEC_HALTED) {
+                sampler_free(&sampler);
+            }
+            break;
+
+        case 5:
+            if (tracer == NULL) {
+                tracer = tracer_new(trace_fd, true);
+            }
+            status = execute_trace(memory, registers, prog_counter, io,
+                                   stats, tracer);
+            if (status == EXEC_HALTED) {
+                tracer_free(&tracer);
+            }
+            break;
+
+        case 6:
+            if (seghist == NULL) {
+                seghist = seghist_new(report, NULL);
+                segment_observe(memory, seghist);
+            }
+            status = execute_segments(memory, registers, prog_counter, io,
+                                      stats, seghist);
+            if (status == EXEC_HALTED) {
+                segment_observe(memory, NULL);
+                seghist_free(&seghist);
+            }
+            break;
+
+        case 7:
+            if (cache == NULL) {
+                cache = cache_new(report, 32768, 64, 8);
+            }
+            status = execute_cache(memory, registers, prog_counter, io,
+                                   stats, cache);
+            if (status == EXEC_HALTED) {
+                cache_free(&cache);
+            }
+            break;
+    }
+    return status;
+}
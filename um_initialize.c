@@ -5,17 +5,34 @@
  *
  * Implementation of the um_initialize.h interface. Contains function that
  * creates new instance of a Memory_T and maps that to the zero segment. Then,
- * gets each individual instruction and stores in the zero segment.
+ * maps the program file and byte swaps its big-endian words straight into
+ * the zero segment, several words at a time where the host has SIMD.
 */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <sys/mman.h>
+
+#if defined(__AVX2__) || defined(__SSSE3__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
-#include "bitpack.h"
 #include "um_segments.h"
 #include "um_initialize.h"
 
+/* macros ================================================================== */
+#define READ_BLOCK 65536 /* words per read when the file can't be mapped */
+
+/* function declarations =================================================== */
+static void load_words(uint32_t *words, const unsigned char *bytes,
+                       size_t count);
+
+/* function definitions ==================================================== */
+
 /* initialize
  *
  *      Purpose: Initializes program and loads instructions in segment 0.
@@ -24,28 +41,99 @@
  *
  *      Returns: Filled program memory (Memory_T).
  *
- * Expectations: None.
+ * Expectations: File holds at least num_instructions words.
 */
 extern Memory_T initialize(FILE *fp, uint32_t num_instructions)
 {
     /* create new segment of length equal to the number of instructions */
     Memory_T memory = segment_new();
     uint32_t segment_0 = segment_map(memory, num_instructions);
+    uint32_t *words = segment_words(memory, segment_0);
+    size_t size = (size_t)num_instructions * sizeof(uint32_t);
+
+    if (size == 0) {
+        return memory;
+    }
 
-    /* loops through the number of instructions in segment 0 */
-    for (int i = 0; i < (int)num_instructions; i++) {
-        uint32_t instruction = 0;
+    /* maps the whole file and converts it in one pass */
+    void *bytes = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fileno(fp), 0);
 
-        /* loops for every first character of each set of 4 */
-        for (int j = sizeof(uint32_t) - 1; j >= 0; j--) {
-            int first_byte = getc(fp);
-            instruction = Bitpack_newu(instruction, 8, (j * 8),
-                                       (uint64_t)first_byte);
+    if (bytes != MAP_FAILED) {
+        madvise(bytes, size, MADV_SEQUENTIAL);
+        load_words(words, bytes, num_instructions);
+        munmap(bytes, size);
+        return memory;
+    }
+
+    /* otherwise reads it a large block at a time */
+    unsigned char *buffer = malloc(READ_BLOCK * sizeof(uint32_t));
+    assert(buffer != NULL);
+
+    for (size_t i = 0; i < num_instructions; i += READ_BLOCK) {
+        size_t count = num_instructions - i;
+        if (count > READ_BLOCK) {
+            count = READ_BLOCK;
         }
 
-        /* store each instruction in correct placement of segment 0 sequence */
-        segment_store(memory, segment_0, i, instruction);
+        size_t read = fread(buffer, sizeof(uint32_t), count, fp);
+        assert(read == count);
+        load_words(words + i, buffer, count);
     }
 
+    free(buffer);
     return memory;
 }
+
+/* static function definitions============================================== */
+
+/* load_words
+ *
+ *      Purpose: Convert big-endian words from the program file to host order.
+ *
+ *   Parameters: Where the words go, the raw bytes, and the number of words.
+ *
+ *      Returns: None
+ *
+ * Expectations: Both buffers hold count words; neither needs to be aligned.
+*/
+static void load_words(uint32_t *words, const unsigned char *bytes,
+                       size_t count)
+{
+    size_t i = 0;
+
+#if defined(__AVX2__)
+    /* reverses the bytes within each word, eight words at a time */
+    const __m256i reverse = _mm256_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                             11, 10, 9, 8, 15, 14, 13, 12,
+                                             3, 2, 1, 0, 7, 6, 5, 4,
+                                             11, 10, 9, 8, 15, 14, 13, 12);
+    for (; i + 8 <= count; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(bytes + 4 * i));
+        _mm256_storeu_si256((__m256i *)(words + i),
+                            _mm256_shuffle_epi8(v, reverse));
+    }
+#elif defined(__SSSE3__)
+    /* reverses the bytes within each word, four words at a time */
+    const __m128i reverse = _mm_setr_epi8(3, 2, 1, 0, 7, 6, 5, 4,
+                                          11, 10, 9, 8, 15, 14, 13, 12);
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(bytes + 4 * i));
+        _mm_storeu_si128((__m128i *)(words + i), _mm_shuffle_epi8(v, reverse));
+    }
+#elif defined(__SSE2__)
+    /* no byte shuffle, so swaps 16-bit halves and then bytes within them */
+    for (; i + 4 <= count; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(bytes + 4 * i));
+        v = _mm_or_si128(_mm_slli_epi32(v, 16), _mm_srli_epi32(v, 16));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8));
+        _mm_storeu_si128((__m128i *)(words + i), v);
+    }
+#endif
+
+    /* finishes whatever is left one word at a time */
+    for (; i < count; i++) {
+        const unsigned char *b = bytes + 4 * i;
+        words[i] = (uint32_t)b[0] << 24 | (uint32_t)b[1] << 16 |
+                   (uint32_t)b[2] << 8 | (uint32_t)b[3];
+    }
+}
@@ -90,15 +90,17 @@ void bitwise_nand(uint32_t *registers, unsigned A, unsigned B, unsigned C)
  *
  *      Purpose: Multiply two register values and store in the third.
  *
- *   Parameters: Pointer to the registers struct and the register number
- *               of the three registers to use in unwrapped word.
+ *   Parameters: Pointer to the registers struct, the register number
+ *               of the three registers to use in unwrapped word, and the
+ *               I/O state to queue the character on.
  *
  *      Returns: None
  *
  * Expectations: Registers pointer is not null and contents of register C
  *               contain a valid ascii number.
 */
-void output(uint32_t *registers, unsigned A, unsigned B, unsigned C)
+void output(uint32_t *registers, unsigned A, unsigned B, unsigned C,
+            Io_T io)
 {
     (void)A;
     (void)B;
@@ -106,7 +108,7 @@ void output(uint32_t *registers, unsigned A, unsigned B, unsigned C)
     assert(registers != NULL);
     assert(registers[C] <= 255); /* assert valid ascii character */
 
-    putchar(registers[C]);
+    io_put(io, (uint8_t)registers[C]);
 }
 
 /* input
@@ -114,43 +116,57 @@ void output(uint32_t *registers, unsigned A, unsigned B, unsigned C)
  *      Purpose: Take in an inputed character and load it into given register.
  *               Load register with max value if end of file has been reached.
  *
- *   Parameters: Pointer to the registers struct and the register number
- *               of the three registers to use in unwrapped word.
+ *   Parameters: Pointer to the registers struct, the register number
+ *               of the three registers to use in unwrapped word, and the
+ *               I/O state to read from.
  *
- *      Returns: None
+ *      Returns: False if the input is non-blocking and has nothing to read
+ *               yet, in which case register C is left alone; true otherwise.
  *
- * Expectations: Registers is not null, the input is a valid ascii character.
+ * Expectations: Registers is not null.
 */
-void input(uint32_t *registers, unsigned A, unsigned B, unsigned C)
+bool input(uint32_t *registers, unsigned A, unsigned B, unsigned C, Io_T io)
 {
     (void)A;
     (void)B;
     assert(registers != NULL);
 
-    /* get inputted char and check if valid ascii character */
-    int input = getchar();
-    assert(input >= 0 && input <= 255);
+    /* io_get writes out any prompt before it waits for the answer */
+    int input = io_get(io);
 
     /* checks if end of input has been reached */
-    if (input == EOF) {
+    if (input == IO_BLOCKED) {
+        return false;
+    } else if (input == EOF) {
         registers[C] = ~0; /* makes 32-bit word with all 1s */
     } else {
         registers[C] = (uint32_t)input;
     }
+    return true;
 }
 
 /* halt
  *
  *      Purpose: Terminate the program and free all memory.
  *
- *   Parameters: The instance of main memory being used.
+ *   Parameters: The instance of main memory being used and its I/O state.
  *
  *      Returns: None
  *
  * Expectations: None
 */
-void halt(Memory_T memory)
+void halt(Memory_T memory, Io_T io)
 {
+    io_free(&io);
+
+#ifdef UM_POOL_STATS
+    Pool_stats stats = segment_pool_stats(memory);
+    fprintf(stderr, "pool hits %llu, misses %llu, bytes held %llu\n",
+            (unsigned long long)stats.hits,
+            (unsigned long long)stats.misses,
+            (unsigned long long)stats.bytes);
+#endif
+
     segment_free(memory);
     exit(EXIT_SUCCESS);
 }
@@ -207,15 +223,16 @@ void conditional_move(uint32_t *registers, unsigned A, unsigned B, unsigned C)
  *               of the three registers to use in unwrapped word, and a
  *               pointer to an instance of main memory.
  *
- *      Returns: None
+ *      Returns: False if register B doesn't name a mapped segment or
+ *               register C is past its end, leaving register A alone.
  *
  * Expectations: Registers pointer is not null
 */
-void segmented_load(uint32_t *registers, unsigned A, unsigned B, unsigned C,
+bool segmented_load(uint32_t *registers, unsigned A, unsigned B, unsigned C,
                     Memory_T memory)
 {
     assert(registers != NULL);
-    registers[A] = segment_load(memory, registers[B], registers[C]);
+    return segment_load(memory, registers[B], registers[C], &registers[A]);
 }
 
 /* segmented_store
@@ -228,15 +245,16 @@ void segmented_load(uint32_t *registers, unsigned A, unsigned B, unsigned C,
  *               of the three registers to use in unwrapped word, and a
  *               pointer to an instance of main memory.
  *
- *      Returns: None
+ *      Returns: False if register A doesn't name a mapped segment or
+ *               register B is past its end, storing nothing.
  *
  * Expectations: Registers pointer is not null
 */
-void segmented_store(uint32_t *registers, unsigned A, unsigned B, unsigned C,
+bool segmented_store(uint32_t *registers, unsigned A, unsigned B, unsigned C,
                      Memory_T memory)
 {
     assert(registers != NULL);
-    segment_store(memory, registers[A], registers[B], registers[C]);
+    return segment_store(memory, registers[A], registers[B], registers[C]);
 }
 
 /* map_segment
@@ -270,18 +288,18 @@ void map_segment(uint32_t *registers, unsigned A, unsigned B,
  *               of the three registers to use in unwrapped word, and a
  *               pointer to an instance of main memory.
  *
- *      Returns: None
+ *      Returns: False if register C holds 0 or an id that isn't mapped.
  *
  * Expectations: Registers pointer is not null
 */
-void unmap_segment(uint32_t *registers, unsigned A, unsigned B, unsigned C,
+bool unmap_segment(uint32_t *registers, unsigned A, unsigned B, unsigned C,
                    Memory_T memory)
 {
     (void)A;
     (void)B;
 
     assert(registers != NULL);
-    segment_unmap(memory, registers[C]);
+    return segment_unmap(memory, registers[C]);
 }
 
 /* load_program
@@ -295,7 +313,8 @@ void unmap_segment(uint32_t *registers, unsigned A, unsigned B, unsigned C,
  *
  *      Returns: None
  *
- * Expectations: Registers pointer is not null
+ * Expectations: Registers pointer is not null and register B holds 0 or a
+ *               mapped id.
 */
 int load_program(uint32_t *registers, unsigned A, unsigned B, unsigned C,
                  Memory_T memory)
@@ -10,10 +10,15 @@
 #ifndef UM_INSTRUCTIONS_
 #define UM_INSTRUCTIONS_
 
+#include <stdbool.h>
 #include "um_segments.h"
+#include "um_io.h"
 
-/* Takes in inputted memory and stops all computations associated with it */
-void halt(Memory_T memory);
+/*
+ * Takes in inputted memory and I/O state and stops all computations
+ *      associated with them, writing out any queued output.
+ */
+void halt(Memory_T memory, Io_T io);
 
 /* Takes in inputted array of registers and a value to load into register A */
 void load_value(uint32_t *registers, unsigned A, unsigned B,
@@ -28,25 +33,34 @@ void conditional_move(uint32_t *registers, unsigned A,
 
 /*
  * Takes in inputted array of registers and memory to duplicate a segment in
- *      memory and return it.
+ *      memory and return it. The segment in register B has to be mapped.
 */
 int load_program(uint32_t *registers, unsigned A, unsigned B, unsigned C,
                  Memory_T memory);
 
-/* Takes in inputted array of registers and memory to load words from memory*/
-void segmented_load(uint32_t *registers, unsigned A, unsigned B,
+/*
+ * Takes in inputted array of registers and memory to load words from memory.
+ *      Returns false, leaving A as it was, if the word isn't in a segment.
+ */
+bool segmented_load(uint32_t *registers, unsigned A, unsigned B,
                                   unsigned C, Memory_T memory);
 
-/* Takes in inputted array of registers and memory to store words in memory*/
-void segmented_store(uint32_t *registers, unsigned A, unsigned B,
+/*
+ * Takes in inputted array of registers and memory to store words in memory.
+ *      Returns false, storing nothing, if the word isn't in a segment.
+ */
+bool segmented_store(uint32_t *registers, unsigned A, unsigned B,
                                    unsigned C, Memory_T memory);
 
 /* Takes in inputted array of registers and memory to activate new segment */
 void map_segment(uint32_t *registers, unsigned A, unsigned B,
                                unsigned C, Memory_T memory);
 
-/* Takes in inputted array of registers and memory to deactivate a segment */
-void unmap_segment(uint32_t *registers, unsigned A, unsigned B,
+/*
+ * Takes in inputted array of registers and memory to deactivate a segment.
+ *      Returns false if it is segment 0 or isn't mapped.
+ */
+bool unmap_segment(uint32_t *registers, unsigned A, unsigned B,
                                 unsigned C, Memory_T memory);
 
 /* Takes in inputted array of registers and adds two values */
@@ -65,13 +79,20 @@ void division(uint32_t *registers, unsigned A, unsigned B,
 void bitwise_nand(uint32_t *registers, unsigned A, unsigned B,
                                 unsigned C);
 
-/* Takes in inputted array of registers and outputs value in register C */
+/*
+ * Takes in inputted array of registers and I/O state and queues the value in
+ *      register C for output.
+ */
 void output(uint32_t *registers, unsigned A, unsigned B,
-                          unsigned C);
+                          unsigned C, Io_T io);
 
-/* Takes in inputted array of registers and loads inputted value in C */
-void input(uint32_t *registers, unsigned A, unsigned B,
-                         unsigned C);
+/*
+ * Takes in inputted array of registers and I/O state and loads inputted
+ *      value in C. Returns false, leaving C as it was, if the input is
+ *      non-blocking and has nothing yet, so the IN can be run again later.
+ */
+bool input(uint32_t *registers, unsigned A, unsigned B,
+                         unsigned C, Io_T io);
 
 #undef T
 #endif
@@ -138,7 +138,9 @@ void test_bitwise_nand()
 void test_output()
 {
     uint32_t registers[8] = { 0, 1, 2, 3, 4, 5, 6, 70 };
-    output(registers, 0, 0, 7);
+    Io_T io = io_new(0, 1);
+    output(registers, 0, 0, 7, io);
+    io_free(&io);
     printf("\n");
 
     // registers[7] = 256;
@@ -183,7 +185,7 @@ void test_input()
 void test_halt()
 {
     Memory_T memory = segment_new();
-    halt(memory);
+    halt(memory, io_new(0, 1));
 }
 
 /* test_load_value
@@ -0,0 +1,392 @@
+/*
+ * um_io.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Implementation of the um_io.h interface. Every live Io_T sits on a list so
+ * that a fatal signal (a failed assert, a division by zero, ^C) can still
+ * write out whatever output the machine produced before it died. The list
+ * is locked only while an Io_T is added or removed, so machines on other
+ * threads can come and go; IN and OUT never touch it. The handler can't
+ * take that lock, so links are stored atomically, an Io_T is only freed
+ * once no handler can be reading it, and one whose buffer is being written
+ * out is skipped rather than written twice.
+ *
+ * Input read from a regular file is mapped whole, so IN never calls into the
+ * kernel; anything else (a pipe, a terminal) is read a buffer at a time, and
+ * queued output is written before each of those reads in case it blocks.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <signal.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "um_io.h"
+
+#define T Io_T
+
+/* macros ================================================================== */
+#define OUT_BUFFER_SIZE 65536
+#define IN_BUFFER_SIZE 65536
+
+/* struct definition ======================================================= */
+struct T {
+    int in_fd, out_fd;
+    size_t out_used;        /* stored with release, for the handler */
+    bool flushing;          /* out is being written; the handler skips it */
+    const uint8_t *in_next; /* next unread input byte */
+    const uint8_t *in_end;  /* end of the input read so far */
+    void *in_map;           /* whole input file, if it could be mapped */
+    size_t in_map_size;
+    T next;                 /* next live I/O state, for the signal handler */
+    uint8_t out[OUT_BUFFER_SIZE];
+    uint8_t in[IN_BUFFER_SIZE];
+};
+
+/* every live I/O state, newest first */
+static T live = NULL;
+static pthread_mutex_t live_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* set up by io_install_signal_flush */
+static bool handlers_installed = false;
+static void (*flush_also)(void) = NULL;
+static int handlers_running = 0;
+
+/* signals after which queued output is still written */
+static const int fatal_signals[] = { SIGABRT, SIGSEGV, SIGBUS, SIGFPE,
+                                     SIGILL, SIGINT, SIGTERM, SIGHUP };
+
+/* function declarations =================================================== */
+static void map_input(T io);
+static ssize_t refill(T io);
+static void write_all(int fd, const uint8_t *bytes, size_t size);
+static void flush_on_signal(int signal_number);
+
+/* function definitions ==================================================== */
+
+/* io_new
+ *
+ *      Purpose: Create the I/O state of a machine and put it where a fatal
+ *               signal handler can find its output.
+ *
+ *   Parameters: Descriptor IN reads from and descriptor OUT writes to.
+ *
+ *      Returns: New instance of Io_T.
+ *
+ * Expectations: Both descriptors are open.
+*/
+extern T io_new(int in_fd, int out_fd)
+{
+    T io = malloc(sizeof(*io));
+    assert(io != NULL);
+
+    io->in_fd = in_fd;
+    io->out_fd = out_fd;
+    io->out_used = 0;
+    io->flushing = false;
+    io->in_next = io->in;
+    io->in_end = io->in;
+    io->in_map = NULL;
+    io->in_map_size = 0;
+    map_input(io);
+
+    /* published whole, so a handler never sees it half made */
+    pthread_mutex_lock(&live_lock);
+    io->next = live;
+    __atomic_store_n(&live, io, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&live_lock);
+
+    return io;
+}
+
+/* io_free
+ *
+ *      Purpose: Write out the remaining output and free the I/O state.
+ *
+ *   Parameters: Pointer to an instance of Io_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: io and *io are not null.
+*/
+extern void io_free(T *io)
+{
+    assert(io != NULL && *io != NULL);
+
+    io_flush(*io);
+
+    if ((*io)->in_map != NULL) {
+        munmap((*io)->in_map, (*io)->in_map_size);
+    }
+
+    /* unlink it before the memory goes away */
+    pthread_mutex_lock(&live_lock);
+    for (T *link = &live; *link != NULL; link = &(*link)->next) {
+        if (*link == *io) {
+            __atomic_store_n(link, (*io)->next, __ATOMIC_SEQ_CST);
+            break;
+        }
+    }
+    pthread_mutex_unlock(&live_lock);
+
+    /* a handler that started before the unlink may still be reading it; the
+     * process dies as soon as that handler is done */
+    while (__atomic_load_n(&handlers_running, __ATOMIC_SEQ_CST) > 0) {
+        sched_yield();
+    }
+
+    free(*io);
+    *io = NULL;
+}
+
+/* io_put
+ *
+ *      Purpose: Queue one byte of output, writing the buffer when it fills.
+ *
+ *   Parameters: Instance of Io_T and the byte to output.
+ *
+ *      Returns: None
+ *
+ * Expectations: io is not null.
+*/
+extern void io_put(T io, uint8_t byte)
+{
+    if (io->out_used == OUT_BUFFER_SIZE) {
+        io_flush(io);
+    }
+    io->out[io->out_used] = byte;
+    __atomic_store_n(&io->out_used, io->out_used + 1, __ATOMIC_RELEASE);
+}
+
+/* io_get
+ *
+ *      Purpose: Take the next byte of input, reading more when the buffer
+ *               runs dry.
+ *
+ *   Parameters: Instance of Io_T.
+ *
+ *      Returns: The byte, EOF at the end of the input, or IO_BLOCKED if
+ *               the descriptor is non-blocking and has nothing yet.
+ *
+ * Expectations: io is not null.
+*/
+extern int io_get(T io)
+{
+    if (io->in_next == io->in_end) {
+        ssize_t got = refill(io);
+        if (got <= 0) {
+            return (got == 0) ? EOF : IO_BLOCKED;
+        }
+    }
+    return *io->in_next++;
+}
+
+/* io_flush
+ *
+ *      Purpose: Write every queued byte of output.
+ *
+ *   Parameters: Instance of Io_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: io is not null.
+*/
+extern void io_flush(T io)
+{
+    assert(io != NULL);
+
+    __atomic_store_n(&io->flushing, true, __ATOMIC_SEQ_CST);
+    write_all(io->out_fd, io->out, io->out_used);
+    __atomic_store_n(&io->out_used, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&io->flushing, false, __ATOMIC_SEQ_CST);
+}
+
+/* io_install_signal_flush
+ *
+ *      Purpose: Install handlers that write out queued output on every
+ *               fatal signal, unless that was already done.
+ *
+ *   Parameters: A function for the handler to call after, or NULL.
+ *
+ *      Returns: None
+ *
+ * Expectations: Called from one thread, before any other thread is started.
+ *               Replaces whatever handlers those signals had.
+*/
+extern void io_install_signal_flush(void (*also)(void))
+{
+    if (handlers_installed) {
+        return;
+    }
+    flush_also = also;
+
+    struct sigaction action;
+    action.sa_handler = flush_on_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESETHAND;
+
+    int num_signals = sizeof(fatal_signals) / sizeof(fatal_signals[0]);
+    for (int i = 0; i < num_signals; i++) {
+        sigaction(fatal_signals[i], &action, NULL);
+    }
+    handlers_installed = true;
+}
+
+/* static function definitions============================================== */
+
+/* map_input
+ *
+ *      Purpose: Map the input if it is a regular file, starting from the
+ *               descriptor's current offset.
+ *
+ *   Parameters: Instance of Io_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: None. The input is left to refill() if it can't be mapped.
+*/
+static void map_input(T io)
+{
+    struct stat st;
+    if (fstat(io->in_fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return;
+    }
+
+    off_t offset = lseek(io->in_fd, 0, SEEK_CUR);
+    if (offset < 0 || offset >= st.st_size) {
+        return;
+    }
+
+    size_t size = (size_t)st.st_size;
+    void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, io->in_fd, 0);
+    if (map == MAP_FAILED) {
+        return;
+    }
+    madvise(map, size, MADV_SEQUENTIAL);
+
+    io->in_map = map;
+    io->in_map_size = size;
+    io->in_next = (const uint8_t *)map + offset;
+    io->in_end = (const uint8_t *)map + size;
+}
+
+/* refill
+ *
+ *      Purpose: Read the next block of input, first writing queued output
+ *               since the read may wait on whoever is reading it.
+ *
+ *   Parameters: Instance of Io_T.
+ *
+ *      Returns: How many bytes were read, 0 at the end of the input, or -1
+ *               if the descriptor is non-blocking and has none yet.
+ *
+ * Expectations: The buffer has been used up.
+*/
+static ssize_t refill(T io)
+{
+    /* a mapped file is there in full, so running out means the end */
+    if (io->in_map != NULL) {
+        return 0;
+    }
+
+    io_flush(io);
+
+    ssize_t got;
+    do {
+        got = read(io->in_fd, io->in, IN_BUFFER_SIZE);
+    } while (got < 0 && errno == EINTR);
+
+    if (got < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+        return -1;
+    }
+    if (got <= 0) {
+        return 0;
+    }
+
+    io->in_next = io->in;
+    io->in_end = io->in + got;
+    return got;
+}
+
+/* write_all
+ *
+ *      Purpose: Write a whole buffer, retrying short and interrupted writes.
+ *               A descriptor that is non-blocking, as the output can be
+ *               when it shares a terminal's file description with an input
+ *               um_sched made non-blocking, is waited on until it takes
+ *               more. Only calls write() and poll(), so it is safe in a
+ *               signal handler.
+ *
+ *   Parameters: Descriptor to write to, the bytes, and how many there are.
+ *
+ *      Returns: None
+ *
+ * Expectations: None. Output is dropped if the descriptor stops taking it.
+*/
+static void write_all(int fd, const uint8_t *bytes, size_t size)
+{
+    while (size > 0) {
+        ssize_t written = write(fd, bytes, size);
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                struct pollfd ready = { .fd = fd, .events = POLLOUT };
+                if (poll(&ready, 1, -1) >= 0 || errno == EINTR) {
+                    continue;
+                }
+            }
+            return;
+        }
+
+        bytes += written;
+        size -= (size_t)written;
+    }
+}
+
+/* flush_on_signal
+ *
+ *      Purpose: Write the output of every live machine that isn't in the
+ *               middle of writing it already, call the function given to
+ *               io_install_signal_flush, then die of the same signal with
+ *               its default action.
+ *
+ *   Parameters: The signal that was caught.
+ *
+ *      Returns: None
+ *
+ * Expectations: Installed with SA_RESETHAND, so raising it again kills us.
+*/
+static void flush_on_signal(int signal_number)
+{
+    int saved_errno = errno;
+    __atomic_add_fetch(&handlers_running, 1, __ATOMIC_SEQ_CST);
+
+    for (T io = __atomic_load_n(&live, __ATOMIC_SEQ_CST); io != NULL;
+         io = __atomic_load_n(&io->next, __ATOMIC_SEQ_CST)) {
+        if (!__atomic_load_n(&io->flushing, __ATOMIC_SEQ_CST)) {
+            write_all(io->out_fd, io->out,
+                      __atomic_load_n(&io->out_used, __ATOMIC_ACQUIRE));
+        }
+    }
+
+    if (flush_also != NULL) {
+        flush_also();
+    }
+
+    errno = saved_errno;
+    raise(signal_number);
+}
+
+#undef T
@@ -0,0 +1,56 @@
+/*
+ * um_io.h
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Provides an interface for the buffered input and output of one running
+ * machine. OUT collects bytes in memory and hands them to write() in large
+ * batches; the buffer is emptied at HALT, before any IN that could block
+ * and, once io_install_signal_flush() is called, from the handler of a
+ * signal that kills the process. IN takes
+ * bytes from a buffer filled by large read()s or, when the input is a
+ * regular file, straight from a mapping of that file.
+*/
+
+#ifndef UM_IO_
+#define UM_IO_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define T Io_T
+typedef struct T *T; /* pointer to the I/O state of one machine */
+
+/* Takes in the descriptors to read and write and returns new I/O state */
+extern T io_new(int in_fd, int out_fd);
+
+/* Takes in a pointer to I/O state, writes out what is left and frees it */
+extern void io_free(T *io);
+
+/* Takes in I/O state and a byte, and queues the byte for output */
+extern void io_put(T io, uint8_t byte);
+
+/* returned by io_get when a non-blocking input has nothing to read yet */
+#define IO_BLOCKED (-2)
+
+/*
+ * Takes in I/O state and returns the next input byte, or EOF once the input
+ *      is used up, or IO_BLOCKED if the input descriptor is non-blocking and
+ *      has nothing to read yet.
+ */
+extern int io_get(T io);
+
+/* Takes in I/O state and writes every queued byte */
+extern void io_flush(T io);
+
+/*
+ * Takes in a function to call after, or NULL, and has fatal signals write
+ *      the queued output of every live I/O state before the process dies.
+ *      The function has to be safe in a signal handler. Only the first call
+ *      installs anything; programs embedding machines can leave their own
+ *      handlers in place by never calling it.
+ */
+extern void io_install_signal_flush(void (*also)(void));
+
+#undef T
+#endif
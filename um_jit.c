@@ -0,0 +1,923 @@
+/*
+ * um_jit.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Implementation of the um_jit.h interface. Translates straight-line runs of
+ * segment 0 into x86-64 code in an mmap'd executable buffer. A block ends
+ * right before the first LOADP, HALT, IN, OUT or invalid opcode, which are
+ * run by a small interpreter loop in execute_jit. While a block runs, the
+ * eight UM registers live in host registers; MAP, UNMAP, SLOAD and SSTORE
+ * call straight into um_segments.c. A DIV by 0, or an access um_segments.c
+ * turns down, leaves its block without running, handing execute_jit the
+ * fault along with the pc.
+ *
+ * A store into segment 0 throws away just the blocks made from the word it
+ * changed, and the running block only leaves early if it is one of them, so
+ * data kept in segment 0 costs nothing extra. A word stored over
+ * MAX_REWRITES times after being translated is run by the interpreter loop
+ * from then on, and blocks end before it, rather than be translated again
+ * every pass. LOADP with a nonzero id resets everything for the new program.
+ * Otherwise translations are kept with the memory (see segment_attach) from
+ * one call to the next, so a program run a budget at a time, or stopping at
+ * every IN, is only translated once, and the code buffer is only mapped once
+ * per machine.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+
+#include "um_jit.h"
+
+#ifdef UM_HAVE_JIT
+
+#include <sys/mman.h>
+
+#include "um_instructions.h"
+#include "um_execution.h"
+
+#define T Instruction_T
+
+/* macros ================================================================== */
+#define CODE_BUFFER_SIZE (32 * 1024 * 1024)
+#define MAX_BLOCK 512       /* instructions per translated block */
+/* SSTORE emits the most, 88 bytes when its registers all need REX */
+#define MAX_INST_BYTES 88   /* upper bound on code emitted per instruction */
+#define EXIT_BYTES 15       /* code emitted by emit_exit */
+#define FRAME_BYTES 128     /* upper bound on prologue plus epilogue */
+#define MAX_REWRITES 4      /* stores into a translated word before it is
+                               left to the interpreter */
+
+/* x86-64 register numbers */
+enum { RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI,
+       R8, R9, R10, R11, R12, R13, R14, R15 };
+
+/*
+ * Where each UM register lives while a block runs. r0 to r5 sit in
+ * callee-saved registers; r6 and r7 are pushed around every call.
+ */
+static const int host[8] = { RBX, RBP, R12, R13, R14, R15, R10, R11 };
+
+/* struct definition ======================================================= */
+/* returns the pc to go on from, and in the upper half why it stopped there */
+typedef uint64_t (*Block)(uint32_t *registers);
+
+struct Jit {
+    Memory_T memory;
+    uint8_t *buffer;       /* executable code */
+    size_t used;
+    uint8_t **entries;     /* translated block per pc of segment 0 */
+    uint16_t *sizes;       /* instructions in the block at each entry */
+    uint16_t *covers;      /* how many blocks each word was translated into */
+    uint8_t *rewrites;     /* stores that voided a translation of each word */
+    int length;            /* length of segment 0 */
+    uint32_t running;      /* pc of the block running now */
+    uint8_t stale;         /* set by a store into the running block */
+};
+
+/* marks a pc that starts with an instruction the interpreter has to run */
+static uint8_t interpret_here;
+
+/* function declarations =================================================== */
+static struct Jit *jit_new(Memory_T memory);
+static void jit_free(void *jit);
+static void jit_flush(struct Jit *jit);
+static void jit_reset(void *jit);
+static void jit_stored(void *jit, uint32_t offset);
+static void jit_drop(struct Jit *jit, uint32_t pc);
+static Exec_status interpret(T instruction, Memory_T memory,
+                             uint32_t *registers);
+static uint8_t *translate(struct Jit *jit, T code, uint32_t pc);
+static bool translatable(unsigned opcode);
+static void emit_instruction(struct Jit *jit, T instruction, uint32_t next,
+                             size_t *exits, int *num_exits);
+static void emit_call(struct Jit *jit, void *function, int num_args,
+                      const int *args, bool out);
+static void emit_fault_check(struct Jit *jit, uint32_t pc, size_t *exits,
+                             int *num_exits);
+static void emit_exit(struct Jit *jit, uint32_t pc, Exec_status status,
+                      size_t *exits, int *num_exits);
+static void emit_byte(struct Jit *jit, uint8_t byte);
+static void emit_u32(struct Jit *jit, uint32_t value);
+static void emit_u64(struct Jit *jit, uint64_t value);
+static void emit_rex(struct Jit *jit, int reg, int rm);
+static void emit_rr(struct Jit *jit, uint8_t op, int reg, int rm);
+static void emit_0f_rr(struct Jit *jit, uint8_t op, int reg, int rm);
+
+/* how the memory tells the translator segment 0 was replaced or changed */
+static const Segment_engine jit_engine = { jit_reset, jit_stored, jit_free };
+
+/* function definitions ==================================================== */
+
+/* execute_jit
+ *
+ *      Purpose: Run the program, translating each block of segment 0 the
+ *               first time it is reached and interpreting the instructions
+ *               that end blocks.
+ *
+ *   Parameters: Instance of program memory, pointer to an array of
+ *               registers, a pointer to program counter to keep track of
+ *               instructions, the I/O state for IN and OUT, and the counters
+ *               to keep up to date.
+ *
+ *      Returns: Why it stopped, EXEC_BAD_PC if a jump or a block without a
+ *               LOADP or HALT at its end leaves segment 0.
+ *
+ * Expectations: None. Falls back to the switch engine if no executable
+ *               memory can be had. The translations made are left with the
+ *               memory for the next call, and freed along with it.
+*/
+extern Exec_status execute_jit(Memory_T program, uint32_t *registers,
+                               int *prog_counter, Io_T io, Exec_stats *stats)
+{
+    struct Jit *jit = segment_engine_state(program, &jit_engine);
+
+    if (jit == NULL) {
+        jit = jit_new(program);
+        if (jit == NULL) {
+            return execute_switch(program, registers, prog_counter, io,
+                                  stats);
+        }
+        segment_attach(program, &jit_engine, jit);
+    }
+
+    T code = segment_program(program);
+    uint32_t pc = (uint32_t)*prog_counter;
+    uint32_t block_start = pc; /* straight-line run since the last LOADP */
+    Exec_status status = EXEC_RUNNING;
+
+    /* runs until halt is reached or a fault */
+    while (status == EXEC_RUNNING) {
+        /* a LOADP, or a block without one at the end, can leave segment 0;
+         * there is no entry, or decoded word, to read past it */
+        if (pc >= (uint32_t)jit->length) {
+            status = EXEC_BAD_PC;
+            break;
+        }
+
+        uint8_t *entry = jit->entries[pc];
+
+        if (entry == NULL) {
+            entry = translate(jit, code, pc);
+        }
+
+        if (entry != &interpret_here) {
+            jit->running = pc;
+            jit->stale = 0;
+
+            uint64_t exit = ((Block)(void *)entry)(registers);
+            pc = (uint32_t)exit;
+            status = (Exec_status)(exit >> 32);
+            continue;
+        }
+
+        T instruction = &code[pc];
+        unsigned A = instruction->register_A;
+        unsigned B = instruction->register_B;
+        unsigned C = instruction->register_C;
+
+        switch (instruction->opcode) {
+            case OUT:
+                if (registers[C] > 255) {
+                    status = EXEC_BAD_OUTPUT;
+                    break;
+                }
+                output(registers, A, B, C, io);
+                pc++;
+                break;
+
+            case IN:
+                if (!input(registers, A, B, C, io)) {
+                    status = EXEC_BLOCKED;
+                    break;
+                }
+                pc++;
+                break;
+
+            case LOADP:
+                /* checked before it is counted, since a fault doesn't run */
+                if (registers[B] != 0 && !segment_mapped(program,
+                                                         registers[B])) {
+                    status = EXEC_BAD_SEGMENT;
+                    break;
+                }
+                stats_loadp(stats, program, pc - block_start + 1, pc);
+                stats_checkpoint(stats, program, registers, pc);
+                /* which resets the translator through jit_engine */
+                if (registers[B] != 0) {
+                    segment_load_program(program, registers[B]);
+                    code = segment_program(program);
+                }
+                pc = registers[C];
+                block_start = pc;
+                stats_enter(stats, pc, registers[B] != 0);
+
+                if (stats_out_of_budget(stats)) {
+                    status = EXEC_OUT_OF_BUDGET;
+                }
+                break;
+
+            case HALT:
+                stats_halt(stats, program, pc - block_start + 1);
+                stats_checkpoint(stats, program, registers, pc);
+                *prog_counter = (int)pc;
+                return EXEC_HALTED;
+
+            default:
+                /* else a word stored over too often to translate again */
+                if (!translatable(instruction->opcode)) {
+                    status = EXEC_BAD_OPCODE;
+                    break;
+                }
+                status = interpret(instruction, program, registers);
+                if (status == EXEC_RUNNING) {
+                    pc++;
+                }
+                break;
+        }
+    }
+
+    /* a fault, a blocked IN, or the next block out of budget; pc didn't run */
+    stats_halt(stats, program, pc - block_start);
+    *prog_counter = (int)pc;
+    return status;
+}
+
+/* static function definitions============================================== */
+
+/* jit_new
+ *
+ *      Purpose: Set up the code buffer and block table for a program.
+ *
+ *   Parameters: The program memory.
+ *
+ *      Returns: The translator state, or NULL if executable memory couldn't
+ *               be mapped.
+ *
+ * Expectations: Segment 0 is mapped. The buffer is only reserved, so pages
+ *               cost nothing until code is written to them, however many
+ *               machines keep one.
+*/
+static struct Jit *jit_new(Memory_T memory)
+{
+    struct Jit *jit = malloc(sizeof(*jit));
+    assert(jit != NULL);
+
+    jit->buffer = mmap(NULL, CODE_BUFFER_SIZE,
+                       PROT_READ | PROT_WRITE | PROT_EXEC,
+                       MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (jit->buffer == MAP_FAILED) {
+        free(jit);
+        return NULL;
+    }
+
+    jit->memory = memory;
+    jit->entries = NULL;
+    jit->sizes = NULL;
+    jit->covers = NULL;
+    jit->rewrites = NULL;
+    jit_reset(jit);
+
+    return jit;
+}
+
+/* jit_free
+ *
+ *      Purpose: Release the code buffer and block table, once the memory
+ *               they were kept with is freed.
+ *
+ *   Parameters: The translator state.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void jit_free(void *jit)
+{
+    struct Jit *self = jit;
+
+    munmap(self->buffer, CODE_BUFFER_SIZE);
+    free(self->entries);
+    free(self->sizes);
+    free(self->covers);
+    free(self->rewrites);
+    free(self);
+}
+
+/* jit_flush
+ *
+ *      Purpose: Forget every translation of the current segment 0, keeping
+ *               count of the words stored over.
+ *
+ *   Parameters: The translator state.
+ *
+ *      Returns: None
+ *
+ * Expectations: No block is running.
+*/
+static void jit_flush(struct Jit *jit)
+{
+    memset(jit->entries, 0, jit->length * sizeof(*jit->entries));
+    memset(jit->sizes, 0, jit->length * sizeof(*jit->sizes));
+    memset(jit->covers, 0, jit->length * sizeof(*jit->covers));
+    jit->used = 0;
+}
+
+/* jit_reset
+ *
+ *      Purpose: Forget every translation and size the block table for a
+ *               newly loaded segment 0.
+ *
+ *   Parameters: The translator state.
+ *
+ *      Returns: None
+ *
+ * Expectations: Called when the translator is made, and by
+ *               segment_load_program through jit_engine.
+*/
+static void jit_reset(void *state)
+{
+    struct Jit *jit = state;
+    jit->length = segment_length(jit->memory, 0);
+
+    free(jit->entries);
+    free(jit->sizes);
+    free(jit->covers);
+    free(jit->rewrites);
+    jit->entries = calloc(jit->length + 1, sizeof(*jit->entries));
+    jit->sizes = calloc(jit->length + 1, sizeof(*jit->sizes));
+    jit->covers = calloc(jit->length + 1, sizeof(*jit->covers));
+    jit->rewrites = calloc(jit->length + 1, sizeof(*jit->rewrites));
+    assert(jit->entries != NULL && jit->sizes != NULL);
+    assert(jit->covers != NULL && jit->rewrites != NULL);
+
+    jit->used = 0;
+    jit->running = 0;
+    jit->stale = 0;
+}
+
+/* jit_stored
+ *
+ *      Purpose: Throw away the blocks translated from a word of segment 0
+ *               that a store just changed.
+ *
+ *   Parameters: The translator state and the offset stored into.
+ *
+ *      Returns: None
+ *
+ * Expectations: Called by segment_store through jit_engine. Sets stale if
+ *               the running block was one of them, for it to leave right
+ *               after the store.
+*/
+static void jit_stored(void *state, uint32_t offset)
+{
+    struct Jit *jit = state;
+
+    /* nothing was translated from it, as with data kept in segment 0 */
+    if (jit->covers[offset] == 0) {
+        return;
+    }
+
+    if (jit->rewrites[offset] < MAX_REWRITES) {
+        jit->rewrites[offset]++;
+    }
+    if (offset >= jit->running &&
+        offset - jit->running < jit->sizes[jit->running]) {
+        jit->stale = 1;
+    }
+
+    /* only blocks starting up to a block's length before it can hold it */
+    uint32_t start = (offset >= MAX_BLOCK) ? offset - (MAX_BLOCK - 1) : 0;
+
+    for (; start <= offset && jit->covers[offset] > 0; start++) {
+        if (offset - start < jit->sizes[start]) {
+            jit_drop(jit, start);
+        }
+    }
+}
+
+/* jit_drop
+ *
+ *      Purpose: Forget the block translated at a pc. Its code stays in the
+ *               buffer, unreachable, until the buffer is flushed.
+ *
+ *   Parameters: The translator state and the pc the block starts at.
+ *
+ *      Returns: None
+ *
+ * Expectations: A block was translated at pc.
+*/
+static void jit_drop(struct Jit *jit, uint32_t pc)
+{
+    for (uint32_t i = pc; i < pc + jit->sizes[pc]; i++) {
+        jit->covers[i]--;
+    }
+
+    jit->entries[pc] = NULL;
+    jit->sizes[pc] = 0;
+}
+
+/* interpret
+ *
+ *      Purpose: Run one instruction that could have been translated, for a
+ *               word left to the interpreter loop.
+ *
+ *   Parameters: The decoded instruction, the program memory and the
+ *               registers.
+ *
+ *      Returns: EXEC_RUNNING, or the fault that kept it from running.
+ *
+ * Expectations: Instruction is translatable.
+*/
+static Exec_status interpret(T instruction, Memory_T memory,
+                             uint32_t *registers)
+{
+    unsigned A = instruction->register_A;
+    unsigned B = instruction->register_B;
+    unsigned C = instruction->register_C;
+
+    switch (instruction->opcode) {
+        case CMOV:
+            conditional_move(registers, A, B, C);
+            break;
+
+        case SLOAD:
+            if (!segmented_load(registers, A, B, C, memory)) {
+                return EXEC_BAD_SEGMENT;
+            }
+            break;
+
+        case SSTORE:
+            if (!segmented_store(registers, A, B, C, memory)) {
+                return EXEC_BAD_SEGMENT;
+            }
+            break;
+
+        case ADD:
+            addition(registers, A, B, C);
+            break;
+
+        case MUL:
+            multiplication(registers, A, B, C);
+            break;
+
+        case DIV:
+            if (registers[C] == 0) {
+                return EXEC_DIVIDE_BY_ZERO;
+            }
+            division(registers, A, B, C);
+            break;
+
+        case NAND:
+            bitwise_nand(registers, A, B, C);
+            break;
+
+        case ACTIVATE:
+            map_segment(registers, A, B, C, memory);
+            break;
+
+        case INACTIVATE:
+            if (!unmap_segment(registers, A, B, C, memory)) {
+                return EXEC_BAD_SEGMENT;
+            }
+            break;
+
+        case LV:
+            load_value(registers, A, B, C, instruction->value);
+            break;
+
+        default:
+            assert(!"untranslatable opcode");
+    }
+
+    return EXEC_RUNNING;
+}
+
+/* translate
+ *
+ *      Purpose: Translate the block starting at pc and remember where it is.
+ *
+ *   Parameters: The translator state, decoded segment 0 and the pc.
+ *
+ *      Returns: Entry point of the block, or &interpret_here if the
+ *               instruction at pc has to be interpreted.
+ *
+ * Expectations: pc is within segment 0.
+*/
+static uint8_t *translate(struct Jit *jit, T code, uint32_t pc)
+{
+    int count = 0;
+
+    while ((int)pc + count < jit->length && count < MAX_BLOCK) {
+        T instruction = &code[pc + count];
+
+        if (instruction->opcode == NOT_DECODED) {
+            instruction = segment_decode(jit->memory, pc + count);
+        }
+        /* ends before words stored over too often to be worth it */
+        if (!translatable(instruction->opcode) ||
+            jit->rewrites[pc + count] >= MAX_REWRITES) {
+            break;
+        }
+        count++;
+    }
+
+    if (count == 0) {
+        jit->entries[pc] = &interpret_here;
+        return &interpret_here;
+    }
+
+    /* starts over with an empty buffer rather than run out of room */
+    if (jit->used + FRAME_BYTES + count * MAX_INST_BYTES > CODE_BUFFER_SIZE) {
+        jit_flush(jit);
+    }
+
+
+    uint8_t *entry = jit->buffer + jit->used;
+    size_t exits[2 * MAX_BLOCK];    /* an SSTORE has two */
+    int num_exits = 0;
+
+    /* prologue: save callee-saved registers and the register file pointer */
+    emit_byte(jit, 0x53);                           /* push rbx */
+    emit_byte(jit, 0x55);                           /* push rbp */
+    emit_byte(jit, 0x41); emit_byte(jit, 0x54);     /* push r12 */
+    emit_byte(jit, 0x41); emit_byte(jit, 0x55);     /* push r13 */
+    emit_byte(jit, 0x41); emit_byte(jit, 0x56);     /* push r14 */
+    emit_byte(jit, 0x41); emit_byte(jit, 0x57);     /* push r15 */
+    emit_byte(jit, 0x57);                           /* push rdi */
+
+    for (int i = 0; i < 8; i++) {                   /* mov reg, [rdi+4i] */
+        emit_rex(jit, host[i], RDI);
+        emit_byte(jit, 0x8B);
+        emit_byte(jit, 0x40 | ((host[i] & 7) << 3) | RDI);
+        emit_byte(jit, 4 * i);
+    }
+
+    for (int i = 0; i < count; i++) {
+        size_t before = jit->used;
+        emit_instruction(jit, &code[pc + i], pc + i + 1, exits, &num_exits);
+        assert(jit->used - before <= MAX_INST_BYTES);
+    }
+
+    /* falls off the end of the block into the epilogue */
+    emit_byte(jit, 0xB8);                           /* mov eax, next pc */
+    emit_u32(jit, pc + count);
+
+    /* epilogue: write the registers back and restore the host's */
+    size_t epilogue = jit->used;
+
+    emit_byte(jit, 0x5F);                           /* pop rdi */
+    for (int i = 0; i < 8; i++) {                   /* mov [rdi+4i], reg */
+        emit_rex(jit, host[i], RDI);
+        emit_byte(jit, 0x89);
+        emit_byte(jit, 0x40 | ((host[i] & 7) << 3) | RDI);
+        emit_byte(jit, 4 * i);
+    }
+    emit_byte(jit, 0x41); emit_byte(jit, 0x5F);     /* pop r15 */
+    emit_byte(jit, 0x41); emit_byte(jit, 0x5E);     /* pop r14 */
+    emit_byte(jit, 0x41); emit_byte(jit, 0x5D);     /* pop r13 */
+    emit_byte(jit, 0x41); emit_byte(jit, 0x5C);     /* pop r12 */
+    emit_byte(jit, 0x5D);                           /* pop rbp */
+    emit_byte(jit, 0x5B);                           /* pop rbx */
+    emit_byte(jit, 0xC3);                           /* ret */
+
+    assert(jit->used - (size_t)(entry - jit->buffer) <=
+           FRAME_BYTES + (size_t)count * MAX_INST_BYTES);
+
+    /* points every early exit at the epilogue */
+    for (int i = 0; i < num_exits; i++) {
+        int32_t rel = (int32_t)(epilogue - (exits[i] + 4));
+        memcpy(jit->buffer + exits[i], &rel, sizeof(rel));
+    }
+
+    jit->entries[pc] = entry;
+    jit->sizes[pc] = (uint16_t)count;
+    for (int i = 0; i < count; i++) {
+        jit->covers[pc + i]++;
+    }
+
+    return entry;
+}
+
+/* translatable
+ *
+ *      Purpose: Tell whether an opcode can be part of a translated block.
+ *
+ *   Parameters: The opcode.
+ *
+ *      Returns: True for everything but LOADP, HALT, IN, OUT and invalid
+ *               opcodes.
+ *
+ * Expectations: None
+*/
+static bool translatable(unsigned opcode)
+{
+    switch (opcode) {
+        case CMOV: case SLOAD: case SSTORE: case ADD: case MUL: case DIV:
+        case NAND: case ACTIVATE: case INACTIVATE: case LV:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+/* emit_instruction
+ *
+ *      Purpose: Emit the native code for one instruction.
+ *
+ *   Parameters: The translator state, the decoded instruction, the pc of
+ *               the instruction after it, and the list of early exits whose
+ *               jump to the epilogue still has to be patched.
+ *
+ *      Returns: None
+ *
+ * Expectations: Instruction is translatable.
+*/
+static void emit_instruction(struct Jit *jit, T instruction, uint32_t next,
+                             size_t *exits, int *num_exits)
+{
+    int A = host[instruction->register_A];
+    int B = host[instruction->register_B];
+    int C = host[instruction->register_C];
+
+    switch (instruction->opcode) {
+        case CMOV:
+            emit_rr(jit, 0x85, C, C);               /* test C, C */
+            emit_0f_rr(jit, 0x45, A, B);            /* cmovne A, B */
+            break;
+
+        case ADD:
+            emit_rr(jit, 0x89, B, RAX);             /* mov eax, B */
+            emit_rr(jit, 0x01, C, RAX);             /* add eax, C */
+            emit_rr(jit, 0x89, RAX, A);             /* mov A, eax */
+            break;
+
+        case MUL:
+            emit_rr(jit, 0x89, B, RAX);             /* mov eax, B */
+            emit_0f_rr(jit, 0xAF, RAX, C);          /* imul eax, C */
+            emit_rr(jit, 0x89, RAX, A);             /* mov A, eax */
+            break;
+
+        case DIV:
+            /* leaves the block at the DIV if C is 0 */
+            emit_rr(jit, 0x85, C, C);               /* test C, C */
+            emit_byte(jit, 0x75);                   /* jnz over the exit */
+            emit_byte(jit, EXIT_BYTES);
+            emit_exit(jit, next - 1, EXEC_DIVIDE_BY_ZERO, exits, num_exits);
+
+            emit_rr(jit, 0x89, B, RAX);             /* mov eax, B */
+            emit_rr(jit, 0x31, RDX, RDX);           /* xor edx, edx */
+            emit_rr(jit, 0xF7, 6, C);               /* div C */
+            emit_rr(jit, 0x89, RAX, A);             /* mov A, eax */
+            break;
+
+        case NAND:
+            emit_rr(jit, 0x89, B, RAX);             /* mov eax, B */
+            emit_rr(jit, 0x21, C, RAX);             /* and eax, C */
+            emit_rr(jit, 0xF7, 2, RAX);             /* not eax */
+            emit_rr(jit, 0x89, RAX, A);             /* mov A, eax */
+            break;
+
+        case LV:
+            emit_rex(jit, 0, A);                    /* mov A, value */
+            emit_byte(jit, 0xB8 | (A & 7));
+            emit_u32(jit, instruction->value);
+            break;
+
+        case SLOAD: {
+            const int args[] = { B, C };
+            emit_call(jit, (void *)segment_load, 2, args, true);
+            emit_fault_check(jit, next - 1, exits, num_exits);
+            emit_rr(jit, 0x89, RCX, A);             /* mov A, ecx */
+            break;
+        }
+
+        case ACTIVATE: {
+            const int args[] = { C };
+            emit_call(jit, (void *)segment_map, 1, args, false);
+            emit_rr(jit, 0x89, RAX, B);             /* mov B, eax */
+            break;
+        }
+
+        case INACTIVATE: {
+            const int args[] = { C };
+            emit_call(jit, (void *)segment_unmap, 1, args, false);
+            emit_fault_check(jit, next - 1, exits, num_exits);
+            break;
+        }
+
+        case SSTORE: {
+            const int args[] = { A, B, C };
+            emit_call(jit, (void *)segment_store, 3, args, false);
+            emit_fault_check(jit, next - 1, exits, num_exits);
+
+            /* leaves the block if the store changed the block's own words */
+            emit_rr(jit, 0x85, A, A);               /* test A, A */
+            emit_byte(jit, 0x75);                   /* jnz over the exit */
+            emit_byte(jit, 10 + 3 + 2 + 5 + 5);
+
+            emit_byte(jit, 0x48);                   /* mov rax, &stale */
+            emit_byte(jit, 0xB8);
+            emit_u64(jit, (uint64_t)(uintptr_t)&jit->stale);
+            emit_byte(jit, 0x80);                   /* cmp byte [rax], 0 */
+            emit_byte(jit, 0x38);
+            emit_byte(jit, 0x00);
+            emit_byte(jit, 0x74);                   /* je over the exit */
+            emit_byte(jit, 5 + 5);
+            emit_byte(jit, 0xB8);                   /* mov eax, next pc */
+            emit_u32(jit, next);
+            emit_byte(jit, 0xE9);                   /* jmp epilogue */
+            exits[(*num_exits)++] = jit->used;
+            emit_u32(jit, 0);
+            break;
+        }
+
+        default:
+            assert(!"untranslatable opcode");
+    }
+}
+
+/* emit_call
+ *
+ *      Purpose: Emit a call to a um_segments.c function taking the memory
+ *               followed by up to three UM registers.
+ *
+ *   Parameters: The translator state, the function, the number of register
+ *               arguments and the host registers holding them, and whether
+ *               the function also takes a pointer to a word it fills in.
+ *
+ *      Returns: None. The function's result is left in eax and, with out,
+ *               the word in ecx.
+ *
+ * Expectations: Stack is 16-byte aligned at the call site, which holds for
+ *               code emitted between the prologue and epilogue. With out,
+ *               there are at most two register arguments.
+*/
+static void emit_call(struct Jit *jit, void *function, int num_args,
+                      const int *args, bool out)
+{
+    static const int arg_registers[] = { RSI, RDX, RCX };
+
+    emit_byte(jit, 0x41); emit_byte(jit, 0x52);     /* push r10 */
+    emit_byte(jit, 0x41); emit_byte(jit, 0x53);     /* push r11 */
+    if (out) {
+        emit_byte(jit, 0x48); emit_byte(jit, 0x83); /* sub rsp, 16 */
+        emit_byte(jit, 0xEC); emit_byte(jit, 16);
+    }
+
+    emit_byte(jit, 0x48);                           /* mov rdi, memory */
+    emit_byte(jit, 0xB8 | RDI);
+    emit_u64(jit, (uint64_t)(uintptr_t)jit->memory);
+
+    for (int i = 0; i < num_args; i++) {            /* mov arg, reg */
+        emit_rr(jit, 0x89, args[i], arg_registers[i]);
+    }
+    if (out) {                                      /* mov arg, rsp */
+        emit_byte(jit, 0x48);
+        emit_byte(jit, 0x89);
+        emit_byte(jit, 0xC0 | (RSP << 3) | arg_registers[num_args]);
+    }
+
+    emit_byte(jit, 0x48);                           /* mov rax, function */
+    emit_byte(jit, 0xB8);
+    emit_u64(jit, (uint64_t)(uintptr_t)function);
+    emit_byte(jit, 0xFF);                           /* call rax */
+    emit_byte(jit, 0xD0);
+
+    if (out) {
+        emit_byte(jit, 0x8B); emit_byte(jit, 0x0C); /* mov ecx, [rsp] */
+        emit_byte(jit, 0x24);
+        emit_byte(jit, 0x48); emit_byte(jit, 0x83); /* add rsp, 16 */
+        emit_byte(jit, 0xC4); emit_byte(jit, 16);
+    }
+    emit_byte(jit, 0x41); emit_byte(jit, 0x5B);     /* pop r11 */
+    emit_byte(jit, 0x41); emit_byte(jit, 0x5A);     /* pop r10 */
+}
+
+/* emit_fault_check
+ *
+ *      Purpose: Emit a test of the bool a um_segments.c access returned,
+ *               leaving the block at that access if it was turned down.
+ *
+ *   Parameters: The translator state, the pc of the access and the list of
+ *               early exits.
+ *
+ *      Returns: None
+ *
+ * Expectations: Emitted right after emit_call.
+*/
+static void emit_fault_check(struct Jit *jit, uint32_t pc, size_t *exits,
+                             int *num_exits)
+{
+    emit_byte(jit, 0x84); emit_byte(jit, 0xC0);     /* test al, al */
+    emit_byte(jit, 0x75);                           /* jnz over the exit */
+    emit_byte(jit, EXIT_BYTES);
+    emit_exit(jit, pc, EXEC_BAD_SEGMENT, exits, num_exits);
+}
+
+/* emit_exit
+ *
+ *      Purpose: Emit a jump to the epilogue that stops at a fault.
+ *
+ *   Parameters: The translator state, the pc of the instruction that didn't
+ *               run, the fault, and the list of early exits to add it to.
+ *
+ *      Returns: None
+ *
+ * Expectations: Always emits EXIT_BYTES, so it can be jumped over.
+*/
+static void emit_exit(struct Jit *jit, uint32_t pc, Exec_status status,
+                      size_t *exits, int *num_exits)
+{
+    emit_byte(jit, 0x48);                           /* mov rax, status:pc */
+    emit_byte(jit, 0xB8);
+    emit_u64(jit, ((uint64_t)status << 32) | pc);
+    emit_byte(jit, 0xE9);                           /* jmp epilogue */
+    exits[(*num_exits)++] = jit->used;
+    emit_u32(jit, 0);
+}
+
+/* emit_byte, emit_u32, emit_u64
+ *
+ *      Purpose: Append raw bytes to the code buffer.
+ *
+ *   Parameters: The translator state and the value to append.
+ *
+ *      Returns: None
+ *
+ * Expectations: translate made sure there is room; checked all the same,
+ *               since running past the buffer corrupts whatever follows.
+*/
+static void emit_byte(struct Jit *jit, uint8_t byte)
+{
+    assert(jit->used + 1 <= CODE_BUFFER_SIZE);
+    jit->buffer[jit->used++] = byte;
+}
+
+static void emit_u32(struct Jit *jit, uint32_t value)
+{
+    assert(jit->used + sizeof(value) <= CODE_BUFFER_SIZE);
+    memcpy(jit->buffer + jit->used, &value, sizeof(value));
+    jit->used += sizeof(value);
+}
+
+static void emit_u64(struct Jit *jit, uint64_t value)
+{
+    assert(jit->used + sizeof(value) <= CODE_BUFFER_SIZE);
+    memcpy(jit->buffer + jit->used, &value, sizeof(value));
+    jit->used += sizeof(value);
+}
+
+/* emit_rex
+ *
+ *      Purpose: Emit the REX prefix needed to reach r8 to r15, if any.
+ *
+ *   Parameters: The translator state and the registers in the reg and r/m
+ *               fields of the ModRM byte that follows.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void emit_rex(struct Jit *jit, int reg, int rm)
+{
+    uint8_t rex = 0x40 | ((reg >> 3) << 2) | (rm >> 3);
+
+    if (rex != 0x40) {
+        emit_byte(jit, rex);
+    }
+}
+
+/* emit_rr, emit_0f_rr
+ *
+ *      Purpose: Emit a 32-bit register to register instruction with a one
+ *               byte or 0F-prefixed opcode.
+ *
+ *   Parameters: The translator state, the opcode, and the registers (or
+ *               opcode extension) for the reg and r/m fields.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void emit_rr(struct Jit *jit, uint8_t op, int reg, int rm)
+{
+    emit_rex(jit, reg, rm);
+    emit_byte(jit, op);
+    emit_byte(jit, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+static void emit_0f_rr(struct Jit *jit, uint8_t op, int reg, int rm)
+{
+    emit_rex(jit, reg, rm);
+    emit_byte(jit, 0x0F);
+    emit_byte(jit, op);
+    emit_byte(jit, 0xC0 | ((reg & 7) << 3) | (rm & 7));
+}
+
+#undef T
+#endif
@@ -0,0 +1,34 @@
+/*
+ * um_jit.h
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Provides an interface for the engine that translates runs of segment 0
+ * into native x86-64 code. Only available on x86-64 hosts with mmap; build
+ * with -DUM_JIT to make execute() use it.
+*/
+
+#ifndef UM_JIT_
+#define UM_JIT_
+
+#include <stdint.h>
+#include "um_segments.h"
+#include "um_io.h"
+#include "um_execution.h"
+
+#if defined(__x86_64__) && defined(__GNUC__) && defined(__unix__)
+#define UM_HAVE_JIT 1
+#endif
+
+#ifdef UM_HAVE_JIT
+/*
+ * Takes in inputted program memory, active registers, a program counter,
+ *      I/O state and counters and executes the program, running
+ *      straight-line code natively and interpreting LOADP, HALT, IN and OUT,
+ *      and returns why it stopped.
+ */
+extern Exec_status execute_jit(Memory_T program, uint32_t *registers,
+                               int *prog_counter, Io_T io, Exec_stats *stats);
+#endif
+
+#endif
@@ -0,0 +1,355 @@
+/*
+ * um_live.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Implementation of the um_live.h interface. The counters are read with
+ * relaxed atomic loads while the engine goes on writing them, so a line may
+ * mix figures from neighbouring blocks but never stalls the engine. Lines
+ * are formatted by hand into a stack buffer and sent with write(), which
+ * keeps the SIGUSR1 handler safe to run at any point.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "um_live.h"
+
+#define T Live_T
+
+/* macros ================================================================== */
+#define LINE_SIZE 256
+
+/* struct definition ======================================================= */
+typedef struct Interval {  /* where the previous line left off */
+    uint64_t instructions;
+    uint64_t nanoseconds;
+} Interval;
+
+struct T {
+    const Exec_stats *stats;
+    Interval signal_interval;  /* for SIGUSR1 lines */
+    Interval socket_interval;  /* for socket lines */
+    int listen_fd;             /* -1 until live_serve */
+    char *path;
+    pthread_t server;
+};
+
+/* the reporter the SIGUSR1 handler reads */
+static T active = NULL;
+
+/* function declarations =================================================== */
+static size_t format_line(T live, Interval *interval, char *line);
+static char *append(char *end, const char *text);
+static char *append_number(char *end, uint64_t number);
+static uint64_t now_ns(void);
+static void dump_on_signal(int signal_number);
+static void *serve(void *live);
+
+/* function definitions ==================================================== */
+
+/* live_new
+ *
+ *      Purpose: Create a reporter and install the SIGUSR1 handler.
+ *
+ *   Parameters: Counters kept by the engine.
+ *
+ *      Returns: New instance of Live_T.
+ *
+ * Expectations: stats outlives the reporter; no other reporter exists.
+*/
+extern T live_new(const Exec_stats *stats)
+{
+    assert(stats != NULL);
+    assert(active == NULL);
+
+    T live = calloc(1, sizeof(*live));
+    assert(live != NULL);
+
+    live->stats = stats;
+    live->listen_fd = -1;
+    live->signal_interval.nanoseconds = now_ns();
+    live->socket_interval = live->signal_interval;
+    active = live;
+
+    struct sigaction action;
+    action.sa_handler = dump_on_signal;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, NULL);
+
+    return live;
+}
+
+/* live_free
+ *
+ *      Purpose: Go back to the default SIGUSR1 action, close the socket so
+ *               the server thread stops accepting, and free the reporter.
+ *
+ *   Parameters: Pointer to an instance of Live_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: live and *live are not null.
+*/
+extern void live_free(T *live)
+{
+    assert(live != NULL && *live != NULL);
+
+    signal(SIGUSR1, SIG_DFL);
+    active = NULL;
+
+    if ((*live)->listen_fd >= 0) {
+        shutdown((*live)->listen_fd, SHUT_RDWR);
+        pthread_join((*live)->server, NULL);
+        close((*live)->listen_fd);
+        unlink((*live)->path);
+        free((*live)->path);
+    }
+
+    free(*live);
+    *live = NULL;
+}
+
+/* live_serve
+ *
+ *      Purpose: Listen on a UNIX socket and start the thread answering it.
+ *               Each connection gets one line and is closed.
+ *
+ *   Parameters: Instance of Live_T and the path of the socket.
+ *
+ *      Returns: True if the socket is being served.
+ *
+ * Expectations: Not already serving. A stale socket at path is replaced.
+*/
+extern bool live_serve(T live, const char *path)
+{
+    assert(live->listen_fd < 0);
+
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return false;
+    }
+    strcpy(address.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return false;
+    }
+
+    unlink(path);
+    if (bind(fd, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(fd, 8) != 0) {
+        close(fd);
+        return false;
+    }
+
+    live->listen_fd = fd;
+    live->path = strdup(path);
+    assert(live->path != NULL);
+
+    /* the thread starts with every signal blocked, leaving them all to the
+     * thread running the machine */
+    sigset_t all, old;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    int created = pthread_create(&live->server, NULL, serve, live);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    if (created != 0) {
+        close(fd);
+        unlink(path);
+        free(live->path);
+        live->listen_fd = -1;
+        return false;
+    }
+    return true;
+}
+
+/* static function definitions============================================== */
+
+/* format_line
+ *
+ *      Purpose: Write the counters as one line, working out MIPS since the
+ *               interval began and starting a new one.
+ *
+ *   Parameters: Instance of Live_T, the interval to use, and a buffer of
+ *               LINE_SIZE characters.
+ *
+ *      Returns: Length of the line, newline included.
+ *
+ * Expectations: Only calls async-signal-safe functions.
+*/
+static size_t format_line(T live, Interval *interval, char *line)
+{
+    const Exec_stats *stats = live->stats;
+    uint64_t instructions = __atomic_load_n(&stats->instructions,
+                                            __ATOMIC_RELAXED);
+    uint64_t loadps = __atomic_load_n(&stats->loadps, __ATOMIC_RELAXED);
+    uint64_t segments = __atomic_load_n(&stats->segments.live,
+                                        __ATOMIC_RELAXED);
+    uint64_t words = __atomic_load_n(&stats->segments.words,
+                                     __ATOMIC_RELAXED);
+    uint64_t now = now_ns();
+
+    /* instructions per microsecond, in tenths */
+    uint64_t elapsed = now - interval->nanoseconds;
+    uint64_t mips_tenths = 0;
+    if (elapsed > 0 && instructions >= interval->instructions) {
+        mips_tenths = (instructions - interval->instructions) * 10000 /
+                      elapsed;
+    }
+    interval->instructions = instructions;
+    interval->nanoseconds = now;
+
+    char *end = line;
+    end = append(end, "instructions=");
+    end = append_number(end, instructions);
+    end = append(end, " mips=");
+    end = append_number(end, mips_tenths / 10);
+    end = append(end, ".");
+    end = append_number(end, mips_tenths % 10);
+    end = append(end, " segments=");
+    end = append_number(end, segments);
+    end = append(end, " bytes=");
+    end = append_number(end, words * sizeof(uint32_t));
+    end = append(end, " loadps=");
+    end = append_number(end, loadps);
+    end = append(end, "\n");
+
+    return (size_t)(end - line);
+}
+
+/* append
+ *
+ *      Purpose: Copy text to the end of a line.
+ *
+ *   Parameters: End of the line so far and the text.
+ *
+ *      Returns: New end of the line.
+ *
+ * Expectations: The line has room; its longest form is under LINE_SIZE.
+*/
+static char *append(char *end, const char *text)
+{
+    while (*text != '\0') {
+        *end++ = *text++;
+    }
+    return end;
+}
+
+/* append_number
+ *
+ *      Purpose: Write a number in decimal at the end of a line.
+ *
+ *   Parameters: End of the line so far and the number.
+ *
+ *      Returns: New end of the line.
+ *
+ * Expectations: The line has room for 20 more digits.
+*/
+static char *append_number(char *end, uint64_t number)
+{
+    char digits[20];
+    int count = 0;
+
+    do {
+        digits[count++] = (char)('0' + number % 10);
+        number /= 10;
+    } while (number != 0);
+
+    while (count > 0) {
+        *end++ = digits[--count];
+    }
+    return end;
+}
+
+/* now_ns
+ *
+ *      Purpose: Read the monotonic clock.
+ *
+ *   Parameters: None
+ *
+ *      Returns: Nanoseconds since some fixed point.
+ *
+ * Expectations: None
+*/
+static uint64_t now_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+}
+
+/* dump_on_signal
+ *
+ *      Purpose: SIGUSR1 handler. Writes one line to stderr.
+ *
+ *   Parameters: The signal number (unused).
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void dump_on_signal(int signal_number)
+{
+    (void)signal_number;
+
+    int saved_errno = errno;
+    T live = active;
+
+    if (live != NULL) {
+        char line[LINE_SIZE];
+        size_t length = format_line(live, &live->signal_interval, line);
+        ssize_t written = write(STDERR_FILENO, line, length);
+        (void)written;
+    }
+
+    errno = saved_errno;
+}
+
+/* serve
+ *
+ *      Purpose: Server thread. Answers each connection with one line until
+ *               the listening socket is shut down.
+ *
+ *   Parameters: The Live_T being served.
+ *
+ *      Returns: NULL
+ *
+ * Expectations: Started with every signal blocked.
+*/
+static void *serve(void *argument)
+{
+    T live = argument;
+
+    while (true) {
+        int client = accept(live->listen_fd, NULL, NULL);
+        if (client < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            return NULL;
+        }
+
+        char line[LINE_SIZE];
+        size_t length = format_line(live, &live->socket_interval, line);
+        ssize_t written = write(client, line, length);
+        (void)written;
+        close(client);
+    }
+}
+
+#undef T
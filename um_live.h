@@ -0,0 +1,41 @@
+/*
+ * um_live.h
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Provides an interface for reading a running machine's counters from
+ * outside. A Live_T prints them to stderr on SIGUSR1 and can serve them to
+ * anyone who connects to a UNIX socket, without stopping the engine. The
+ * line written looks like
+ *
+ *   instructions=123456789 mips=412.7 segments=12 bytes=4096 loadps=98765
+ *
+ * where mips covers the time since the previous line from the same source.
+*/
+
+#ifndef UM_LIVE_
+#define UM_LIVE_
+
+#include <stdbool.h>
+#include "um_execution.h"
+
+#define T Live_T
+typedef struct T *T; /* pointer to a reporter of one machine's counters */
+
+/*
+ * Takes in counters the engine keeps up to date and starts printing them on
+ *      SIGUSR1. Only one reporter can exist at a time.
+ */
+extern T live_new(const Exec_stats *stats);
+
+/* Takes in a pointer to a reporter, stops it, removes its socket, frees it */
+extern void live_free(T *live);
+
+/*
+ * Takes in a reporter and a path, and serves the counters on a UNIX socket
+ *      there from a thread of its own. Returns false if it can't.
+ */
+extern bool live_serve(T live, const char *path);
+
+#undef T
+#endif
@@ -6,34 +6,214 @@
  * Contains main() function to properly use all needed interfaces in order
  * to correctly make a software implementation that emulates a universal
  * machine.
+ *
+ * Usage: um [--profile[=FILE] | --sample[=FILE] | --trace=FILE
+ *           [--trace-registers] | --segment-stats[=FILE]
+ *           [--segment-stats-json[=FILE]] | --cache-sim[=FILE]
+ *           [--cache-geometry=SIZE,LINE,WAYS]] [--perf[=FILE]]
+ *           [--stats[=FILE]] [--stats-socket=PATH] program.um
+ *
+ *   --profile   run the profiling engine and write its report to FILE, or
+ *               to stderr, when the program halts
+ *   --sample    run the program on the usual engine, sampling which block
+ *               it is in, and write folded stacks to FILE, or to stderr,
+ *               when the program halts
+ *   --trace     run the tracing engine, recording every instruction to FILE
+ *               (read it back with umtrace); --trace-registers adds the
+ *               value each instruction writes
+ *   --segment-stats, --segment-stats-json
+ *               run the segment census engine and write histograms of
+ *               segment sizes, lifetimes and id reuse, as text or JSON, to
+ *               FILE, or to stderr, when the program halts
+ *   --cache-sim run the cache simulation engine, passing every word SLOAD
+ *               and SSTORE touch through a model cache, and write miss rates
+ *               per segment and per pc to FILE, or to stderr, when the
+ *               program halts; --cache-geometry sets the capacity and line
+ *               size in bytes and the ways (default 32768,64,8)
+ *   --perf      count hardware events while the program runs and write them
+ *               per UM instruction to FILE, or to stderr, when it halts
+ *   --stats     write how many instructions and LOADPs the program ran to
+ *               FILE, or to stderr, when it halts (umbench reads this)
+ *   --stats-socket
+ *               serve live counters to anyone connecting to PATH
+ *
+ * Sending the process SIGUSR1 prints the live counters to stderr. A program
+ * that divides by 0, outputs a value over 255 or reaches an invalid opcode
+ * exits 1 with a message saying where, after writing every report it would
+ * have written at HALT.
 */
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <limits.h>
 #include <sys/stat.h> /* struct for finding file size */
 #include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
 
 #include "um_initialize.h"
 #include "um_execution.h"
+#include "um_instructions.h"
+#include "um_io.h"
+#include "um_perf.h"
+#include "um_live.h"
+
+/* halt() ends the process in exit(), so these are wound up at exit */
+static Perf_T perf = NULL;
+static Live_T live = NULL;
+static FILE *stats_report = NULL;
+static Exec_stats stats;
+
+/* also flushed from the fatal signal handler */
+static Tracer_T tracer = NULL;
+
+/* function declarations =================================================== */
+static FILE *open_report(const char *path);
+static bool parse_geometry(const char *text, unsigned *size, unsigned *line,
+                           unsigned *ways);
+static void report_perf(void);
+static void report_stats(void);
+static void stop_live(void);
+static bool wait_for_input(int fd);
+static void flush_trace(void);
+static void report_fault(Profile_T profile, Sampler_T sampler,
+                         Seghist_T seghist, Cache_T cache);
 
 int main(int argc, char *argv[])
 {
     FILE *fp;
     struct stat st; /* instance of stat structure */
+    Profile_T profile = NULL;
+    Sampler_T sampler = NULL;
+    Seghist_T seghist = NULL;
+    FILE *segment_text = NULL;
+    FILE *segment_json = NULL;
+    Cache_T cache = NULL;
+    FILE *cache_report = NULL;
+    unsigned cache_size = 32768, cache_line = 64, cache_ways = 8;
+    FILE *report;
+    const char *socket_path = NULL;
+    const char *trace_path = NULL;
+    bool trace_registers = false;
+    int arg = 1;
+
+    /* options come before the program */
+    for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+        if (strcmp(argv[arg], "--profile") == 0) {
+            profile = profile_new(stderr);
+        } else if (strncmp(argv[arg], "--profile=", 10) == 0) {
+            if ((report = open_report(argv[arg] + 10)) == NULL) {
+                return 1;
+            }
+            profile = profile_new(report);
+        } else if (strcmp(argv[arg], "--sample") == 0) {
+            sampler = sampler_new(stderr);
+        } else if (strncmp(argv[arg], "--sample=", 9) == 0) {
+            if ((report = open_report(argv[arg] + 9)) == NULL) {
+                return 1;
+            }
+            sampler = sampler_new(report);
+        } else if (strcmp(argv[arg], "--segment-stats") == 0) {
+            segment_text = stderr;
+        } else if (strncmp(argv[arg], "--segment-stats=", 16) == 0) {
+            if ((segment_text = open_report(argv[arg] + 16)) == NULL) {
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--segment-stats-json") == 0) {
+            segment_json = stderr;
+        } else if (strncmp(argv[arg], "--segment-stats-json=", 21) == 0) {
+            if ((segment_json = open_report(argv[arg] + 21)) == NULL) {
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--cache-sim") == 0) {
+            cache_report = stderr;
+        } else if (strncmp(argv[arg], "--cache-sim=", 12) == 0) {
+            if ((cache_report = open_report(argv[arg] + 12)) == NULL) {
+                return 1;
+            }
+        } else if (strncmp(argv[arg], "--cache-geometry=", 17) == 0) {
+            if (!parse_geometry(argv[arg] + 17, &cache_size, &cache_line,
+                                &cache_ways)) {
+                fprintf(stderr, "Bad cache geometry %s\n", argv[arg] + 17);
+                return 1;
+            }
+        } else if (strcmp(argv[arg], "--perf") == 0) {
+            perf = perf_new(stderr);
+        } else if (strncmp(argv[arg], "--perf=", 7) == 0) {
+            if ((report = open_report(argv[arg] + 7)) == NULL) {
+                return 1;
+            }
+            perf = perf_new(report);
+        } else if (strncmp(argv[arg], "--trace=", 8) == 0) {
+            trace_path = argv[arg] + 8;
+        } else if (strcmp(argv[arg], "--trace-registers") == 0) {
+            trace_registers = true;
+        } else if (strcmp(argv[arg], "--stats") == 0) {
+            stats_report = stderr;
+        } else if (strncmp(argv[arg], "--stats=", 8) == 0) {
+            if ((stats_report = open_report(argv[arg] + 8)) == NULL) {
+                return 1;
+            }
+        } else if (strncmp(argv[arg], "--stats-socket=", 15) == 0) {
+            socket_path = argv[arg] + 15;
+        } else {
+            fprintf(stderr, "Unknown option %s\n", argv[arg]);
+            return 1;
+        }
+    }
+
+    if (segment_text != NULL || segment_json != NULL) {
+        seghist = seghist_new(segment_text, segment_json);
+    }
 
-    /* exits failure if amount of arguments isn't equal to 2 */
-    if (argc != 2) {
+    if (cache_report != NULL) {
+        cache = cache_new(cache_report, cache_size, cache_line, cache_ways);
+    }
+
+    if ((profile != NULL) + (sampler != NULL) + (trace_path != NULL) +
+        (seghist != NULL) + (cache != NULL) > 1) {
+        fprintf(stderr, "Only one of --profile, --sample, --trace, "
+                        "--segment-stats and --cache-sim can be used at a "
+                        "time\n");
+        return 1;
+    }
+
+    if (trace_path != NULL) {
+        int trace_fd = open(trace_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (trace_fd < 0) {
+            fprintf(stderr, "Could not open %s\n", trace_path);
+            return 1;
+        }
+        tracer = tracer_new(trace_fd, trace_registers);
+    }
+
+    /* exits failure unless exactly one program is left */
+    if (argc - arg != 1) {
         fprintf(stderr, "Incorrect Number of Arguments!");
         return 1;
     }
+    const char *path = argv[arg];
 
-    stat(argv[1], &st);
-    uint32_t file_size = st.st_size;
+    if (stat(path, &st) != 0) {
+        fprintf(stderr, "Could not open %s\n", path);
+        return 1;
+    }
+    off_t file_size = st.st_size;
+
+    /* segment 0 can't hold more words than a segment length can count */
+    if (file_size / 4 > INT_MAX) {
+        fprintf(stderr, "%s is too large to load\n", path);
+        return 1;
+    }
 
     /* runs when file size has number of bytes that are divisible by 4 */
     if (file_size % 4 == 0) {
-        fp = fopen(argv[1], "r"); /* opens a file for reading */
+        fp = fopen(path, "r"); /* opens a file for reading */
         assert(fp != NULL);
 
         uint32_t registers[8] = { 0 }; /* initialize 8 registers to 0 */
@@ -42,10 +222,241 @@ int main(int argc, char *argv[])
         /* initializes program and executes instructions */
         Memory_T program = initialize(fp, (file_size / 4));
         fclose(fp);
-        execute(program, registers, &prog_counter);
 
-        return 0; /* exit success */
+        Io_T io = io_new(STDIN_FILENO, STDOUT_FILENO);
+        io_install_signal_flush(flush_trace); /* before any thread starts */
+
+        live = live_new(&stats);
+        atexit(stop_live);
+        if (socket_path != NULL && !live_serve(live, socket_path)) {
+            perror(socket_path);
+            return 1;
+        }
+
+        if (stats_report != NULL) {
+            atexit(report_stats);
+        }
+
+        if (perf != NULL) {
+            atexit(report_perf);
+            perf_start(perf);
+        }
+
+        if (seghist != NULL) {
+            segment_observe(program, seghist);
+        }
+
+        /* stdin may have been left non-blocking, so wait out a blocked IN */
+        Exec_status status;
+        do {
+            if (profile != NULL) {
+                status = execute_profile(program, registers, &prog_counter,
+                                         io, &stats, profile);
+            } else if (sampler != NULL) {
+                status = execute_sample(program, registers, &prog_counter,
+                                        io, &stats, sampler);
+            } else if (tracer != NULL) {
+                status = execute_trace(program, registers, &prog_counter,
+                                       io, &stats, tracer);
+            } else if (seghist != NULL) {
+                status = execute_segments(program, registers, &prog_counter,
+                                          io, &stats, seghist);
+            } else if (cache != NULL) {
+                status = execute_cache(program, registers, &prog_counter,
+                                       io, &stats, cache);
+            } else {
+                status = execute(program, registers, &prog_counter, io,
+                                 &stats);
+            }
+        } while (status == EXEC_BLOCKED && wait_for_input(STDIN_FILENO));
+
+        if (status == EXEC_HALTED) {
+            halt(program, io); /* exit success */
+        }
+
+        /* a fault; the engines only report at HALT, so it is done here */
+        report_fault(profile, sampler, seghist, cache);
+        io_free(&io);
+        segment_free(program);
+        fprintf(stderr, "%s at instruction %d of segment 0\n",
+                exec_status_name(status), prog_counter);
+        return 1;
     }
 
     return 1; /* exit failure */
 }
+
+/* open_report
+ *
+ *      Purpose: Open the file an option asked its report to be written to.
+ *
+ *   Parameters: Path of the file.
+ *
+ *      Returns: The open stream, or NULL after printing why it failed.
+ *
+ * Expectations: None
+*/
+static FILE *open_report(const char *path)
+{
+    FILE *report = fopen(path, "w");
+    if (report == NULL) {
+        fprintf(stderr, "Could not open %s\n", path);
+    }
+    return report;
+}
+
+/* parse_geometry
+ *
+ *      Purpose: Read the cache shape given to --cache-geometry.
+ *
+ *   Parameters: The text after the =, and where to put the capacity, line
+ *               size and ways.
+ *
+ *      Returns: true if the text is three numbers separated by commas
+ *               making a shape the cache model accepts, false otherwise.
+ *
+ * Expectations: None
+*/
+static bool parse_geometry(const char *text, unsigned *size, unsigned *line,
+                           unsigned *ways)
+{
+    unsigned s, l, w;
+    char end;
+
+    if (sscanf(text, "%u,%u,%u%c", &s, &l, &w, &end) != 3) {
+        return false;
+    }
+    if (l == 0 || (l & (l - 1)) != 0 || s == 0 || (s & (s - 1)) != 0 ||
+        w == 0 || s % ((uint64_t)l * w) != 0) {
+        return false;
+    }
+
+    *size = s;
+    *line = l;
+    *ways = w;
+    return true;
+}
+
+/* report_perf
+ *
+ *      Purpose: Stop the hardware counters and write their report once the
+ *               program has halted.
+ *
+ *   Parameters: None
+ *
+ *      Returns: None
+ *
+ * Expectations: Registered with atexit() after perf was started.
+*/
+static void report_perf(void)
+{
+    perf_stop(perf);
+    perf_report(perf, &stats);
+    perf_free(&perf);
+}
+
+/* report_stats
+ *
+ *      Purpose: Write the final counters once the program has halted.
+ *
+ *   Parameters: None
+ *
+ *      Returns: None
+ *
+ * Expectations: Registered with atexit() after stats_report was opened.
+*/
+static void report_stats(void)
+{
+    fprintf(stats_report, "instructions=%llu loadps=%llu\n",
+            (unsigned long long)stats.instructions,
+            (unsigned long long)stats.loadps);
+    fflush(stats_report);
+}
+
+/* stop_live
+ *
+ *      Purpose: Stop serving live counters and remove the socket.
+ *
+ *   Parameters: None
+ *
+ *      Returns: None
+ *
+ * Expectations: Registered with atexit() after live was created.
+*/
+static void stop_live(void)
+{
+    live_free(&live);
+}
+
+/* wait_for_input
+ *
+ *      Purpose: Wait until a non-blocking descriptor has input, or its end,
+ *               for an IN that found nothing to read.
+ *
+ *   Parameters: The descriptor.
+ *
+ *      Returns: True once it is ready to read, false if poll() failed.
+ *
+ * Expectations: fd is open.
+*/
+static bool wait_for_input(int fd)
+{
+    struct pollfd ready = { .fd = fd, .events = POLLIN };
+    int got;
+
+    do {
+        got = poll(&ready, 1, -1);
+    } while (got < 0 && errno == EINTR);
+
+    return got > 0;
+}
+
+/* flush_trace
+ *
+ *      Purpose: Write whatever the tracer holds, if there is one.
+ *
+ *   Parameters: None
+ *
+ *      Returns: None
+ *
+ * Expectations: Safe in a signal handler. The tracer is left allocated, as
+ *               the process is about to end.
+*/
+static void flush_trace(void)
+{
+    if (tracer != NULL) {
+        tracer_flush(tracer);
+    }
+}
+
+/* report_fault
+ *
+ *      Purpose: Write the reports the engine would have written at HALT,
+ *               and the rest of the trace, for a program that faulted.
+ *
+ *   Parameters: Whichever of the profile, sampler, segment census and
+ *               cache was asked for, the others NULL.
+ *
+ *      Returns: None
+ *
+ * Expectations: The engine has returned with something other than
+ *               EXEC_HALTED. The perf, stats and live reports are left to
+ *               their atexit() handlers, as at HALT.
+*/
+static void report_fault(Profile_T profile, Sampler_T sampler,
+                         Seghist_T seghist, Cache_T cache)
+{
+    if (profile != NULL) {
+        profile_report(profile);
+    }
+    if (sampler != NULL) {
+        sampler_report(sampler);
+    }
+    flush_trace();
+    if (seghist != NULL) {
+        seghist_report(seghist);
+    }
+    if (cache != NULL) {
+        cache_report(cache);
+    }
+}
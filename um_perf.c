@@ -0,0 +1,270 @@
+/*
+ * um_perf.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Implementation of the um_perf.h interface on Linux's perf_event_open.
+ * Each counter is opened on its own rather than as a group, so one the
+ * hardware lacks doesn't take the rest down with it, and only user-space
+ * work is counted, which is allowed at the default perf_event_paranoid.
+ * When the kernel has to share the hardware between more counters than it
+ * has, each total is scaled up by how long it was actually counting.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "um_perf.h"
+
+#define T Perf_T
+
+/* macros ================================================================== */
+#define NUM_COUNTERS 6
+
+/* struct definition ======================================================= */
+struct T {
+    FILE *out;
+    int fds[NUM_COUNTERS];     /* -1 for a counter that couldn't be opened */
+    int open_errno;            /* why the first one that failed did */
+    uint64_t totals[NUM_COUNTERS];
+};
+
+#ifdef __linux__
+static const struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} counters[NUM_COUNTERS] = {
+    { "cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES },
+    { "instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS },
+    { "branches", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS },
+    { "branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES },
+    { "L1d-read-misses", PERF_TYPE_HW_CACHE,
+      PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+      (PERF_COUNT_HW_CACHE_RESULT_MISS << 16) },
+    { "cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES }
+};
+#else
+static const struct {
+    const char *name;
+} counters[NUM_COUNTERS] = {
+    { "cycles" }, { "instructions" }, { "branches" }, { "branch-misses" },
+    { "L1d-read-misses" }, { "cache-misses" }
+};
+#endif
+
+/* indices into counters[] the report divides by */
+enum { CYCLES = 0, INSTRUCTIONS, BRANCHES };
+
+/* function definitions ==================================================== */
+
+/* perf_new
+ *
+ *      Purpose: Open every counter the host allows, disabled.
+ *
+ *   Parameters: Stream the report is written to.
+ *
+ *      Returns: New instance of Perf_T, with or without working counters.
+ *
+ * Expectations: out is not null.
+*/
+extern T perf_new(FILE *out)
+{
+    assert(out != NULL);
+
+    T perf = calloc(1, sizeof(*perf));
+    assert(perf != NULL);
+    perf->out = out;
+
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        perf->fds[i] = -1;
+
+#ifdef __linux__
+        struct perf_event_attr attr;
+        memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = counters[i].type;
+        attr.config = counters[i].config;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                           PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+        perf->fds[i] = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1,
+                                    PERF_FLAG_FD_CLOEXEC);
+        if (perf->fds[i] < 0 && perf->open_errno == 0) {
+            perf->open_errno = errno;
+        }
+#else
+        perf->open_errno = ENOSYS;
+#endif
+    }
+
+    return perf;
+}
+
+/* perf_free
+ *
+ *      Purpose: Close the counters and free them. The report stream is left
+ *               open.
+ *
+ *   Parameters: Pointer to an instance of Perf_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: perf and *perf are not null.
+*/
+extern void perf_free(T *perf)
+{
+    assert(perf != NULL && *perf != NULL);
+
+#ifdef __linux__
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        if ((*perf)->fds[i] >= 0) {
+            close((*perf)->fds[i]);
+        }
+    }
+#endif
+
+    free(*perf);
+    *perf = NULL;
+}
+
+/* perf_start
+ *
+ *      Purpose: Zero and enable every open counter.
+ *
+ *   Parameters: Instance of Perf_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+extern void perf_start(T perf)
+{
+#ifdef __linux__
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        if (perf->fds[i] >= 0) {
+            ioctl(perf->fds[i], PERF_EVENT_IOC_RESET, 0);
+            ioctl(perf->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#else
+    (void)perf;
+#endif
+}
+
+/* perf_stop
+ *
+ *      Purpose: Disable every open counter and read its total, scaled for
+ *               the time it was switched out.
+ *
+ *   Parameters: Instance of Perf_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: perf_start was called.
+*/
+extern void perf_stop(T perf)
+{
+#ifdef __linux__
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        if (perf->fds[i] < 0) {
+            continue;
+        }
+        ioctl(perf->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+
+        /* value, time enabled, time running */
+        uint64_t values[3];
+        if (read(perf->fds[i], values, sizeof(values)) != sizeof(values) ||
+            values[2] == 0) {
+            close(perf->fds[i]);
+            perf->fds[i] = -1;
+            continue;
+        }
+
+        perf->totals[i] = values[0];
+        if (values[2] < values[1]) {
+            perf->totals[i] = (uint64_t)((double)values[0] *
+                                         values[1] / values[2]);
+        }
+    }
+#else
+    (void)perf;
+#endif
+}
+
+/* perf_report
+ *
+ *      Purpose: Write each counter's total, per retired UM instruction and
+ *               per block (LOADP), followed by IPC and the branch miss rate.
+ *
+ *   Parameters: Instance of Perf_T and the engine's counts for the run.
+ *
+ *      Returns: None
+ *
+ * Expectations: perf_stop was called.
+*/
+extern void perf_report(T perf, const Exec_stats *stats)
+{
+    FILE *out = perf->out;
+    uint64_t blocks = stats->loadps + 1; /* the last block ends at HALT */
+
+    fprintf(out, "um perf: %llu UM instructions in %llu blocks\n",
+            (unsigned long long)stats->instructions,
+            (unsigned long long)blocks);
+
+    int num_open = 0;
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        num_open += (perf->fds[i] >= 0);
+    }
+    if (num_open == 0) {
+        fprintf(out, "hardware counters unavailable: %s\n",
+                strerror(perf->open_errno));
+        fflush(out);
+        return;
+    }
+
+    double instructions = (stats->instructions > 0)
+                        ? (double)stats->instructions : 1.0;
+
+    fprintf(out, "\n%-16s %16s %14s %14s\n", "counter", "total",
+            "per UM inst", "per block");
+    for (int i = 0; i < NUM_COUNTERS; i++) {
+        if (perf->fds[i] < 0) {
+            fprintf(out, "%-16s %16s\n", counters[i].name, "unavailable");
+            continue;
+        }
+        fprintf(out, "%-16s %16llu %14.3f %14.3f\n", counters[i].name,
+                (unsigned long long)perf->totals[i],
+                (double)perf->totals[i] / instructions,
+                (double)perf->totals[i] / (double)blocks);
+    }
+
+    if (perf->fds[CYCLES] >= 0 && perf->fds[INSTRUCTIONS] >= 0 &&
+        perf->totals[CYCLES] > 0) {
+        fprintf(out, "\nIPC %.2f\n", (double)perf->totals[INSTRUCTIONS] /
+                                     (double)perf->totals[CYCLES]);
+    }
+    if (perf->fds[BRANCHES] >= 0 && perf->fds[BRANCHES + 1] >= 0 &&
+        perf->totals[BRANCHES] > 0) {
+        fprintf(out, "branch miss rate %.2f%%\n",
+                100.0 * (double)perf->totals[BRANCHES + 1] /
+                (double)perf->totals[BRANCHES]);
+    }
+
+    fflush(out);
+}
+
+#undef T
@@ -0,0 +1,41 @@
+/*
+ * um_perf.h
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Provides an interface for reading the host's hardware performance counters
+ * (cycles, instructions, branch and cache misses) around a run of execute(),
+ * and reporting them per retired UM instruction and per block. Counters the
+ * host or its permissions don't allow are reported as unavailable; the
+ * program runs the same either way.
+*/
+
+#ifndef UM_PERF_
+#define UM_PERF_
+
+#include <stdio.h>
+#include "um_execution.h"
+
+#define T Perf_T
+typedef struct T *T; /* pointer to a set of open counters */
+
+/* Takes in where to write the report and opens whatever counters it can */
+extern T perf_new(FILE *out);
+
+/* Takes in a pointer to a set of counters, closes them and frees it */
+extern void perf_free(T *perf);
+
+/* Takes in a set of counters and zeroes and starts them */
+extern void perf_start(T perf);
+
+/* Takes in a set of counters and stops them */
+extern void perf_stop(T perf);
+
+/*
+ * Takes in stopped counters and the engine's counts for the same run, and
+ *      writes the totals and their ratios to the counts
+ */
+extern void perf_report(T perf, const Exec_stats *stats);
+
+#undef T
+#endif
@@ -0,0 +1,253 @@
+/*
+ * um_profile.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Implementation of the um_profile.h interface. Per-offset counts are kept
+ * in an array that grows with the largest offset seen; since LOADP can
+ * replace segment 0, an offset's count covers every program that ran there.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+
+#include "um_profile.h"
+
+#define T Profile_T
+
+/* macros ================================================================== */
+#define NUM_OPCODES 17   /* decoded opcodes, NOT_DECODED through 16 */
+#define HOT_PCS 20       /* offsets listed in the report */
+#define PC_HINT 1024
+
+/* struct definition ======================================================= */
+struct T {
+    FILE *out;
+    struct timespec start;
+    uint64_t opcodes[NUM_OPCODES];
+    uint64_t *pcs;            /* instructions retired at each offset */
+    uint8_t *pc_opcodes;      /* opcode last seen at each offset */
+    uint32_t num_pcs;         /* length of both arrays */
+    uint64_t words_mapped;
+    uint64_t jumps;           /* LOADP of segment 0 */
+    uint64_t program_loads;   /* LOADP of any other segment */
+};
+
+static const char *opcode_names[NUM_OPCODES] = {
+    "?", "cmov", "sload", "sstore", "add", "mul", "div", "nand", "halt",
+    "map", "unmap", "out", "in", "loadp", "lv", "op14", "op15"
+};
+
+/* function declarations =================================================== */
+static void grow(T profile, uint32_t pc);
+static double percent(uint64_t part, uint64_t whole);
+
+/* function definitions ==================================================== */
+
+/* profile_new
+ *
+ *      Purpose: Create zeroed counters and start the clock.
+ *
+ *   Parameters: Stream the report is written to.
+ *
+ *      Returns: New instance of Profile_T.
+ *
+ * Expectations: out is not null.
+*/
+extern T profile_new(FILE *out)
+{
+    assert(out != NULL);
+
+    T profile = calloc(1, sizeof(*profile));
+    assert(profile != NULL);
+
+    profile->out = out;
+    profile->pcs = calloc(PC_HINT, sizeof(uint64_t));
+    profile->pc_opcodes = calloc(PC_HINT, sizeof(uint8_t));
+    assert(profile->pcs != NULL && profile->pc_opcodes != NULL);
+    profile->num_pcs = PC_HINT;
+
+    clock_gettime(CLOCK_MONOTONIC, &profile->start);
+    return profile;
+}
+
+/* profile_free
+ *
+ *      Purpose: Free the counters. The report stream is left open.
+ *
+ *   Parameters: Pointer to an instance of Profile_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: profile and *profile are not null.
+*/
+extern void profile_free(T *profile)
+{
+    assert(profile != NULL && *profile != NULL);
+
+    free((*profile)->pcs);
+    free((*profile)->pc_opcodes);
+    free(*profile);
+    *profile = NULL;
+}
+
+/* profile_count
+ *
+ *      Purpose: Count one instruction about to be retired.
+ *
+ *   Parameters: Instance of Profile_T, offset of the instruction in segment
+ *               0, the decoded instruction and the registers it reads.
+ *
+ *      Returns: None
+ *
+ * Expectations: The instruction has been decoded.
+*/
+extern void profile_count(T profile, uint32_t pc, Instruction_T instruction,
+                          const uint32_t *registers)
+{
+    unsigned opcode = instruction->opcode;
+
+    if (pc >= profile->num_pcs) {
+        grow(profile, pc);
+    }
+    profile->pcs[pc]++;
+    profile->pc_opcodes[pc] = (uint8_t)opcode;
+    profile->opcodes[opcode]++;
+
+    if (opcode == ACTIVATE) {
+        profile->words_mapped += registers[instruction->register_C];
+    } else if (opcode == LOADP) {
+        if (registers[instruction->register_B] == 0) {
+            profile->jumps++;
+        } else {
+            profile->program_loads++;
+        }
+    }
+}
+
+/* profile_report
+ *
+ *      Purpose: Write the wall time, the count and share of every opcode,
+ *               the segment and LOADP totals, and the hottest offsets.
+ *
+ *   Parameters: Instance of Profile_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+extern void profile_report(T profile)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double seconds = (double)(now.tv_sec - profile->start.tv_sec) +
+                     (double)(now.tv_nsec - profile->start.tv_nsec) / 1e9;
+
+    uint64_t total = 0;
+    for (int i = 0; i < NUM_OPCODES; i++) {
+        total += profile->opcodes[i];
+    }
+
+    FILE *out = profile->out;
+    fprintf(out, "um profile: %llu instructions in %.3f s",
+            (unsigned long long)total, seconds);
+    if (seconds > 0) {
+        fprintf(out, " (%.1f M/s)", (double)total / seconds / 1e6);
+    }
+    fprintf(out, "\n\n%-8s %16s %7s\n", "opcode", "count", "share");
+
+    for (int i = 1; i < NUM_OPCODES; i++) {
+        if (profile->opcodes[i] != 0) {
+            fprintf(out, "%-8s %16llu %6.2f%%\n", opcode_names[i],
+                    (unsigned long long)profile->opcodes[i],
+                    percent(profile->opcodes[i], total));
+        }
+    }
+
+    fprintf(out, "\nmap %llu (%llu words), unmap %llu, "
+            "loadp %llu (%llu jumps, %llu program loads)\n",
+            (unsigned long long)profile->opcodes[ACTIVATE],
+            (unsigned long long)profile->words_mapped,
+            (unsigned long long)profile->opcodes[INACTIVATE],
+            (unsigned long long)profile->opcodes[LOADP],
+            (unsigned long long)profile->jumps,
+            (unsigned long long)profile->program_loads);
+
+    /* picks the hottest offsets by insertion into a short sorted list */
+    uint32_t hot[HOT_PCS];
+    int num_hot = 0;
+    for (uint32_t pc = 0; pc < profile->num_pcs; pc++) {
+        uint64_t count = profile->pcs[pc];
+        if (count == 0 ||
+            (num_hot == HOT_PCS && count <= profile->pcs[hot[num_hot - 1]])) {
+            continue;
+        }
+
+        int i = (num_hot < HOT_PCS) ? num_hot++ : HOT_PCS - 1;
+        while (i > 0 && profile->pcs[hot[i - 1]] < count) {
+            hot[i] = hot[i - 1];
+            i--;
+        }
+        hot[i] = pc;
+    }
+
+    fprintf(out, "\n%-10s %-8s %16s %7s\n", "pc", "opcode", "count", "share");
+    for (int i = 0; i < num_hot; i++) {
+        fprintf(out, "%-10u %-8s %16llu %6.2f%%\n", hot[i],
+                opcode_names[profile->pc_opcodes[hot[i]]],
+                (unsigned long long)profile->pcs[hot[i]],
+                percent(profile->pcs[hot[i]], total));
+    }
+
+    fflush(out);
+}
+
+/* static function definitions============================================== */
+
+/* grow
+ *
+ *      Purpose: Make the per-offset arrays long enough to hold pc.
+ *
+ *   Parameters: Instance of Profile_T and the offset to make room for.
+ *
+ *      Returns: None
+ *
+ * Expectations: pc is past the end of the arrays.
+*/
+static void grow(T profile, uint32_t pc)
+{
+    uint64_t length = profile->num_pcs;
+    while (length <= pc) {
+        length *= 2;
+    }
+
+    profile->pcs = realloc(profile->pcs, length * sizeof(uint64_t));
+    profile->pc_opcodes = realloc(profile->pc_opcodes, length);
+    assert(profile->pcs != NULL && profile->pc_opcodes != NULL);
+
+    memset(profile->pcs + profile->num_pcs, 0,
+           (length - profile->num_pcs) * sizeof(uint64_t));
+    memset(profile->pc_opcodes + profile->num_pcs, 0,
+           length - profile->num_pcs);
+    profile->num_pcs = (uint32_t)length;
+}
+
+/* percent
+ *
+ *      Purpose: Share of a count in a total, as a percentage.
+ *
+ *   Parameters: The count and the total.
+ *
+ *      Returns: The percentage, 0 for an empty total.
+ *
+ * Expectations: None
+*/
+static double percent(uint64_t part, uint64_t whole)
+{
+    return (whole == 0) ? 0.0 : 100.0 * (double)part / (double)whole;
+}
+
+#undef T
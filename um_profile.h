@@ -0,0 +1,40 @@
+/*
+ * um_profile.h
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Provides an interface for exact execution profiles. A Profile_T counts
+ * every instruction the profiling engine (execute_profile() in
+ * um_execution.h) retires, by opcode and by segment 0 offset, along with how
+ * often segments are mapped and unmapped and how LOADP is used, and writes a
+ * report when the program halts. The other engines never touch it.
+*/
+
+#ifndef UM_PROFILE_
+#define UM_PROFILE_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "um_decode.h"
+
+#define T Profile_T
+typedef struct T *T; /* pointer to the counters of one profiled run */
+
+/* Takes in where to write the report and returns new, running counters */
+extern T profile_new(FILE *out);
+
+/* Takes in a pointer to a profile and frees it */
+extern void profile_free(T *profile);
+
+/*
+ * Takes in a profile, the offset of an instruction in segment 0, the
+ *      instruction and the registers it is about to run with, and counts it.
+ */
+extern void profile_count(T profile, uint32_t pc, Instruction_T instruction,
+                          const uint32_t *registers);
+
+/* Takes in a profile and writes its report */
+extern void profile_report(T profile);
+
+#undef T
+#endif
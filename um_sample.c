@@ -0,0 +1,325 @@
+/*
+ * um_sample.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Implementation of the um_sample.h interface. The SIGPROF handler only
+ * reads the block and last LOADP out of the engine's Exec_stats, pushes
+ * that LOADP on a ring if it is new, and copies the block and ring into a
+ * preallocated array, so it takes no locks and calls nothing. The engine
+ * never waits on the sampler: a LOADP costs it the two stores it makes for
+ * every caller. Since the ring only grows when a sample lands, it holds
+ * the LOADPs that run long enough to be caught, not every one; a tight loop
+ * shows up as its own frame either way.
+ *
+ * Once the array is full, new samples replace old ones at random (reservoir
+ * sampling), which keeps a fair picture of a run of any length in fixed
+ * memory; counts are scaled back up when the stacks are written.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <assert.h>
+#include <sys/time.h>
+
+#include "um_sample.h"
+#include "um_execution.h"
+
+#define T Sampler_T
+
+/* macros ================================================================== */
+#define SAMPLE_HZ 997          /* prime, so it won't beat with the program */
+#define MAX_SAMPLES 65536
+#define CHAIN_DEPTH 8          /* LOADP offsets kept per sample */
+
+/* struct definition ======================================================= */
+typedef struct Sample {
+    uint32_t block;
+    uint32_t depth;
+    uint32_t chain[CHAIN_DEPTH]; /* oldest LOADP first */
+} Sample;
+
+struct T {
+    FILE *out;
+    const Exec_stats *stats;
+    uint32_t ring[CHAIN_DEPTH];      /* only the handler touches it */
+    uint32_t num_loadps;             /* pushes onto ring so far */
+    uint64_t loadps_seen;            /* stats->loadps at the last sample */
+    volatile uint64_t num_seen;      /* samples taken, kept or not */
+    uint64_t random;                 /* xorshift state for the reservoir */
+    bool running;
+    Sample samples[MAX_SAMPLES];
+};
+
+/* the sampler the SIGPROF handler writes into */
+static T active = NULL;
+
+/* function declarations =================================================== */
+static void take_sample(int signal_number);
+static void set_timer(long microseconds);
+static int compare_samples(const void *first, const void *second);
+static void write_stack(FILE *out, const Sample *sample, uint64_t count);
+
+/* function definitions ==================================================== */
+
+/* sampler_new
+ *
+ *      Purpose: Create a sampler with no samples.
+ *
+ *   Parameters: Stream the folded stacks are written to.
+ *
+ *      Returns: New instance of Sampler_T.
+ *
+ * Expectations: out is not null.
+*/
+extern T sampler_new(FILE *out)
+{
+    assert(out != NULL);
+
+    T sampler = calloc(1, sizeof(*sampler));
+    assert(sampler != NULL);
+
+    sampler->out = out;
+    sampler->random = 0x9e3779b97f4a7c15ull;
+    return sampler;
+}
+
+/* sampler_free
+ *
+ *      Purpose: Stop the sampler if it is still running and free it. The
+ *               output stream is left open.
+ *
+ *   Parameters: Pointer to an instance of Sampler_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: sampler and *sampler are not null.
+*/
+extern void sampler_free(T *sampler)
+{
+    assert(sampler != NULL && *sampler != NULL);
+
+    if ((*sampler)->running) {
+        set_timer(0);
+        active = NULL;
+    }
+
+    free(*sampler);
+    *sampler = NULL;
+}
+
+/* sampler_start
+ *
+ *      Purpose: Install the SIGPROF handler and start the profiling timer.
+ *
+ *   Parameters: Instance of Sampler_T and the counters to sample.
+ *
+ *      Returns: None
+ *
+ * Expectations: No other sampler is running. Starting this sampler again
+ *               while it runs, as an engine called again after
+ *               EXEC_BLOCKED or EXEC_OUT_OF_BUDGET does, only points it at
+ *               the counters given.
+*/
+extern void sampler_start(T sampler, const Exec_stats *stats)
+{
+    assert(sampler != NULL && stats != NULL);
+
+    if (sampler->running) {
+        assert(active == sampler);
+        sampler->stats = stats;
+        return;
+    }
+    assert(active == NULL);
+
+    sampler->stats = stats;
+    sampler->running = true;
+    active = sampler;
+
+    struct sigaction action;
+    action.sa_handler = take_sample;
+    sigemptyset(&action.sa_mask);
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGPROF, &action, NULL);
+
+    set_timer(1000000 / SAMPLE_HZ);
+}
+
+/* sampler_report
+ *
+ *      Purpose: Stop sampling, then sort the samples so equal stacks are
+ *               next to each other and write one line per distinct stack.
+ *
+ *   Parameters: Instance of Sampler_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: The sampler was started.
+*/
+extern void sampler_report(T sampler)
+{
+    assert(sampler->running);
+
+    set_timer(0);
+    sampler->running = false;
+    active = NULL;
+
+    uint64_t seen = sampler->num_seen;
+    size_t kept = (seen < MAX_SAMPLES) ? (size_t)seen : MAX_SAMPLES;
+    qsort(sampler->samples, kept, sizeof(Sample), compare_samples);
+
+    /* each kept sample stands for seen / kept samples taken */
+    for (size_t i = 0; i < kept; ) {
+        size_t j = i + 1;
+        while (j < kept &&
+               compare_samples(&sampler->samples[i], &sampler->samples[j]) == 0) {
+            j++;
+        }
+
+        uint64_t count = ((j - i) * seen + kept / 2) / kept;
+        write_stack(sampler->out, &sampler->samples[i], count ? count : 1);
+        i = j;
+    }
+
+    fflush(sampler->out);
+}
+
+/* static function definitions============================================== */
+
+/* take_sample
+ *
+ *      Purpose: SIGPROF handler. Pushes the last LOADP if any ran since the
+ *               last sample and it isn't already on top, then copies the
+ *               block and the LOADP ring into the next slot, or a random one
+ *               once full.
+ *
+ *   Parameters: The signal number (unused).
+ *
+ *      Returns: None
+ *
+ * Expectations: Runs on the thread running the engine, so the counters
+ *               are as the engine last left them at a LOADP.
+*/
+static void take_sample(int signal_number)
+{
+    (void)signal_number;
+
+    T sampler = active;
+    if (sampler == NULL) {
+        return;
+    }
+
+    /* a loop jumping back from the same place again is only kept once */
+    const Exec_stats *stats = sampler->stats;
+    uint32_t count = sampler->num_loadps;
+
+    if (stats->loadps != sampler->loadps_seen) {
+        sampler->loadps_seen = stats->loadps;
+        if (count == 0 ||
+            sampler->ring[(count - 1) % CHAIN_DEPTH] != stats->last_loadp) {
+            sampler->ring[count % CHAIN_DEPTH] = stats->last_loadp;
+            sampler->num_loadps = ++count;
+        }
+    }
+
+    uint64_t seen = sampler->num_seen++;
+    uint64_t slot = seen;
+
+    if (seen >= MAX_SAMPLES) {
+        uint64_t x = sampler->random;
+        x ^= x << 13;
+        x ^= x >> 7;
+        x ^= x << 17;
+        sampler->random = x;
+
+        slot = x % (seen + 1);
+        if (slot >= MAX_SAMPLES) {
+            return;
+        }
+    }
+
+    Sample *sample = &sampler->samples[slot];
+    uint32_t depth = (count < CHAIN_DEPTH) ? count : CHAIN_DEPTH;
+
+    sample->block = stats->block_start;
+    sample->depth = depth;
+    for (uint32_t i = 0; i < CHAIN_DEPTH; i++) {
+        sample->chain[i] = (i < depth)
+                         ? sampler->ring[(count - depth + i) % CHAIN_DEPTH]
+                         : 0;
+    }
+}
+
+/* set_timer
+ *
+ *      Purpose: Arm the profiling timer, or disarm it.
+ *
+ *   Parameters: Interval in microseconds of CPU time, 0 to stop.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void set_timer(long microseconds)
+{
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = microseconds;
+    timer.it_value = timer.it_interval;
+    setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+/* compare_samples
+ *
+ *      Purpose: qsort comparator ordering samples by stack.
+ *
+ *   Parameters: Two samples.
+ *
+ *      Returns: Negative, zero or positive as for memcmp.
+ *
+ * Expectations: Unused chain entries are zero.
+*/
+static int compare_samples(const void *first, const void *second)
+{
+    const Sample *a = first;
+    const Sample *b = second;
+
+    if (a->depth != b->depth) {
+        return (a->depth < b->depth) ? -1 : 1;
+    }
+    for (int i = 0; i < CHAIN_DEPTH; i++) {
+        if (a->chain[i] != b->chain[i]) {
+            return (a->chain[i] < b->chain[i]) ? -1 : 1;
+        }
+    }
+    if (a->block != b->block) {
+        return (a->block < b->block) ? -1 : 1;
+    }
+    return 0;
+}
+
+/* write_stack
+ *
+ *      Purpose: Write one folded stack: the LOADPs oldest first, then the
+ *               sampled block, then the count.
+ *
+ *   Parameters: Stream to write to, the sample, and how many it stands for.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void write_stack(FILE *out, const Sample *sample, uint64_t count)
+{
+    for (uint32_t i = 0; i < sample->depth; i++) {
+        uint32_t entry = sample->chain[i];
+        fprintf(out, "%s_%u;", (entry & STATS_PROGRAM_LOAD) ? "load" : "loadp",
+                entry & ~STATS_PROGRAM_LOAD);
+    }
+    fprintf(out, "block_%u %llu\n", sample->block,
+            (unsigned long long)count);
+}
+
+#undef T
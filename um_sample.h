@@ -0,0 +1,46 @@
+/*
+ * um_sample.h
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Provides an interface for the sampling profiler. While the sampling engine
+ * (execute_sample() in um_execution.h) runs, a SIGPROF timer records the
+ * block being run, by the offset in segment 0 it starts at, along with the
+ * last few LOADPs seen running, which stand in for a call stack. Both come
+ * from what every engine publishes in Exec_stats at each LOADP, so samples
+ * are taken at full speed, the JIT included, but name the block rather than
+ * the instruction. At HALT the samples are written as folded stacks
+ * ("frame;frame;frame count" per line), the input format of flame graph
+ * tools.
+*/
+
+#ifndef UM_SAMPLE_
+#define UM_SAMPLE_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#define T Sampler_T
+typedef struct T *T; /* pointer to the samples of one run */
+
+struct Exec_stats; /* see um_execution.h */
+
+/* Takes in where to write the folded stacks and returns a new sampler */
+extern T sampler_new(FILE *out);
+
+/* Takes in a pointer to a sampler, stops it if running, and frees it */
+extern void sampler_free(T *sampler);
+
+/*
+ * Takes in a sampler and the counters the engine keeps up to date, and
+ *      starts taking samples. Only one sampler can run at a time; starting
+ *      the one that runs again carries on with the same samples.
+ */
+extern void sampler_start(T sampler, const struct Exec_stats *stats);
+
+/* Takes in a sampler, stops it, and writes its folded stacks */
+extern void sampler_report(T sampler);
+
+#undef T
+#endif
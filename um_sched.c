@@ -0,0 +1,763 @@
+/*
+ * um_sched.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Implementation of the um_sched.h interface. Every worker has a queue of
+ * machines of its own, a ring kept behind a mutex that is only taken
+ * between slices: the worker runs the oldest machine on it and puts it back
+ * at the newest end when its slice runs out, so machines on one worker take
+ * turns, while an idle worker steals from the newest end of another's.
+ * Workers with nothing to run or steal sleep on a condition variable,
+ * which is only signalled if someone is sleeping.
+ *
+ * A machine blocked on input is registered with epoll, one-shot, and a
+ * thread of its own waits on it and queues the machines whose input became
+ * readable, or reached its end, spreading them over the workers in turn.
+ * Should epoll_wait itself fail, the poller says so and stops, after putting
+ * the machines it was waiting on back on the queues; from then on a blocked
+ * machine is queued again straight away, to try its IN once more.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "um_sched.h"
+
+#define T Sched_T
+
+/* macros ================================================================== */
+#define INITIAL_QUEUE 64    /* machines a queue holds before it grows */
+#define POLL_EVENTS 64      /* ready descriptors taken per epoll_wait */
+#define CACHE_LINE 64
+
+/* struct definition ======================================================= */
+typedef struct Task {
+    Um_vm_T vm;
+    int fd;                 /* input descriptor */
+    int flags;              /* its file status flags, put back before done */
+    bool polled;            /* registered with epoll */
+    bool waiting;           /* set aside until its input is readable */
+    struct Task *swept;     /* on the poller's list to queue if it fails */
+    struct Task *prev;      /* on the list of every machine not done */
+    struct Task *next;
+} Task;
+
+/* aligned so that workers don't share a cache line */
+typedef struct Worker {
+    pthread_mutex_t lock;   /* guards the queue */
+    Task **queue;           /* ring, oldest at head */
+    uint32_t capacity;      /* a power of 2 */
+    uint32_t head;
+    uint32_t count;         /* also read unlocked, to skip empty queues */
+    unsigned seed;          /* picks whom to steal from */
+    Sched_stats stats;      /* written by this worker alone */
+    pthread_t thread;
+    T sched;
+} __attribute__((aligned(CACHE_LINE))) Worker;
+
+struct T {
+    Worker *workers;
+    unsigned count;
+    uint64_t slice;
+    Sched_done done;
+    void *cl;
+
+    pthread_mutex_t lock;   /* guards tasks, live, waiting and poll_failed */
+    pthread_cond_t work;    /* something was queued, or stopping */
+    pthread_cond_t idle;    /* live reached 0 */
+    Task *tasks;
+    uint64_t live;
+    unsigned sleeping;      /* read unlocked by whoever queues a machine */
+    bool stopping;
+    unsigned next;          /* worker the next new or ready machine goes to */
+
+    int epoll_fd;
+    int wake_fd;            /* stops the poller */
+    bool poll_failed;       /* the poller stopped on an error */
+    pthread_t poller;
+};
+
+/* function declarations =================================================== */
+static void *work(void *worker);
+static void run_slice(T sched, Worker *worker, Task *task);
+static Task *pop(Worker *worker);
+static Task *steal(T sched, Worker *thief);
+static void push(T sched, Worker *worker, Task *task, bool from_owner);
+static bool wait_for_work(T sched);
+static bool any_queued(T sched);
+static void set_aside(T sched, Task *task);
+static void *poll_input(void *sched);
+static void stop_polling(T sched, int error);
+static void finish(T sched, Task *task, Exec_status status);
+static Worker *next_worker(T sched);
+static void start_thread(pthread_t *thread, void *(*run)(void *), void *arg);
+
+/* function definitions ==================================================== */
+
+/* sched_new
+ *
+ *      Purpose: Create a scheduler and start its workers and the thread
+ *               waiting on blocked input.
+ *
+ *   Parameters: How many workers, 0 for one per online CPU, instructions
+ *               per slice, what to call as machines stop and its closure.
+ *
+ *      Returns: New instance of Sched_T.
+ *
+ * Expectations: slice is not 0 and done is not null. A machine under the
+ *               JIT keeps its translations between slices, so every engine
+ *               can run on the same slice.
+*/
+extern T sched_new(unsigned workers, uint64_t slice, Sched_done done,
+                   void *cl)
+{
+    assert(slice > 0 && done != NULL);
+
+    if (workers == 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        workers = (online > 0) ? (unsigned)online : 1;
+    }
+
+    T sched = calloc(1, sizeof(*sched));
+    assert(sched != NULL);
+
+    sched->count = workers;
+    sched->slice = slice;
+    sched->done = done;
+    sched->cl = cl;
+    pthread_mutex_init(&sched->lock, NULL);
+    pthread_cond_init(&sched->work, NULL);
+    pthread_cond_init(&sched->idle, NULL);
+
+    void *memory = NULL;
+    int allocated = posix_memalign(&memory, CACHE_LINE,
+                                   workers * sizeof(Worker));
+    assert(allocated == 0);
+    sched->workers = memory;
+    memset(sched->workers, 0, workers * sizeof(Worker));
+
+    for (unsigned i = 0; i < workers; i++) {
+        Worker *worker = &sched->workers[i];
+        pthread_mutex_init(&worker->lock, NULL);
+        worker->capacity = INITIAL_QUEUE;
+        worker->queue = malloc(INITIAL_QUEUE * sizeof(Task *));
+        assert(worker->queue != NULL);
+        worker->seed = i + 1;
+        worker->sched = sched;
+    }
+
+    sched->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    sched->wake_fd = eventfd(0, EFD_CLOEXEC);
+    assert(sched->epoll_fd >= 0 && sched->wake_fd >= 0);
+
+    /* the poller knows the wake descriptor by its null pointer */
+    struct epoll_event event = { .events = EPOLLIN, .data.ptr = NULL };
+    int added = epoll_ctl(sched->epoll_fd, EPOLL_CTL_ADD, sched->wake_fd,
+                          &event);
+    assert(added == 0);
+
+    start_thread(&sched->poller, poll_input, sched);
+    for (unsigned i = 0; i < workers; i++) {
+        start_thread(&sched->workers[i].thread, work, &sched->workers[i]);
+    }
+
+    return sched;
+}
+
+/* sched_add
+ *
+ *      Purpose: Make a machine's input non-blocking, noting its flags as
+ *               they were, and queue it on the next worker in turn.
+ *
+ *   Parameters: Instance of Sched_T and the machine.
+ *
+ *      Returns: None
+ *
+ * Expectations: The machine is still running and no other machine added
+ *               reads its input descriptor.
+*/
+extern void sched_add(T sched, Um_vm_T vm)
+{
+    assert(sched != NULL && vm != NULL);
+    assert(um_vm_status(vm) == EXEC_RUNNING);
+
+    Task *task = calloc(1, sizeof(*task));
+    assert(task != NULL);
+    task->vm = vm;
+    task->fd = um_vm_input_fd(vm);
+
+    task->flags = fcntl(task->fd, F_GETFL);
+    assert(task->flags >= 0);
+    fcntl(task->fd, F_SETFL, task->flags | O_NONBLOCK);
+
+    pthread_mutex_lock(&sched->lock);
+    task->next = sched->tasks;
+    if (sched->tasks != NULL) {
+        sched->tasks->prev = task;
+    }
+    sched->tasks = task;
+    sched->live++;
+    pthread_mutex_unlock(&sched->lock);
+
+    push(sched, next_worker(sched), task, false);
+}
+
+/* sched_wait
+ *
+ *      Purpose: Wait until every machine added has halted or faulted and
+ *               been passed to done.
+ *
+ *   Parameters: Instance of Sched_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: Not called from done. Machines blocked on input that never
+ *               comes keep it waiting.
+*/
+extern void sched_wait(T sched)
+{
+    assert(sched != NULL);
+
+    pthread_mutex_lock(&sched->lock);
+    while (sched->live > 0) {
+        pthread_cond_wait(&sched->idle, &sched->lock);
+    }
+    pthread_mutex_unlock(&sched->lock);
+}
+
+/* sched_stats
+ *
+ *      Purpose: Add up the workers' counters.
+ *
+ *   Parameters: Instance of Sched_T.
+ *
+ *      Returns: The totals; while workers run they may be a slice behind.
+ *
+ * Expectations: sched is not null.
+*/
+extern Sched_stats sched_stats(T sched)
+{
+    assert(sched != NULL);
+
+    Sched_stats total = { 0, 0, 0 };
+    for (unsigned i = 0; i < sched->count; i++) {
+        Sched_stats *stats = &sched->workers[i].stats;
+        total.slices += __atomic_load_n(&stats->slices, __ATOMIC_RELAXED);
+        total.blocks += __atomic_load_n(&stats->blocks, __ATOMIC_RELAXED);
+        total.steals += __atomic_load_n(&stats->steals, __ATOMIC_RELAXED);
+    }
+    return total;
+}
+
+/* sched_free
+ *
+ *      Purpose: Stop the workers once their slices end and the poller, pass
+ *               every machine not yet done to done with EXEC_RUNNING, and
+ *               free the scheduler.
+ *
+ *   Parameters: Pointer to an instance of Sched_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: sched and *sched are not null. Not called from done.
+*/
+extern void sched_free(T *sched)
+{
+    assert(sched != NULL && *sched != NULL);
+    T s = *sched;
+
+    pthread_mutex_lock(&s->lock);
+    __atomic_store_n(&s->stopping, true, __ATOMIC_RELEASE);
+    pthread_cond_broadcast(&s->work);
+    pthread_mutex_unlock(&s->lock);
+
+    uint64_t one = 1;
+    ssize_t wrote = write(s->wake_fd, &one, sizeof(one));
+    assert(wrote == sizeof(one));
+
+    for (unsigned i = 0; i < s->count; i++) {
+        pthread_join(s->workers[i].thread, NULL);
+    }
+    pthread_join(s->poller, NULL);
+
+    /* nothing else runs now, so queued and blocked machines can go back */
+    while (s->tasks != NULL) {
+        Task *task = s->tasks;
+        s->tasks = task->next;
+        fcntl(task->fd, F_SETFL, task->flags);
+        s->done(task->vm, EXEC_RUNNING, s->cl);
+        free(task);
+    }
+
+    for (unsigned i = 0; i < s->count; i++) {
+        pthread_mutex_destroy(&s->workers[i].lock);
+        free(s->workers[i].queue);
+    }
+    free(s->workers);
+
+    close(s->epoll_fd);
+    close(s->wake_fd);
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->work);
+    pthread_cond_destroy(&s->idle);
+
+    free(s);
+    *sched = NULL;
+}
+
+/* static function definitions============================================== */
+
+/* work
+ *
+ *      Purpose: Run a worker: take a machine from its own queue, or steal
+ *               one, run it for a slice, and sleep when there is none.
+ *
+ *   Parameters: The worker.
+ *
+ *      Returns: NULL once the scheduler is stopping.
+ *
+ * Expectations: Runs on a thread of its own.
+*/
+static void *work(void *worker)
+{
+    Worker *self = worker;
+    T sched = self->sched;
+
+    while (!__atomic_load_n(&sched->stopping, __ATOMIC_ACQUIRE)) {
+        Task *task = pop(self);
+        if (task == NULL) {
+            task = steal(sched, self);
+        }
+
+        if (task != NULL) {
+            run_slice(sched, self, task);
+        } else if (!wait_for_work(sched)) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/* run_slice
+ *
+ *      Purpose: Run a machine for one slice and decide where it goes next:
+ *               back on the queue, aside until its input is readable, or
+ *               to done.
+ *
+ *   Parameters: Instance of Sched_T, the worker running it and the machine.
+ *
+ *      Returns: None
+ *
+ * Expectations: The worker alone holds the task.
+*/
+static void run_slice(T sched, Worker *worker, Task *task)
+{
+    Exec_status status = um_vm_run_for(task->vm, sched->slice);
+    __atomic_add_fetch(&worker->stats.slices, 1, __ATOMIC_RELAXED);
+
+    switch (status) {
+        case EXEC_OUT_OF_BUDGET:
+            push(sched, worker, task, true);
+            break;
+
+        case EXEC_BLOCKED:
+            __atomic_add_fetch(&worker->stats.blocks, 1, __ATOMIC_RELAXED);
+            set_aside(sched, task);
+            break;
+
+        default:
+            finish(sched, task, status);
+            break;
+    }
+}
+
+/* pop
+ *
+ *      Purpose: Take the oldest machine off a worker's own queue.
+ *
+ *   Parameters: The worker.
+ *
+ *      Returns: The machine, or NULL if the queue is empty.
+ *
+ * Expectations: Called by the worker itself.
+*/
+static Task *pop(Worker *worker)
+{
+    if (__atomic_load_n(&worker->count, __ATOMIC_RELAXED) == 0) {
+        return NULL;
+    }
+
+    Task *task = NULL;
+    pthread_mutex_lock(&worker->lock);
+    if (worker->count > 0) {
+        task = worker->queue[worker->head];
+        worker->head = (worker->head + 1) & (worker->capacity - 1);
+        __atomic_store_n(&worker->count, worker->count - 1, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&worker->lock);
+
+    return task;
+}
+
+/* steal
+ *
+ *      Purpose: Take the newest machine off another worker's queue,
+ *               starting from one picked at random.
+ *
+ *   Parameters: Instance of Sched_T and the worker stealing.
+ *
+ *      Returns: The machine, or NULL if every other queue is empty.
+ *
+ * Expectations: Called by the thief itself.
+*/
+static Task *steal(T sched, Worker *thief)
+{
+    unsigned start = (unsigned)rand_r(&thief->seed) % sched->count;
+
+    for (unsigned i = 0; i < sched->count; i++) {
+        Worker *victim = &sched->workers[(start + i) % sched->count];
+        if (victim == thief ||
+            __atomic_load_n(&victim->count, __ATOMIC_RELAXED) == 0) {
+            continue;
+        }
+
+        Task *task = NULL;
+        pthread_mutex_lock(&victim->lock);
+        if (victim->count > 0) {
+            uint32_t newest = (victim->head + victim->count - 1) &
+                              (victim->capacity - 1);
+            task = victim->queue[newest];
+            __atomic_store_n(&victim->count, victim->count - 1,
+                             __ATOMIC_SEQ_CST);
+        }
+        pthread_mutex_unlock(&victim->lock);
+
+        if (task != NULL) {
+            __atomic_add_fetch(&thief->stats.steals, 1, __ATOMIC_RELAXED);
+            return task;
+        }
+    }
+    return NULL;
+}
+
+/* push
+ *
+ *      Purpose: Queue a machine at the newest end of a worker's queue,
+ *               growing it if full, and wake a sleeping worker if there is
+ *               one and it could find the machine.
+ *
+ *   Parameters: Instance of Sched_T, the worker, the machine, and whether
+ *               the worker is queuing a machine it just ran.
+ *
+ *      Returns: None
+ *
+ * Expectations: The caller alone holds the task.
+*/
+static void push(T sched, Worker *worker, Task *task, bool from_owner)
+{
+    pthread_mutex_lock(&worker->lock);
+    if (worker->count == worker->capacity) {
+        Task **queue = malloc(2 * worker->capacity * sizeof(Task *));
+        assert(queue != NULL);
+        for (uint32_t i = 0; i < worker->count; i++) {
+            queue[i] = worker->queue[(worker->head + i) &
+                                     (worker->capacity - 1)];
+        }
+        free(worker->queue);
+        worker->queue = queue;
+        worker->head = 0;
+        worker->capacity *= 2;
+    }
+
+    uint32_t count = worker->count;
+    worker->queue[(worker->head + count) & (worker->capacity - 1)] = task;
+    __atomic_store_n(&worker->count, count + 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&worker->lock);
+
+    /* the owner runs its only machine next; a sleeper can't help with it.
+     * The count is stored before sleeping is read, and wait_for_work does
+     * the reverse, so one of the two sees the other. */
+    if ((!from_owner || count > 0) &&
+        __atomic_load_n(&sched->sleeping, __ATOMIC_SEQ_CST) > 0) {
+        pthread_mutex_lock(&sched->lock);
+        pthread_cond_signal(&sched->work);
+        pthread_mutex_unlock(&sched->lock);
+    }
+}
+
+/* wait_for_work
+ *
+ *      Purpose: Sleep until some queue has a machine on it or the
+ *               scheduler is stopping.
+ *
+ *   Parameters: Instance of Sched_T.
+ *
+ *      Returns: False if the scheduler is stopping.
+ *
+ * Expectations: The worker found nothing to run or steal.
+*/
+static bool wait_for_work(T sched)
+{
+    __atomic_add_fetch(&sched->sleeping, 1, __ATOMIC_SEQ_CST);
+
+    pthread_mutex_lock(&sched->lock);
+    while (!sched->stopping && !any_queued(sched)) {
+        pthread_cond_wait(&sched->work, &sched->lock);
+    }
+    bool stopping = sched->stopping;
+    pthread_mutex_unlock(&sched->lock);
+
+    __atomic_sub_fetch(&sched->sleeping, 1, __ATOMIC_SEQ_CST);
+    return !stopping;
+}
+
+/* any_queued
+ *
+ *      Purpose: Tell whether any worker's queue has a machine on it.
+ *
+ *   Parameters: Instance of Sched_T.
+ *
+ *      Returns: True if one does.
+ *
+ * Expectations: None
+*/
+static bool any_queued(T sched)
+{
+    for (unsigned i = 0; i < sched->count; i++) {
+        if (__atomic_load_n(&sched->workers[i].count, __ATOMIC_SEQ_CST) > 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/* set_aside
+ *
+ *      Purpose: Have the poller queue a machine again once its input is
+ *               readable or at its end.
+ *
+ *   Parameters: Instance of Sched_T and the machine.
+ *
+ *      Returns: None
+ *
+ * Expectations: The machine stopped at an IN with nothing to read. Once
+ *               epoll has it, the task may already be running elsewhere,
+ *               so it isn't touched after. A descriptor epoll won't take,
+ *               or a poller that has stopped, just has its machine queued
+ *               again.
+*/
+static void set_aside(T sched, Task *task)
+{
+    struct epoll_event event = { .events = EPOLLIN | EPOLLONESHOT,
+                                 .data.ptr = task };
+    int op = task->polled ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    bool queue = true;
+
+    /* held until epoll has the task, so that a failing poller either sees
+     * it waiting or is seen to have failed */
+    pthread_mutex_lock(&sched->lock);
+    if (!sched->poll_failed) {
+        /* pairs with the loads in poll_input; epoll orders the hand-off
+         * anyway, but out of sight of race detectors */
+        __atomic_store_n(&task->waiting, true, __ATOMIC_RELEASE);
+        __atomic_store_n(&task->polled, true, __ATOMIC_RELEASE);
+
+        if (epoll_ctl(sched->epoll_fd, op, task->fd, &event) == 0) {
+            queue = false;
+        } else {
+            /* epoll refuses regular files (EPERM), whose reads never
+             * block, and can run out of room (ENOSPC, ENOMEM); either way
+             * the machine is still ours, and runs again to try its IN
+             * once more */
+            task->waiting = false;
+            task->polled = (op == EPOLL_CTL_MOD && errno != ENOENT);
+        }
+    }
+    pthread_mutex_unlock(&sched->lock);
+
+    if (queue) {
+        push(sched, next_worker(sched), task, false);
+    }
+}
+
+/* poll_input
+ *
+ *      Purpose: Wait on the input of every blocked machine and queue those
+ *               that can go on, until woken through wake_fd or epoll_wait
+ *               fails.
+ *
+ *   Parameters: Instance of Sched_T.
+ *
+ *      Returns: NULL once the scheduler is stopping or polling failed.
+ *
+ * Expectations: Runs on a thread of its own.
+*/
+static void *poll_input(void *sched)
+{
+    T s = sched;
+    struct epoll_event events[POLL_EVENTS];
+
+    for (;;) {
+        int ready = epoll_wait(s->epoll_fd, events, POLL_EVENTS, -1);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            stop_polling(s, errno);
+            return NULL;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            Task *task = events[i].data.ptr;
+            if (task == NULL) {
+                return NULL;
+            }
+            bool polled = __atomic_load_n(&task->polled, __ATOMIC_ACQUIRE);
+            assert(polled);
+            (void)polled;
+            __atomic_store_n(&task->waiting, false, __ATOMIC_RELAXED);
+            push(s, next_worker(s), task, false);
+        }
+    }
+}
+
+/* stop_polling
+ *
+ *      Purpose: Report why epoll_wait failed and queue again every machine
+ *               the poller was waiting on, so that they go on trying their
+ *               IN rather than wait for good.
+ *
+ *   Parameters: Instance of Sched_T and the errno epoll_wait set.
+ *
+ *      Returns: None
+ *
+ * Expectations: Called by the poller, which stops after. Once poll_failed
+ *               is set, set_aside no longer hands machines to epoll.
+*/
+static void stop_polling(T sched, int error)
+{
+    fprintf(stderr, "um: waiting on input failed: %s\n", strerror(error));
+
+    /* push may take the lock, so the machines are gathered first; no one
+     * else can queue them, as none of them is running */
+    Task *swept = NULL;
+    pthread_mutex_lock(&sched->lock);
+    sched->poll_failed = true;
+    for (Task *task = sched->tasks; task != NULL; task = task->next) {
+        if (__atomic_load_n(&task->waiting, __ATOMIC_ACQUIRE)) {
+            task->waiting = false;
+            task->swept = swept;
+            swept = task;
+        }
+    }
+    pthread_mutex_unlock(&sched->lock);
+
+    while (swept != NULL) {
+        Task *task = swept;
+        swept = task->swept;
+        push(sched, next_worker(sched), task, false);
+    }
+}
+
+/* finish
+ *
+ *      Purpose: Hand a machine that stopped to done and forget it.
+ *
+ *   Parameters: Instance of Sched_T, the machine and the status it stopped
+ *               with.
+ *
+ *      Returns: None
+ *
+ * Expectations: The caller alone holds the task.
+*/
+static void finish(T sched, Task *task, Exec_status status)
+{
+    /* done may close the descriptor, so it leaves epoll, and gets back the
+     * flags it shares with whoever else has it open, first */
+    if (task->polled) {
+        epoll_ctl(sched->epoll_fd, EPOLL_CTL_DEL, task->fd, NULL);
+    }
+    fcntl(task->fd, F_SETFL, task->flags);
+
+    sched->done(task->vm, status, sched->cl);
+
+    pthread_mutex_lock(&sched->lock);
+    if (task->prev != NULL) {
+        task->prev->next = task->next;
+    } else {
+        sched->tasks = task->next;
+    }
+    if (task->next != NULL) {
+        task->next->prev = task->prev;
+    }
+
+    sched->live--;
+    if (sched->live == 0) {
+        pthread_cond_broadcast(&sched->idle);
+    }
+    pthread_mutex_unlock(&sched->lock);
+
+    free(task);
+}
+
+/* next_worker
+ *
+ *      Purpose: Pick the worker a new or ready machine is queued on.
+ *
+ *   Parameters: Instance of Sched_T.
+ *
+ *      Returns: Each worker in turn.
+ *
+ * Expectations: None
+*/
+static Worker *next_worker(T sched)
+{
+    unsigned next = __atomic_fetch_add(&sched->next, 1, __ATOMIC_RELAXED);
+    return &sched->workers[next % sched->count];
+}
+
+/* start_thread
+ *
+ *      Purpose: Start a thread with the signals sent to the process as a
+ *               whole blocked, leaving them to the threads the program
+ *               started itself. Signals a thread raises by faulting (SIGSEGV,
+ *               SIGFPE, SIGBUS, SIGILL, SIGABRT from an assert) stay
+ *               unblocked, so that they still reach their handlers rather
+ *               than kill the process outright.
+ *
+ *   Parameters: Where to put its id, what it runs, and its argument.
+ *
+ *      Returns: None
+ *
+ * Expectations: The thread can be created.
+*/
+static void start_thread(pthread_t *thread, void *(*run)(void *), void *arg)
+{
+    static const int process_signals[] = {
+        SIGINT, SIGTERM, SIGHUP, SIGQUIT, SIGUSR1, SIGUSR2, SIGALRM, SIGPROF
+    };
+    int num_signals = sizeof(process_signals) / sizeof(process_signals[0]);
+
+    sigset_t blocked, old;
+    sigemptyset(&blocked);
+    for (int i = 0; i < num_signals; i++) {
+        sigaddset(&blocked, process_signals[i]);
+    }
+    pthread_sigmask(SIG_BLOCK, &blocked, &old);
+    int created = pthread_create(thread, NULL, run, arg);
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+
+    assert(created == 0);
+    (void)created;
+}
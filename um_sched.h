@@ -0,0 +1,77 @@
+/*
+ * um_sched.h
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Provides an interface for running many machines on a pool of worker
+ * threads. Each worker runs one machine at a time for a slice of
+ * instructions, with um_vm_run_for(), and then moves on to the next; a
+ * machine that reaches an IN with nothing to read is set aside until its
+ * input is readable, so machines waiting on input cost nothing. Workers
+ * with nothing queued take machines from the others. Should waiting on
+ * input fail, the scheduler says so on stderr and falls back to running a
+ * blocked machine again straight away, to retry its IN.
+ *
+ * Machines share no mutable state, so the engines run without locks; the
+ * scheduler only locks between slices. The input descriptor of each
+ * machine is made non-blocking while the scheduler has the machine, and has
+ * to be one no other machine reads; its flags are put back before the
+ * machine is passed to done, since they are shared with every process that
+ * has the same file open, a shell's terminal or pipe among them.
+ * Output is written from the worker running the machine, which waits for
+ * the descriptor to take it even if it shares a file description (say, a
+ * terminal) with an input made non-blocking.
+*/
+
+#ifndef UM_SCHED_
+#define UM_SCHED_
+
+#include <stdint.h>
+#include "um_vm.h"
+
+#define T Sched_T
+typedef struct T *T; /* pointer to a pool of workers and their machines */
+
+/*
+ * Called from a worker once a machine halts or faults, with the status it
+ *      stopped with and the closure given to sched_new. It now owns the
+ *      machine and may free it. sched_free calls it with EXEC_RUNNING for
+ *      machines that hadn't stopped. Calls can come from several workers
+ *      at once.
+ */
+typedef void (*Sched_done)(Um_vm_T vm, Exec_status status, void *cl);
+
+/* totals over every worker, read while they run */
+typedef struct Sched_stats {
+    uint64_t slices;    /* calls to um_vm_run_for */
+    uint64_t blocks;    /* slices that ended at an IN with nothing to read */
+    uint64_t steals;    /* machines taken from another worker's queue */
+} Sched_stats;
+
+/*
+ * Takes in how many workers to start, 0 for one per online CPU, how many
+ *      instructions a slice runs, and what to call as machines stop.
+ */
+extern T sched_new(unsigned workers, uint64_t slice, Sched_done done,
+                   void *cl);
+
+/*
+ * Takes in a scheduler and a machine that is still running, and queues it.
+ *      The scheduler owns the machine until it is passed to done.
+ */
+extern void sched_add(T sched, Um_vm_T vm);
+
+/* Takes in a scheduler and waits until every machine added has stopped */
+extern void sched_wait(T sched);
+
+/* Takes in a scheduler and returns its counters so far */
+extern Sched_stats sched_stats(T sched);
+
+/*
+ * Takes in a pointer to a scheduler, stops its workers at the end of their
+ *      slices, hands back machines still running, and frees it.
+ */
+extern void sched_free(T *sched);
+
+#undef T
+#endif
@@ -0,0 +1,277 @@
+/*
+ * um_sched_bench.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Benchmark for the scheduler in um_sched.c, run through a "main()". The
+ * same batch of machines, each counting down a loop with no input, is run
+ * on 1, 2, 4, ... workers up to the number of online CPUs, and the table
+ * gives instructions per second and the speedup over one worker. A second
+ * table runs machines that each read a pipe written by the main thread a
+ * byte at a time, so they block whenever they catch up with it, and gives
+ * bytes read per second.
+ *
+ * Usage: um_sched_bench [machines] [iterations]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "um_sched.h"
+#include "um_encode.h"
+
+/* macros ================================================================== */
+#define DEFAULT_MACHINES 2000
+#define DEFAULT_ITERATIONS 20000
+#define SLICE 20000
+#define BLOCKING_MACHINES 200
+#define BYTES 200           /* written to each blocking machine */
+
+/* function declarations =================================================== */
+static double bench_counting(unsigned workers, unsigned machines,
+                             uint32_t iterations, uint64_t *instructions,
+                             Sched_stats *stats);
+static double bench_blocking(unsigned workers, Sched_stats *stats);
+static void count_done(Um_vm_T vm, Exec_status status, void *cl);
+static Um_vm_T counting_vm(uint32_t count, int in_fd, int out_fd);
+static Um_vm_T reading_vm(int in_fd, int out_fd);
+static double now(void);
+
+/* function definitions ==================================================== */
+int main(int argc, char *argv[])
+{
+    unsigned machines = (argc > 1) ? (unsigned)strtoul(argv[1], NULL, 0)
+                                   : DEFAULT_MACHINES;
+    uint32_t iterations = (argc > 2) ? (uint32_t)strtoul(argv[2], NULL, 0)
+                                     : DEFAULT_ITERATIONS;
+    long online = sysconf(_SC_NPROCESSORS_ONLN);
+    unsigned cpus = (online > 0) ? (unsigned)online : 1;
+
+    printf("%u machines of %u iterations, %u CPUs online\n\n", machines,
+           iterations, cpus);
+    printf("%-8s %10s %8s %10s %10s\n", "workers", "MIPS", "speedup",
+           "slices", "steals");
+
+    double base = 0;
+    for (unsigned workers = 1; workers <= cpus; workers *= 2) {
+        uint64_t instructions = 0;
+        Sched_stats stats;
+        double seconds = bench_counting(workers, machines, iterations,
+                                        &instructions, &stats);
+        double mips = (double)instructions / seconds / 1e6;
+        if (workers == 1) {
+            base = mips;
+        }
+        printf("%-8u %10.1f %8.2f %10llu %10llu\n", workers, mips,
+               mips / base, (unsigned long long)stats.slices,
+               (unsigned long long)stats.steals);
+    }
+
+    printf("\n%u machines reading %u bytes each\n\n", BLOCKING_MACHINES,
+           BYTES);
+    printf("%-8s %14s %10s\n", "workers", "bytes/sec", "blocks");
+    for (unsigned workers = 1; workers <= cpus; workers *= 2) {
+        Sched_stats stats;
+        double seconds = bench_blocking(workers, &stats);
+        printf("%-8u %14.0f %10llu\n", workers,
+               (double)BLOCKING_MACHINES * BYTES / seconds,
+               (unsigned long long)stats.blocks);
+    }
+
+    return 0;
+}
+
+/* bench_counting
+ *
+ *      Purpose: Time a batch of counting machines on some workers.
+ *
+ *   Parameters: Workers, machines, loop iterations each, and where to put
+ *               the instructions run and the scheduler's counters.
+ *
+ *      Returns: Seconds from the first machine added to the last done.
+ *
+ * Expectations: iterations is under 2^25.
+*/
+static double bench_counting(unsigned workers, unsigned machines,
+                             uint32_t iterations, uint64_t *instructions,
+                             Sched_stats *stats)
+{
+    int out_fd = open("/dev/null", O_WRONLY);
+    int *inputs = malloc(machines * sizeof(int));
+    assert(out_fd >= 0 && inputs != NULL);
+
+    /* machines are made first, so only running them is timed */
+    Um_vm_T *vms = malloc(machines * sizeof(Um_vm_T));
+    assert(vms != NULL);
+    for (unsigned i = 0; i < machines; i++) {
+        inputs[i] = open("/dev/null", O_RDONLY);
+        assert(inputs[i] >= 0);
+        vms[i] = counting_vm(iterations, inputs[i], out_fd);
+    }
+
+    *instructions = 0;
+    Sched_T sched = sched_new(workers, SLICE, count_done, instructions);
+    double start = now();
+    for (unsigned i = 0; i < machines; i++) {
+        sched_add(sched, vms[i]);
+    }
+    sched_wait(sched);
+    double seconds = now() - start;
+    *stats = sched_stats(sched);
+    sched_free(&sched);
+
+    for (unsigned i = 0; i < machines; i++) {
+        close(inputs[i]);
+    }
+    free(vms);
+    free(inputs);
+    close(out_fd);
+    return seconds;
+}
+
+/* bench_blocking
+ *
+ *      Purpose: Time machines reading input written a byte at a time.
+ *
+ *   Parameters: Workers, and where to put the scheduler's counters.
+ *
+ *      Returns: Seconds from the first byte written to the last done.
+ *
+ * Expectations: None
+*/
+static double bench_blocking(unsigned workers, Sched_stats *stats)
+{
+    int out_fd = open("/dev/null", O_WRONLY);
+    int readers[BLOCKING_MACHINES];
+    int writers[BLOCKING_MACHINES];
+    uint64_t instructions = 0;
+    assert(out_fd >= 0);
+
+    Sched_T sched = sched_new(workers, SLICE, count_done, &instructions);
+    for (int i = 0; i < BLOCKING_MACHINES; i++) {
+        int ends[2];
+        int made = pipe(ends);
+        assert(made == 0);
+        readers[i] = ends[0];
+        writers[i] = ends[1];
+        sched_add(sched, reading_vm(readers[i], out_fd));
+    }
+
+    double start = now();
+    for (int byte = 0; byte < BYTES; byte++) {
+        for (int i = 0; i < BLOCKING_MACHINES; i++) {
+            ssize_t wrote = write(writers[i], "x", 1);
+            assert(wrote == 1);
+        }
+    }
+    for (int i = 0; i < BLOCKING_MACHINES; i++) {
+        close(writers[i]);
+    }
+    sched_wait(sched);
+    double seconds = now() - start;
+    *stats = sched_stats(sched);
+    sched_free(&sched);
+
+    for (int i = 0; i < BLOCKING_MACHINES; i++) {
+        close(readers[i]);
+    }
+    close(out_fd);
+    return seconds;
+}
+
+/* static function definitions============================================== */
+
+/* count_done
+ *
+ *      Purpose: Add up what a machine ran and free it.
+ *
+ *   Parameters: The machine, its status and the running total.
+ *
+ *      Returns: None
+ *
+ * Expectations: The machine halted.
+*/
+static void count_done(Um_vm_T vm, Exec_status status, void *cl)
+{
+    assert(status == EXEC_HALTED);
+    (void)status;
+    __atomic_add_fetch((uint64_t *)cl, um_vm_stats(vm)->instructions,
+                       __ATOMIC_RELAXED);
+    um_vm_free(&vm);
+}
+
+/* counting_vm
+ *
+ *      Purpose: Make a machine that loops count times, one LOADP a step.
+ *
+ *   Parameters: The count, and the descriptors for IN and OUT.
+ *
+ *      Returns: The machine.
+ *
+ * Expectations: count is under 2^25.
+*/
+static Um_vm_T counting_vm(uint32_t count, int in_fd, int out_fd)
+{
+    const uint32_t program[] = {
+        encode_word(NAND, 2, 0, 0),             /* r2 = ~0 */
+        encode_lv(3, count),
+        encode_lv(4, 1),
+        encode_lv(5, 5),                        /* top */
+        encode_lv(6, 10),                       /* out */
+        encode_word(ADD, 3, 3, 2),              /* top: r3 -= 1 */
+        encode_word(ADD, 1, 1, 4),              /* r1 += 1 */
+        encode_word(ADD, 7, 6, 0),              /* r7 = out */
+        encode_word(CMOV, 7, 5, 3),             /* r7 = top if r3 */
+        encode_word(LOADP, 0, 0, 7),            /* loadp r7 */
+        encode_word(HALT, 0, 0, 0)              /* out: halt */
+    };
+    return um_vm_new(program, 11, in_fd, out_fd);
+}
+
+/* reading_vm
+ *
+ *      Purpose: Make a machine that reads its input to the end.
+ *
+ *   Parameters: The descriptors for IN and OUT.
+ *
+ *      Returns: The machine.
+ *
+ * Expectations: None
+*/
+static Um_vm_T reading_vm(int in_fd, int out_fd)
+{
+    const uint32_t program[] = {
+        encode_lv(5, 2),                        /* top */
+        encode_lv(6, 7),                        /* end */
+        encode_word(IN, 0, 0, 3),               /* top: in r3 */
+        encode_word(NAND, 4, 3, 3),             /* r4 = 0 at the end */
+        encode_word(ADD, 7, 6, 0),              /* r7 = end */
+        encode_word(CMOV, 7, 5, 4),             /* r7 = top if r4 */
+        encode_word(LOADP, 0, 0, 7),            /* loadp r7 */
+        encode_word(HALT, 0, 0, 0)              /* end: halt */
+    };
+    return um_vm_new(program, 8, in_fd, out_fd);
+}
+
+/* now
+ *
+ *      Purpose: Read a monotonic clock.
+ *
+ *   Parameters: None
+ *
+ *      Returns: Seconds since some fixed point.
+ *
+ * Expectations: None
+*/
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
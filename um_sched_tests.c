@@ -0,0 +1,322 @@
+/*
+ * um_sched_tests.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Contains all declarations and definitions of functions to test running
+ * many machines on a pool of workers through the um_sched.h interface.
+ * Tests through a "main()" that machines blocked on input are resumed once
+ * it comes, that machines out of budget take turns until they halt, and
+ * that freeing the scheduler hands back machines still waiting.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+
+#include "um_sched.h"
+#include "um_encode.h"
+
+/* macros ================================================================== */
+#define WAITING 400         /* machines reading from a pipe, two fds each */
+#define COMPUTING 64        /* machines that never read */
+#define ROUNDS 3            /* writes to each pipe */
+#define MAX_FD 4096
+#define DEADLINE_MS 10000   /* longest wait for the workers to catch up */
+
+/* struct definition ======================================================= */
+typedef struct Result {     /* what done saw, by input descriptor */
+    Exec_status status;
+    uint32_t value;
+    int finished;
+    bool blocking;          /* the input's O_NONBLOCK was cleared again */
+} Result;
+
+static Result results[MAX_FD];
+
+/* function declarations =================================================== */
+void test_sched_blocked();
+void test_sched_slices();
+void test_sched_free();
+static void record(Um_vm_T vm, Exec_status status, void *cl);
+static Um_vm_T summing_vm(int in_fd, int out_fd);
+static Um_vm_T counting_vm(uint32_t count, int in_fd, int out_fd);
+static bool wait_for_blocks(Sched_T sched, uint64_t blocks);
+static void pause_ms(long ms);
+
+/* function definitions ==================================================== */
+int main()
+{
+    test_sched_blocked();
+    test_sched_slices();
+    test_sched_free();
+
+    return 0;
+}
+
+/* test_sched_blocked
+ *
+ *    Purpose: Test that machines waiting on input are set aside and resumed
+ *
+ * Parameters: None
+ *    Returns: None
+ *
+ *      Tests: WAITING machines each sum what comes down its own pipe, which
+ *             is written in ROUNDS after they have all blocked, then closed,
+ *             and get their pipe back blocking
+ *
+*/
+void test_sched_blocked()
+{
+    static int writers[WAITING];
+    static int readers[WAITING];
+    int out_fd = open("/dev/null", O_WRONLY);
+    assert(out_fd >= 0);
+    memset(results, 0, sizeof(results));
+
+    Sched_T sched = sched_new(4, 1000, record, NULL);
+    for (int i = 0; i < WAITING; i++) {
+        int ends[2];
+        int made = pipe(ends);
+        assert(made == 0 && ends[0] < MAX_FD);
+        readers[i] = ends[0];
+        writers[i] = ends[1];
+        sched_add(sched, summing_vm(readers[i], out_fd));
+    }
+
+    bool blocked = wait_for_blocks(sched, WAITING);
+    assert(blocked);
+
+    for (int round = 0; round < ROUNDS; round++) {
+        for (int i = 0; i < WAITING; i++) {
+            uint8_t bytes[3] = { (uint8_t)i, (uint8_t)round, 7 };
+            ssize_t wrote = write(writers[i], bytes, 3);
+            assert(wrote == 3);
+        }
+        pause_ms(5);
+    }
+    for (int i = 0; i < WAITING; i++) {
+        close(writers[i]);
+    }
+
+    sched_wait(sched);
+    Sched_stats stats = sched_stats(sched);
+    assert(stats.slices >= stats.blocks && stats.blocks >= WAITING);
+    sched_free(&sched);
+    assert(sched == NULL);
+
+    for (int i = 0; i < WAITING; i++) {
+        Result *result = &results[readers[i]];
+        assert(result->finished == 1 && result->blocking);
+        assert(result->status == EXEC_HALTED);
+        assert(result->value == 3 * (uint32_t)(uint8_t)i + 0 + 1 + 2 +
+                                ROUNDS * 7);
+    }
+    close(out_fd);
+}
+
+/* test_sched_slices
+ *
+ *    Purpose: Test that machines out of budget take turns to the end
+ *
+ * Parameters: None
+ *    Returns: None
+ *
+ *      Tests: COMPUTING loops of different lengths on three workers, with
+ *             slices far shorter than the loops, all end with their count
+ *
+*/
+void test_sched_slices()
+{
+    static int inputs[COMPUTING];
+    int out_fd = open("/dev/null", O_WRONLY);
+    assert(out_fd >= 0);
+    memset(results, 0, sizeof(results));
+
+    /* record closes each input, so all are open before any can finish */
+    for (int i = 0; i < COMPUTING; i++) {
+        inputs[i] = open("/dev/null", O_RDONLY);
+        assert(inputs[i] >= 0 && inputs[i] < MAX_FD);
+    }
+
+    Sched_T sched = sched_new(3, 100, record, NULL);
+    for (int i = 0; i < COMPUTING; i++) {
+        sched_add(sched, counting_vm(1000 + 100 * i, inputs[i], out_fd));
+    }
+    sched_wait(sched);
+    assert(sched_stats(sched).slices > COMPUTING * 1000 / 100);
+    sched_free(&sched);
+
+    for (int i = 0; i < COMPUTING; i++) {
+        Result *result = &results[inputs[i]];
+        assert(result->finished == 1 && result->blocking);
+        assert(result->status == EXEC_HALTED);
+        assert(result->value == 1000 + 100 * (uint32_t)i);
+    }
+    close(out_fd);
+}
+
+/* test_sched_free
+ *
+ *    Purpose: Test that freeing a scheduler hands back waiting machines
+ *
+ * Parameters: None
+ *    Returns: None
+ *
+ *      Tests: Machines whose pipes are never written come back to done
+ *             still running, once each, and a scheduler with none frees
+ *
+*/
+void test_sched_free()
+{
+    int writers[8];
+    int readers[8];
+    int out_fd = open("/dev/null", O_WRONLY);
+    assert(out_fd >= 0);
+    memset(results, 0, sizeof(results));
+
+    Sched_T sched = sched_new(2, 1000, record, NULL);
+    for (int i = 0; i < 8; i++) {
+        int ends[2];
+        int made = pipe(ends);
+        assert(made == 0 && ends[0] < MAX_FD);
+        readers[i] = ends[0];
+        writers[i] = ends[1];
+        sched_add(sched, summing_vm(readers[i], out_fd));
+    }
+    bool blocked = wait_for_blocks(sched, 8);
+    assert(blocked);
+    sched_free(&sched);
+
+    for (int i = 0; i < 8; i++) {
+        assert(results[readers[i]].finished == 1);
+        assert(results[readers[i]].blocking);
+        assert(results[readers[i]].status == EXEC_RUNNING);
+        close(writers[i]);
+    }
+
+    sched = sched_new(0, 1000, record, NULL);
+    sched_wait(sched);
+    sched_free(&sched);
+    close(out_fd);
+}
+
+/* static function definitions============================================== */
+
+/* record
+ *
+ *    Purpose: Note how a machine stopped, what it left in register 1 and
+ *             whether its input blocks again, then free it and close its
+ *             input
+ *
+ * Parameters: The machine, its status, and an unused closure
+ *    Returns: None
+ *
+*/
+static void record(Um_vm_T vm, Exec_status status, void *cl)
+{
+    (void)cl;
+    int fd = um_vm_input_fd(vm);
+    assert(fd >= 0 && fd < MAX_FD);
+
+    results[fd].status = status;
+    results[fd].value = um_vm_registers(vm)[1];
+    results[fd].finished++;
+    results[fd].blocking = (fcntl(fd, F_GETFL) & O_NONBLOCK) == 0;
+
+    um_vm_free(&vm);
+    close(fd);
+}
+
+/* summing_vm
+ *
+ *    Purpose: Make a machine that echoes its input and sums it in r1
+ *
+ * Parameters: The descriptors for IN and OUT
+ *    Returns: The machine
+ *
+*/
+static Um_vm_T summing_vm(int in_fd, int out_fd)
+{
+    const uint32_t program[] = {
+        encode_lv(5, 2),                        /* top */
+        encode_lv(6, 11),                       /* end */
+        encode_word(IN, 0, 0, 3),               /* top: in r3 */
+        encode_word(NAND, 4, 3, 3),             /* r4 = 0 at the end */
+        encode_word(ADD, 7, 6, 0),              /* r7 = end */
+        encode_lv(2, 8),                        /* body */
+        encode_word(CMOV, 7, 2, 4),             /* r7 = body if r4 */
+        encode_word(LOADP, 0, 0, 7),            /* loadp r7 */
+        encode_word(ADD, 1, 1, 3),              /* body: r1 += r3 */
+        encode_word(OUT, 0, 0, 3),              /* out r3 */
+        encode_word(LOADP, 0, 0, 5),            /* loadp top */
+        encode_word(HALT, 0, 0, 0)              /* end: halt */
+    };
+    return um_vm_new(program, 12, in_fd, out_fd);
+}
+
+/* counting_vm
+ *
+ *    Purpose: Make a machine that counts r1 up to count, one LOADP a step
+ *
+ * Parameters: The count, under 2^25, and the descriptors for IN and OUT
+ *    Returns: The machine
+ *
+*/
+static Um_vm_T counting_vm(uint32_t count, int in_fd, int out_fd)
+{
+    const uint32_t program[] = {
+        encode_word(NAND, 2, 0, 0),             /* r2 = ~0 */
+        encode_lv(3, count),
+        encode_lv(4, 1),
+        encode_lv(5, 5),                        /* top */
+        encode_lv(6, 10),                       /* out */
+        encode_word(ADD, 3, 3, 2),              /* top: r3 -= 1 */
+        encode_word(ADD, 1, 1, 4),              /* r1 += 1 */
+        encode_word(ADD, 7, 6, 0),              /* r7 = out */
+        encode_word(CMOV, 7, 5, 3),             /* r7 = top if r3 */
+        encode_word(LOADP, 0, 0, 7),            /* loadp r7 */
+        encode_word(HALT, 0, 0, 0)              /* out: halt */
+    };
+    return um_vm_new(program, 11, in_fd, out_fd);
+}
+
+/* wait_for_blocks
+ *
+ *    Purpose: Wait for the workers to have set aside some number of
+ *             machines, however slow the machine running the tests
+ *
+ * Parameters: The scheduler and how many blocks to wait for
+ *    Returns: Whether there were that many before DEADLINE_MS passed
+ *
+*/
+static bool wait_for_blocks(Sched_T sched, uint64_t blocks)
+{
+    for (long waited = 0; waited < DEADLINE_MS; waited++) {
+        if (sched_stats(sched).blocks >= blocks) {
+            return true;
+        }
+        pause_ms(1);
+    }
+    return sched_stats(sched).blocks >= blocks;
+}
+
+/* pause_ms
+ *
+ *    Purpose: Give the workers time to run
+ *
+ * Parameters: Milliseconds to sleep
+ *    Returns: None
+ *
+*/
+static void pause_ms(long ms)
+{
+    struct timespec time = { ms / 1000, (ms % 1000) * 1000000 };
+    nanosleep(&time, NULL);
+}
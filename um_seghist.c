@@ -0,0 +1,372 @@
+/*
+ * um_seghist.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Implementation of the um_seghist.h interface. Bucket 0 of each histogram
+ * counts zeros and bucket k counts values from 2^(k-1) to 2^k - 1. When
+ * each id was last mapped and unmapped is kept in arrays indexed by id,
+ * grown like the segment table itself.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "um_seghist.h"
+
+#define T Seghist_T
+
+/* macros ================================================================== */
+#define NUM_BUCKETS 65
+#define ID_HINT 64
+
+/* struct definition ======================================================= */
+typedef uint64_t Histogram[NUM_BUCKETS];
+
+struct T {
+    FILE *text, *json;
+    uint64_t now;               /* instructions retired */
+    uint64_t maps, unmaps, reused;
+    uint64_t live, words;       /* mapped right now */
+    uint64_t peak_live, peak_words, peak_at;
+    uint32_t largest;
+    Histogram sizes, lifetimes, reuse_distances;
+    uint64_t *mapped_at;        /* per id, when it was last mapped */
+    uint64_t *unmapped_at;      /* per id, when it was last unmapped */
+    uint32_t num_ids;           /* length of both arrays */
+    uint32_t ids_seen;          /* one past the highest id mapped */
+};
+
+/* function declarations =================================================== */
+static void grow(T seghist, uint32_t id);
+static inline int bucket(uint64_t value);
+static void write_text(FILE *out, const char *title, const Histogram counts);
+static void write_json(FILE *out, const char *name, const Histogram counts);
+
+/* function definitions ==================================================== */
+
+/* seghist_new
+ *
+ *      Purpose: Create an empty census.
+ *
+ *   Parameters: Streams for the text and JSON reports, NULL to skip one.
+ *
+ *      Returns: New instance of Seghist_T.
+ *
+ * Expectations: None
+*/
+extern T seghist_new(FILE *text, FILE *json)
+{
+    T seghist = calloc(1, sizeof(*seghist));
+    assert(seghist != NULL);
+
+    seghist->text = text;
+    seghist->json = json;
+    seghist->mapped_at = calloc(ID_HINT, sizeof(uint64_t));
+    seghist->unmapped_at = calloc(ID_HINT, sizeof(uint64_t));
+    assert(seghist->mapped_at != NULL && seghist->unmapped_at != NULL);
+    seghist->num_ids = ID_HINT;
+
+    return seghist;
+}
+
+/* seghist_free
+ *
+ *      Purpose: Free the census. The report streams are left open.
+ *
+ *   Parameters: Pointer to an instance of Seghist_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: seghist and *seghist are not null.
+*/
+extern void seghist_free(T *seghist)
+{
+    assert(seghist != NULL && *seghist != NULL);
+
+    free((*seghist)->mapped_at);
+    free((*seghist)->unmapped_at);
+    free(*seghist);
+    *seghist = NULL;
+}
+
+/* seghist_clock
+ *
+ *      Purpose: Set the time the next map or unmap happens at.
+ *
+ *   Parameters: Instance of Seghist_T and instructions retired so far.
+ *
+ *      Returns: None
+ *
+ * Expectations: Time never goes backwards.
+*/
+extern void seghist_clock(T seghist, uint64_t now)
+{
+    seghist->now = now;
+}
+
+/* seghist_map
+ *
+ *      Purpose: Count a new segment, its size and, for an id seen before,
+ *               how long the id sat unmapped.
+ *
+ *   Parameters: Instance of Seghist_T, the id, the length in words, and
+ *               whether the id came off the unmapped stack.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+extern void seghist_map(T seghist, uint32_t id, uint32_t size, int reused)
+{
+    if (id >= seghist->num_ids) {
+        grow(seghist, id);
+    }
+    if (id >= seghist->ids_seen) {
+        seghist->ids_seen = id + 1;
+    }
+
+    seghist->maps++;
+    seghist->sizes[bucket(size)]++;
+    if (size > seghist->largest) {
+        seghist->largest = size;
+    }
+
+    if (reused) {
+        seghist->reused++;
+        seghist->reuse_distances[bucket(seghist->now -
+                                        seghist->unmapped_at[id])]++;
+    }
+    seghist->mapped_at[id] = seghist->now;
+
+    seghist->live++;
+    seghist->words += size;
+    if (seghist->words > seghist->peak_words) {
+        seghist->peak_words = seghist->words;
+        seghist->peak_at = seghist->now;
+    }
+    if (seghist->live > seghist->peak_live) {
+        seghist->peak_live = seghist->live;
+    }
+}
+
+/* seghist_unmap
+ *
+ *      Purpose: Count a segment going away and how long it lived.
+ *
+ *   Parameters: Instance of Seghist_T, the id and the length in words.
+ *
+ *      Returns: None
+ *
+ * Expectations: The id was passed to seghist_map.
+*/
+extern void seghist_unmap(T seghist, uint32_t id, uint32_t size)
+{
+    assert(id < seghist->num_ids);
+
+    seghist->unmaps++;
+    seghist->lifetimes[bucket(seghist->now - seghist->mapped_at[id])]++;
+    seghist->unmapped_at[id] = seghist->now;
+
+    seghist->live--;
+    seghist->words -= size;
+}
+
+/* seghist_resize
+ *
+ *      Purpose: Follow segment 0 changing length when LOADP replaces it.
+ *
+ *   Parameters: Instance of Seghist_T and the change in words.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+extern void seghist_resize(T seghist, int64_t words)
+{
+    seghist->words = (uint64_t)((int64_t)seghist->words + words);
+    if (seghist->words > seghist->peak_words) {
+        seghist->peak_words = seghist->words;
+        seghist->peak_at = seghist->now;
+    }
+}
+
+/* seghist_report
+ *
+ *      Purpose: Write the totals, high-water marks and histograms to
+ *               whichever report streams were given.
+ *
+ *   Parameters: Instance of Seghist_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+extern void seghist_report(T seghist)
+{
+    FILE *out = seghist->text;
+
+    if (out != NULL) {
+        fprintf(out, "um segments: %llu maps, %llu unmaps, %llu live at "
+                "halt\n", (unsigned long long)seghist->maps,
+                (unsigned long long)seghist->unmaps,
+                (unsigned long long)seghist->live);
+        fprintf(out, "peak: %llu live segments, %llu live bytes "
+                "(at instruction %llu), largest segment %u words\n",
+                (unsigned long long)seghist->peak_live,
+                (unsigned long long)seghist->peak_words * 4,
+                (unsigned long long)seghist->peak_at, seghist->largest);
+        fprintf(out, "ids: %u handed out, %llu maps reused an unmapped id\n",
+                seghist->ids_seen, (unsigned long long)seghist->reused);
+
+        write_text(out, "size (words)", seghist->sizes);
+        write_text(out, "lifetime (instructions)", seghist->lifetimes);
+        write_text(out, "id reuse distance (instructions)",
+                   seghist->reuse_distances);
+        fflush(out);
+    }
+
+    out = seghist->json;
+    if (out != NULL) {
+        fprintf(out, "{\"maps\": %llu, \"unmaps\": %llu, "
+                "\"live_at_halt\": %llu, \"peak_live_segments\": %llu, "
+                "\"peak_live_bytes\": %llu, \"peak_at_instruction\": %llu, "
+                "\"largest_segment_words\": %u, \"ids\": %u, "
+                "\"reused_ids\": %llu",
+                (unsigned long long)seghist->maps,
+                (unsigned long long)seghist->unmaps,
+                (unsigned long long)seghist->live,
+                (unsigned long long)seghist->peak_live,
+                (unsigned long long)seghist->peak_words * 4,
+                (unsigned long long)seghist->peak_at, seghist->largest,
+                seghist->ids_seen, (unsigned long long)seghist->reused);
+        write_json(out, "size_words", seghist->sizes);
+        write_json(out, "lifetime_instructions", seghist->lifetimes);
+        write_json(out, "reuse_distance_instructions",
+                   seghist->reuse_distances);
+        fprintf(out, "}\n");
+        fflush(out);
+    }
+}
+
+/* static function definitions============================================== */
+
+/* grow
+ *
+ *      Purpose: Make the per-id arrays long enough to hold id.
+ *
+ *   Parameters: Instance of Seghist_T and the id to make room for.
+ *
+ *      Returns: None
+ *
+ * Expectations: id is past the end of the arrays.
+*/
+static void grow(T seghist, uint32_t id)
+{
+    uint64_t length = seghist->num_ids;
+    while (length <= id) {
+        length *= 2;
+    }
+
+    seghist->mapped_at = realloc(seghist->mapped_at,
+                                 length * sizeof(uint64_t));
+    seghist->unmapped_at = realloc(seghist->unmapped_at,
+                                   length * sizeof(uint64_t));
+    assert(seghist->mapped_at != NULL && seghist->unmapped_at != NULL);
+
+    size_t added = (length - seghist->num_ids) * sizeof(uint64_t);
+    memset(seghist->mapped_at + seghist->num_ids, 0, added);
+    memset(seghist->unmapped_at + seghist->num_ids, 0, added);
+    seghist->num_ids = (uint32_t)length;
+}
+
+/* bucket
+ *
+ *      Purpose: Find the log2 bucket of a value.
+ *
+ *   Parameters: The value.
+ *
+ *      Returns: 0 for 0, otherwise one more than the index of its top bit.
+ *
+ * Expectations: None
+*/
+static inline int bucket(uint64_t value)
+{
+    return (value == 0) ? 0 : 64 - __builtin_clzll(value);
+}
+
+/* write_text
+ *
+ *      Purpose: Write the nonempty buckets of a histogram as a table.
+ *
+ *   Parameters: Stream, heading, and the histogram.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void write_text(FILE *out, const char *title, const Histogram counts)
+{
+    uint64_t total = 0;
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        total += counts[i];
+    }
+
+    fprintf(out, "\n%-40s %16s %7s\n", title, "count", "share");
+    if (total == 0) {
+        fprintf(out, "  (none)\n");
+        return;
+    }
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        if (counts[i] == 0) {
+            continue;
+        }
+
+        unsigned long long low = (i == 0) ? 0 : 1ull << (i - 1);
+        unsigned long long high = (i == 0) ? 0 : (low << 1) - 1;
+        char range[48];
+        if (low == high) {
+            snprintf(range, sizeof(range), "%llu", low);
+        } else {
+            snprintf(range, sizeof(range), "%llu-%llu", low, high);
+        }
+
+        fprintf(out, "  %-38s %16llu %6.2f%%\n", range,
+                (unsigned long long)counts[i],
+                100.0 * (double)counts[i] / (double)total);
+    }
+}
+
+/* write_json
+ *
+ *      Purpose: Write a histogram as a JSON member holding a list of
+ *               nonempty buckets.
+ *
+ *   Parameters: Stream, member name, and the histogram.
+ *
+ *      Returns: None
+ *
+ * Expectations: Written inside an object that already has members.
+*/
+static void write_json(FILE *out, const char *name, const Histogram counts)
+{
+    const char *separator = "";
+
+    fprintf(out, ", \"%s\": [", name);
+    for (int i = 0; i < NUM_BUCKETS; i++) {
+        if (counts[i] == 0) {
+            continue;
+        }
+
+        unsigned long long low = (i == 0) ? 0 : 1ull << (i - 1);
+        unsigned long long high = (i == 0) ? 0 : (low << 1) - 1;
+        fprintf(out, "%s{\"min\": %llu, \"max\": %llu, \"count\": %llu}",
+                separator, low, high, (unsigned long long)counts[i]);
+        separator = ", ";
+    }
+    fprintf(out, "]");
+}
+
+#undef T
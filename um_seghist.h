@@ -0,0 +1,49 @@
+/*
+ * um_seghist.h
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Provides an interface for segment census data. Once a Seghist_T is handed
+ * to segment_observe() (um_segments.h), every segment_map() and
+ * segment_unmap() feeds it, and it keeps log2-bucketed histograms of
+ * segment sizes, of lifetimes (instructions from MAP to UNMAP) and of how
+ * long an id sat unmapped before being handed out again, along with the
+ * most segments and bytes ever live at once. The instrumented engine keeps
+ * its clock exact and writes the report, as text, JSON or both, at HALT.
+*/
+
+#ifndef UM_SEGHIST_
+#define UM_SEGHIST_
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define T Seghist_T
+typedef struct T *T; /* pointer to the census of one run */
+
+/*
+ * Takes in where to write the text report and the JSON report, either of
+ *      which may be NULL, and returns an empty census
+ */
+extern T seghist_new(FILE *text, FILE *json);
+
+/* Takes in a pointer to a census and frees it, leaving the streams open */
+extern void seghist_free(T *seghist);
+
+/* Takes in a census and the number of instructions retired so far */
+extern void seghist_clock(T seghist, uint64_t now);
+
+/* Takes in a census, the id of a segment just mapped and its length */
+extern void seghist_map(T seghist, uint32_t id, uint32_t size, int reused);
+
+/* Takes in a census, the id of a segment about to be unmapped and its length */
+extern void seghist_unmap(T seghist, uint32_t id, uint32_t size);
+
+/* Takes in a census and how many words segment 0 grew (or shrank) by */
+extern void seghist_resize(T seghist, int64_t words);
+
+/* Takes in a census and writes its reports */
+extern void seghist_report(T seghist);
+
+#undef T
+#endif
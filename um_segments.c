@@ -4,12 +4,32 @@
  * um
  *
  * The implementation for the "main memory" used in the UM emulator. Uses a
- * sequence of arrays where the sequence in the main memory and the arrays
- * are segments of memory that can be used.
+ * table of segments where each segment is a single allocation: two header
+ * words holding a share count and the length, followed by the words
+ * themselves. The table points straight at the words, so a load or store is
+ * one dependent load.
+ *
+ * Loading a program shares the source segment's storage with segment 0
+ * rather than copying it. Whichever side is stored into first gets its own
+ * copy at that point, so a program that is loaded and never modified costs
+ * nothing to load.
+ *
+ * Segments of up to 1024 words are carved from per-memory free lists, one
+ * per power-of-two capacity, so programs that map and unmap the same few
+ * sizes over and over recycle storage instead of going back to malloc.
+ *
+ * An engine can leave state with the memory, such as the JIT's
+ * translations, which lives as long as the machine does and is told when
+ * a load program replaces segment 0 or a store changes one of its words.
+ *
+ * Loads, stores and unmaps check the id against the table and the offset
+ * against the LENGTH header already next to the words, and report a bad
+ * one to the engine rather than touch memory that isn't the segment's.
 */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <assert.h>
 //#include <seq.h> /* Hanson's sequence library */
 //#include <uarray.h>
@@ -20,22 +40,38 @@
 /* macros ================================================================== */
 //#define SEQ_SEGMENT 1000
 //#define SEQ_UNMAPPED 500
+#define SEGMENT_HINT 64 /* starting size of the segment table */
+#define LENGTH(words) ((words)[-1]) /* header word before every segment */
+#define REFS(words) ((words)[-2])   /* ids sharing the storage, via LOADP */
+#define HEADER 2                    /* header words before every segment */
+#define NUM_CLASSES 11                /* pooled capacities of 1 to 1024 words */
+#define POOL_LIMIT (64 * 1024 * 1024) /* most bytes kept on free lists */
 
 /* struct definition ======================================================= */
 struct T {
-    struct array **segments;
-    uint32_t *unmapped_segments; /* sequence holding unmapped ids */
-    int num_mapped;
-    int num_unmapped;
+    uint32_t **segments; /* words of each segment, NULL if unmapped */
+    struct Instruction_T *program; /* segment 0, decoded word for word */
+    uint32_t *unmapped_segments; /* stack of ids free for reuse */
+    int num_mapped;   /* live segments */
+    int num_unmapped; /* ids on the unmapped stack */
+    int length;       /* ids handed out so far, all below this */
+    int capacity;     /* slots in segments and unmapped_segments */
+    uint64_t words_mapped; /* total length of the live segments */
+    void *pools[NUM_CLASSES]; /* free blocks of each size class, linked */
+    Pool_stats pool_stats;
+    Seghist_T seghist;  /* told about map, unmap and load program, or NULL */
+    const Segment_engine *engine; /* told about changes to 0, or NULL */
+    void *engine_state;
 };
 
-struct array {
-    uint32_t *words;
-    int length; 
-};
-
-struct array *copy(struct array *segment);
-void free_words(struct array *segment);
+uint32_t *copy(T memory, uint32_t *segment);
+static uint32_t *new_words(T memory, int size);
+static void free_words(T memory, uint32_t *words);
+static void release(T memory, uint32_t *words);
+static uint32_t *unshare(T memory, int id);
+static inline int size_class(uint32_t size);
+static inline size_t class_bytes(int class);
+static void grow(T memory);
 
 /* function definitions =====================================================*/
 
@@ -56,16 +92,29 @@ extern T segment_new()
     T memory = malloc(sizeof(struct T));
     //assert(memory != NULL);
 
-    /* create sequence of segments and check memory correctly allocated */
-    memory->segments = calloc(100000000, sizeof(struct array));
-    //assert(memory->segments != NULL);
+    /* create table of segments, grown by segment_map as ids run out */
+    memory->capacity = SEGMENT_HINT;
+    memory->segments = calloc(memory->capacity, sizeof(uint32_t *));
+    assert(memory->segments != NULL);
+
+    /* create stack of unmapped ids, never deeper than the table is long */
+    memory->unmapped_segments = malloc(memory->capacity * sizeof(uint32_t));
+    assert(memory->unmapped_segments != NULL);
 
-    /* create sequence of unmapped segments */
-    memory->unmapped_segments = calloc(100000000, sizeof(uint32_t));
-    //assert(memory->unmapped_segments != NULL);
-    
+    memory->program = NULL;
     memory->num_mapped = 0;
     memory->num_unmapped = 0;
+    memory->length = 0;
+    memory->words_mapped = 0;
+
+    /* every free list starts out empty */
+    for (int i = 0; i < NUM_CLASSES; i++) {
+        memory->pools[i] = NULL;
+    }
+    memory->pool_stats = (Pool_stats){ 0, 0, 0 };
+    memory->seghist = NULL;
+    memory->engine = NULL;
+    memory->engine_state = NULL;
 
     return memory; /* return created memory */
 }
@@ -83,22 +132,27 @@ extern T segment_new()
 extern void segment_free(T memory)
 {
     //assert(memory != NULL);
-    struct array *segment_array;
     //fprintf(stderr, "num mapped to free: %d\n", memory->num_mapped);
+    segment_attach(memory, NULL, NULL);
 
-    /* frees all individual segment arrays */
-    for (int i = 0; i < memory->num_mapped; i++) {
-        segment_array = memory->segments[i];
-        
-        if (segment_array != NULL) {
-            //fprintf(stderr, "not NULL\n");
-            
-            free(segment_array->words);
-            free(segment_array);
+    /* frees all individual segments, skipping unmapped ids */
+    for (int i = 0; i < memory->length; i++) {
+        if (memory->segments[i] != NULL) {
+            release(memory, memory->segments[i]);
+        }
+    }
+
+    /* frees every block still waiting on a free list */
+    for (int i = 0; i < NUM_CLASSES; i++) {
+        while (memory->pools[i] != NULL) {
+            void *block = memory->pools[i];
+            memory->pools[i] = *(void **)block;
+            free(block);
         }
     }
 
     /* frees sequences and structs themselves */
+    free(memory->program);
     free(memory->segments);
     free(memory->unmapped_segments);
     free(memory);
@@ -108,25 +162,28 @@ extern void segment_free(T memory)
  *      Purpose: Gets a word from a segment in main memory.
  *
  *   Parameters: The main memory, the index of the segment that holds the
- *               value, and the index of that segment.
+ *               value, the index of that segment, and where to put the word.
  *
- *      Returns: The word at the given location.
+ *      Returns: False if the id isn't mapped or the offset is past the end
+ *               of its segment, leaving *word alone.
  *
  * Expectations: Main memory is not null.
 */
-extern uint32_t segment_load(T memory, int id, int offset)
+extern bool segment_load(T memory, uint32_t id, uint32_t offset,
+                         uint32_t *word)
 {
     //assert(memory != NULL);
-    //assert(id >= 0 && id < memory->num_mapped);
 
-    /* gets desired segment array based on input */
-    struct array *segment_array = memory->segments[id];
-    //assert(offset >= 0 && offset < segment_array->length);
+    /* unmapped ids have a NULL entry, and ids never handed out no entry */
+    if (id >= (uint32_t)memory->length || memory->segments[id] == NULL ||
+        offset >= LENGTH(memory->segments[id])) {
+        return false;
+    }
 
-    /* gets desired value in segment array */
-    uint32_t load_value = segment_array->words[offset];
+    /* gets desired value straight out of the segment */
+    *word = memory->segments[id][offset];
 
-    return load_value;
+    return true;
 }
 
 /* segment_store
@@ -136,24 +193,137 @@ extern uint32_t segment_load(T memory, int id, int offset)
  *   Parameters: The main memory, the index of segment in main memory, the
  *               index for the word to be placed, and the word to be placed.
  *
- *      Returns: None
+ *      Returns: False if the id isn't mapped or the offset is past the end
+ *               of its segment, storing nothing.
  *
- * Expectations: Main memory is not null and the index of segment and index
- *               of location in that segment are valid.
+ * Expectations: Main memory is not null.
 */
-extern void segment_store(T memory, int id, int offset, uint32_t word)
+extern bool segment_store(T memory, uint32_t id, uint32_t offset,
+                          uint32_t word)
 {
     /* checks memory isn't empty and id is in bounds */
     //assert(memory != NULL);
     //fprintf(stderr, "num mapped: %u\n", memory->num_mapped);
     //fprintf(stderr, "id: %u\n",id);
-    //assert(id >= 0 && id < memory->num_mapped);
+    if (id >= (uint32_t)memory->length || memory->segments[id] == NULL) {
+        return false;
+    }
+
+    uint32_t *words = memory->segments[id];
+    if (offset >= LENGTH(words)) {
+        return false;
+    }
+
+    /* gives a segment shared by a load program its own copy first */
+    if (REFS(words) > 1) {
+        words = unshare(memory, id);
+    }
+
+    /* stores word at proper address in segment */
+    words[offset] = word;
+
+    /* keeps the decoded copy, and any translation, of the running program
+       in step */
+    if (id == 0) {
+        memory->program[offset] = decode_word(word);
+        if (memory->engine != NULL) {
+            memory->engine->stored(memory->engine_state, offset);
+        }
+    }
+
+    return true;
+}
+
+/* segment_mapped
+ *
+ *      Purpose: Tell whether an id names a segment, for the engines to check
+ *               a LOADP before they count it.
+ *
+ *   Parameters: The main memory and the index of the segment.
+ *
+ *      Returns: True if the segment is mapped.
+ *
+ * Expectations: Main memory is not null.
+*/
+extern bool segment_mapped(T memory, uint32_t id)
+{
+    return id < (uint32_t)memory->length && memory->segments[id] != NULL;
+}
+
+/* segment_length
+ *
+ *      Purpose: Gets the number of words in a segment.
+ *
+ *   Parameters: The main memory and the index of the segment.
+ *
+ *      Returns: The length of the segment.
+ *
+ * Expectations: Main memory is not null and the segment is mapped.
+*/
+extern int segment_length(T memory, int id)
+{
+    return LENGTH(memory->segments[id]);
+}
+
+/* segment_words
+ *
+ *      Purpose: Gives direct access to the words of a segment so engines
+ *               can fetch instructions without a call per word.
+ *
+ *   Parameters: The main memory and the index of the segment.
+ *
+ *      Returns: Pointer to the first word of the segment.
+ *
+ * Expectations: Main memory is not null and the segment is mapped. The
+ *               pointer goes stale once the segment is unmapped or, for
+ *               segment 0, replaced by segment_load_program. Writing through
+ *               it skips copy on write, so only write to a segment no load
+ *               program can have shared yet.
+*/
+extern uint32_t *segment_words(T memory, int id)
+{
+    return memory->segments[id];
+}
+
+/* segment_program
+ *
+ *      Purpose: Gives the engines segment 0 in decoded form.
+ *
+ *   Parameters: The main memory.
+ *
+ *      Returns: Array holding one decoded instruction per word of segment 0.
+ *               Entries whose opcode is NOT_DECODED have to be filled in by
+ *               segment_decode before use.
+ *
+ * Expectations: Main memory is not null and segment 0 is mapped. The array
+ *               goes stale after segment_load_program.
+*/
+extern Instruction_T segment_program(T memory)
+{
+    return memory->program;
+}
 
-    struct array *segment_array = memory->segments[id];
-    //assert(offset >= 0 && offset < segment_array->length);
+/* segment_decode
+ *
+ *      Purpose: Decodes one word of segment 0 into the decoded array.
+ *
+ *   Parameters: The main memory and the offset of the word.
+ *
+ *      Returns: The decoded entry for that word, or NULL if offset is the
+ *               length of segment 0, whose entry is never decoded.
+ *
+ * Expectations: Main memory is not null and offset is at most the length
+ *               of segment 0. Running off the end of segment 0 always
+ *               lands here, so engines need no check of their own for it.
+*/
+extern Instruction_T segment_decode(T memory, int offset)
+{
+    if ((uint32_t)offset >= LENGTH(memory->segments[0])) {
+        return NULL;
+    }
 
-    /* stores word at proper address in segment array */
-    segment_array->words[offset] = word;
+    memory->program[offset] = decode_word(memory->segments[0][offset]);
+    return &memory->program[offset];
 }
 
 /* segment_load_program
@@ -166,37 +336,330 @@ extern void segment_store(T memory, int id, int offset, uint32_t word)
  *
  *      Returns: None
  *
- * Expectations: Main memory is not null and the index of segment and index
- *               of location in that segment are valid.
+ * Expectations: Main memory is not null and the segment is mapped, which
+ *               the engines check with segment_mapped.
 */
 extern void segment_load_program(T memory, int id)
 {
     //assert(memory != NULL);
-    //assert(id >= 0 && id < memory->num_mapped);
+    assert(segment_mapped(memory, id));
+
+    uint32_t *program_words = memory->segments[id];
+
+    /* already running this very storage, so nothing changes */
+    if (program_words == memory->segments[0]) {
+        return;
+    }
+
+    if (memory->seghist != NULL) {
+        seghist_resize(memory->seghist, (int64_t)LENGTH(program_words) -
+                                        (int64_t)LENGTH(memory->segments[0]));
+    }
+
+    /* shares the segment with segment 0 and lets go of the old program */
+    memory->words_mapped += LENGTH(program_words);
+    memory->words_mapped -= LENGTH(memory->segments[0]);
+    REFS(program_words)++;
+    release(memory, memory->segments[0]);
+    memory->segments[0] = program_words;
+
+    /* starts the new program out undecoded; calloc makes that O(1) for
+       large programs, whose zeroed pages only appear once touched. The
+       entry past the end stays undecoded, for segment_decode to catch */
+    free(memory->program);
+    memory->program = calloc(LENGTH(program_words) + 1,
+                             sizeof(struct Instruction_T));
+    assert(memory->program != NULL);
+
+    if (memory->engine != NULL) {
+        memory->engine->loaded(memory->engine_state);
+    }
+}
+
+/* copy
+ *
+ *      Purpose: Duplicate a segment, header included.
+ *
+ *   Parameters: The main memory and the words of the segment to copy.
+ *
+ *      Returns: The words of the new segment.
+ *
+ * Expectations: Segment is not null.
+*/
+uint32_t *copy(T memory, uint32_t *segment)
+{
+    int size = LENGTH(segment);
+    uint32_t *words = new_words(memory, size);
+
+    memcpy(words, segment, size * sizeof(uint32_t));
+    return words;
+}
+
+/* new_words
+ *
+ *      Purpose: Allocate a zeroed, unshared segment and its header in one
+ *               go, reusing a block from the matching free list when there
+ *               is one.
+ *
+ *   Parameters: The main memory and the number of words in the segment.
+ *
+ *      Returns: Pointer to the first word, just past the header.
+ *
+ * Expectations: Memory is allocated successfully.
+ *
+ *         Note: Only the words handed out are zeroed; the rest of a pooled
+ *               block's capacity is never read.
+*/
+static uint32_t *new_words(T memory, int size)
+{
+    int class = size_class(size);
+    uint32_t *block;
+
+    if (class < NUM_CLASSES && memory->pools[class] != NULL) {
+        /* pops a recycled block off its free list */
+        block = memory->pools[class];
+        memory->pools[class] = *(void **)block;
+        memory->pool_stats.hits++;
+        memory->pool_stats.bytes -= class_bytes(class);
+    } else {
+        /* sizes the block for its class so it can be pooled later */
+        block = malloc(class < NUM_CLASSES ? class_bytes(class)
+                                           : (size + HEADER) *
+                                             sizeof(uint32_t));
+        memory->pool_stats.misses++;
+    }
+    assert(block != NULL);
+
+    block[0] = 1;
+    block[1] = size;
+    memset(block + HEADER, 0, size * sizeof(uint32_t));
+    return block + HEADER;
+}
+
+/* free_words
+ *
+ *      Purpose: Give a segment allocated by new_words back, either to its
+ *               free list or, for large segments or full pools, to free().
+ *
+ *   Parameters: The main memory and the words of the segment.
+ *
+ *      Returns: None
+ *
+ * Expectations: Segment is not null.
+*/
+static void free_words(T memory, uint32_t *words)
+{
+    int class = size_class(LENGTH(words));
+    void *block = words - HEADER;
+
+    if (class < NUM_CLASSES &&
+        memory->pool_stats.bytes + class_bytes(class) <= POOL_LIMIT) {
+        *(void **)block = memory->pools[class];
+        memory->pools[class] = block;
+        memory->pool_stats.bytes += class_bytes(class);
+    } else {
+        free(block);
+    }
+}
+
+/* release
+ *
+ *      Purpose: Drop one id's claim on a segment's storage, freeing it once
+ *               no id is left using it.
+ *
+ *   Parameters: The main memory and the words of the segment.
+ *
+ *      Returns: None
+ *
+ * Expectations: Segment is not null.
+*/
+static void release(T memory, uint32_t *words)
+{
+    REFS(words)--;
+
+    if (REFS(words) == 0) {
+        free_words(memory, words);
+    }
+}
+
+/* unshare
+ *
+ *      Purpose: Give a segment whose storage is shared its own copy, ahead
+ *               of a store into it.
+ *
+ *   Parameters: The main memory and the index of the segment.
+ *
+ *      Returns: The words of the segment's own copy.
+ *
+ * Expectations: Main memory is not null and the segment is shared. The
+ *               decoded copy of segment 0 stays valid since the words are
+ *               the same.
+*/
+static uint32_t *unshare(T memory, int id)
+{
+    uint32_t *words = copy(memory, memory->segments[id]);
+
+    release(memory, memory->segments[id]);
+    memory->segments[id] = words;
+
+    return words;
+}
+
+/* size_class
+ *
+ *      Purpose: Find the free list for a segment size.
+ *
+ *   Parameters: The number of words in the segment.
+ *
+ *      Returns: Smallest class whose capacity, 2 to the class, holds the
+ *               segment. NUM_CLASSES or above means it is not pooled.
+ *
+ * Expectations: None
+*/
+static inline int size_class(uint32_t size)
+{
+    return size <= 1 ? 0 : 32 - __builtin_clz(size - 1);
+}
+
+/* class_bytes
+ *
+ *      Purpose: Get the size of the blocks on a free list.
+ *
+ *   Parameters: The size class.
+ *
+ *      Returns: Bytes for the header plus the class capacity.
+ *
+ * Expectations: Class is below NUM_CLASSES.
+*/
+static inline size_t class_bytes(int class)
+{
+    return (((size_t)1 << class) + HEADER) * sizeof(uint32_t);
+}
+
+/* segment_pool_stats
+ *
+ *      Purpose: Report how well the free lists are doing.
+ *
+ *   Parameters: The main memory.
+ *
+ *      Returns: Hits, misses and bytes currently held on free lists.
+ *
+ * Expectations: Main memory is not null.
+*/
+extern Pool_stats segment_pool_stats(T memory)
+{
+    return memory->pool_stats;
+}
+
+/* segment_usage
+ *
+ *      Purpose: Report how much the program has mapped.
+ *
+ *   Parameters: The main memory.
+ *
+ *      Returns: Number of live segments and the words across them.
+ *
+ * Expectations: Main memory is not null.
+*/
+extern Segment_usage segment_usage(T memory)
+{
+    return (Segment_usage){ (uint64_t)memory->num_mapped,
+                            memory->words_mapped };
+}
+
+/* segment_observe
+ *
+ *      Purpose: Start or stop feeding a census from map, unmap and load
+ *               program.
+ *
+ *   Parameters: The main memory and the census, or NULL.
+ *
+ *      Returns: None
+ *
+ * Expectations: Main memory is not null. Segments mapped before this call
+ *               count as mapped at the census's current time.
+*/
+extern void segment_observe(T memory, Seghist_T seghist)
+{
+    memory->seghist = seghist;
+    if (seghist == NULL) {
+        return;
+    }
 
-    /* gets desired segment array and finds length */
-    struct array *segment_array = memory->segments[id];
+    for (int i = 0; i < memory->length; i++) {
+        if (memory->segments[i] != NULL) {
+            seghist_map(seghist, i, LENGTH(memory->segments[i]), 0);
+        }
+    }
+}
+
+/* segment_attach
+ *
+ *      Purpose: Keep an engine's state with the memory between calls.
+ *
+ *   Parameters: The main memory, the engine or NULL, and its state.
+ *
+ *      Returns: None
+ *
+ * Expectations: Main memory is not null. The engine, if any, outlives the
+ *               memory; a static const struct is what it is meant for.
+*/
+extern void segment_attach(T memory, const Segment_engine *engine,
+                           void *state)
+{
+    if (memory->engine != NULL) {
+        memory->engine->release(memory->engine_state);
+    }
 
-    /* creates copy of segment array and frees old array */
-    struct array *program_array = copy(segment_array);
-    struct array *old_program_array = memory->segments[0];
-    free(old_program_array->words);
-    free(old_program_array);
+    memory->engine = engine;
+    memory->engine_state = (engine != NULL) ? state : NULL;
+}
 
-    /* puts contents into segment 0 */
-    memory->segments[0] = program_array;
+/* segment_engine_state
+ *
+ *      Purpose: Find the state an engine left with the memory.
+ *
+ *   Parameters: The main memory and the engine.
+ *
+ *      Returns: Its state, or NULL if it isn't the engine attached.
+ *
+ * Expectations: Main memory is not null.
+*/
+extern void *segment_engine_state(T memory, const Segment_engine *engine)
+{
+    return (memory->engine == engine) ? memory->engine_state : NULL;
 }
 
-struct array *copy(struct array *segment)
+/* segment_digest
+ *
+ *      Purpose: Sum up everything the program has mapped in one number.
+ *
+ *   Parameters: The main memory.
+ *
+ *      Returns: 64-bit FNV-1a hash over the id, length and words of each
+ *               mapped segment, in id order.
+ *
+ * Expectations: Main memory is not null. Takes time in proportion to the
+ *               words mapped.
+*/
+extern uint64_t segment_digest(T memory)
 {
-    int size = segment->length;
-    struct array *new_arr = malloc(sizeof(struct array));
-    new_arr->words = calloc(size, sizeof(uint32_t));
-    for (int i = 0; i < size; i++) {
-        new_arr->words[i] = segment->words[i];
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (int i = 0; i < memory->length; i++) {
+        uint32_t *words = memory->segments[i];
+        if (words == NULL) {
+            continue;
+        }
+
+        hash = (hash ^ (uint32_t)i) * 0x100000001b3ull;
+        hash = (hash ^ LENGTH(words)) * 0x100000001b3ull;
+        for (uint32_t j = 0; j < LENGTH(words); j++) {
+            hash = (hash ^ words[j]) * 0x100000001b3ull;
+        }
     }
-    new_arr->length = size;
-    return new_arr;
+
+    return hash;
 }
 
 /* segment_unmap
@@ -205,26 +668,34 @@ struct array *copy(struct array *segment)
  *
  *   Parameters: The main memory and the index of segment to unmap.
  *
- *      Returns: None
+ *      Returns: False if the id is 0 or isn't mapped, unmapping nothing.
  *
- * Expectations: Main memory is not null and the index of segment is valid.
+ * Expectations: Main memory is not null.
  *
  *         Note: Adds the index of the segment that was unmapped to the
  *               unmapped sequence to keep track of available memory.
 */
-extern void segment_unmap(T memory, int id)
+extern bool segment_unmap(T memory, uint32_t id)
 {
     //assert(memory != NULL);
-    //assert(id >= 0 && id < memory->num_mapped);
+    if (id == 0 || !segment_mapped(memory, id)) {
+        return false;
+    }
 
-    struct array *segment_array = memory->segments[id];
-    free(segment_array->words);
-    free(segment_array);
+    if (memory->seghist != NULL) {
+        seghist_unmap(memory->seghist, id, LENGTH(memory->segments[id]));
+    }
+
+    memory->words_mapped -= LENGTH(memory->segments[id]);
+    release(memory, memory->segments[id]);
     memory->segments[id] = NULL;
 
-    /* adds id to unmapped segments sequence */
+    /* adds id to unmapped segments stack */
     memory->unmapped_segments[memory->num_unmapped] = id;
     memory->num_unmapped++;
+    memory->num_mapped--;
+
+    return true;
 }
 
 /* segment_map
@@ -245,30 +716,65 @@ extern uint32_t segment_map(T memory, int size)
     //assert(size > 0);
 
     int index = 0;
+    int reused = memory->num_unmapped > 0;
     //fprintf(stderr, "num mapped: %d num unmapped: %d\n", memory->num_mapped, memory->num_unmapped);
 
-    /* creates new segment array and checks memory was correctly allocated */
-    struct array *new_segment_array = malloc(sizeof(struct array));
-    new_segment_array->length = size;
-    //assert(new_segment_array != NULL);
-
-    /* initializes every element in new segment array to be 0 */
-    new_segment_array->words = calloc(size, sizeof(uint32_t));
+    /* creates new segment with every word initialized to 0 */
+    uint32_t *new_segment = new_words(memory, size);
 
-    /* gets length of unmapped segments sequence */
+    /* reuses the most recently unmapped id before handing out a new one */
     if (memory->num_unmapped == 0) {
-        /* adds new segment array to sequence of segments */
-        index = memory->num_mapped;
-        memory->segments[index] = new_segment_array;
+        if (memory->length == memory->capacity) {
+            grow(memory);
+        }
+
+        /* adds new segment to the end of the table */
+        index = memory->length;
+        memory->segments[index] = new_segment;
+        memory->length++;
     } else {
-        /* get index value and store in memory segments sequence */
-        uint32_t last = memory->num_unmapped - 1;
-        index = memory->unmapped_segments[last];
-        memory->segments[index] = new_segment_array;
-        memory->unmapped_segments[last] = 0;
+        /* pops an unmapped id and stores segment there */
         memory->num_unmapped--;
+        index = memory->unmapped_segments[memory->num_unmapped];
+        memory->segments[index] = new_segment;
     }
     memory->num_mapped++;
+    memory->words_mapped += (uint64_t)size;
+
+    if (memory->seghist != NULL) {
+        seghist_map(memory->seghist, index, size, reused);
+    }
+
+    /* a zeroed array is an undecoded one, so segment 0 decodes lazily;
+       one entry more, never decoded, marks the end */
+    if (index == 0) {
+        free(memory->program);
+        memory->program = calloc(size + 1, sizeof(struct Instruction_T));
+        assert(memory->program != NULL);
+    }
 
     return (uint32_t)index; /* returns index of newly mapped segment */
 }
+
+/* grow
+ *
+ *      Purpose: Double the segment table and the unmapped stack with it.
+ *
+ *   Parameters: The main memory.
+ *
+ *      Returns: None
+ *
+ * Expectations: Main memory is not null and every slot is in use.
+*/
+static void grow(T memory)
+{
+    int capacity = memory->capacity * 2;
+
+    memory->segments = realloc(memory->segments,
+                               capacity * sizeof(uint32_t *));
+    memory->unmapped_segments = realloc(memory->unmapped_segments,
+                                        capacity * sizeof(uint32_t));
+    assert(memory->segments != NULL && memory->unmapped_segments != NULL);
+
+    memory->capacity = capacity;
+}
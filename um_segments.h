@@ -12,10 +12,39 @@
 #define UM_SEGMENTS_
 
 #include <stdint.h>
+#include <stdbool.h>
+#include "um_decode.h"
+#include "um_seghist.h"
 
 #define T Memory_T
 typedef struct T *T; /* pointer to an incomplete struct */
 
+/*
+ * Counters kept by the free lists behind segment_map and segment_unmap.
+ *      halt() prints them when built with -DUM_POOL_STATS.
+ */
+typedef struct Pool_stats {
+    uint64_t hits;   /* segments handed out from a free list */
+    uint64_t misses; /* segments that needed a fresh malloc */
+    uint64_t bytes;  /* bytes currently held on free lists */
+} Pool_stats;
+
+/*
+ * What an engine that keeps state in memory between calls is told about it,
+ *      along with that state (see segment_attach).
+ */
+typedef struct Segment_engine {
+    void (*loaded)(void *state);    /* segment_load_program replaced 0 */
+    void (*stored)(void *state, uint32_t offset); /* a word of 0 changed */
+    void (*release)(void *state);   /* detached, or the memory freed */
+} Segment_engine;
+
+/* What the program has mapped right now, segment 0 included */
+typedef struct Segment_usage {
+    uint64_t live;   /* mapped segments */
+    uint64_t words;  /* words across them, shared storage counted per id */
+} Segment_usage;
+
 /* Outputs a newly created instance of main memory */
 extern T segment_new();
 
@@ -23,20 +52,51 @@ extern T segment_new();
 extern void segment_free(T memory);
 
 /*
- * Takes in inputted memory, an offset, and an id and returns a word at that
- *      spot in memory.
+ * Takes in inputted memory, an offset, an id, and where to put the word at
+ *      that spot in memory. Returns false, putting nothing, if the id isn't
+ *      mapped or the offset is past the end of its segment.
  */
-extern uint32_t segment_load(T memory, int id, int offset);
+extern bool segment_load(T memory, uint32_t id, uint32_t offset,
+                         uint32_t *word);
 
 /*
  * Takes in inputted memory, an offset, an id, and a word to store in that spot
- *      in main memory.
+ *      in main memory. Returns false, storing nothing, if the id isn't mapped
+ *      or the offset is past the end of its segment.
+ */
+extern bool segment_store(T memory, uint32_t id, uint32_t offset,
+                          uint32_t word);
+
+/* Takes in inputted memory and an id and returns whether it is mapped */
+extern bool segment_mapped(T memory, uint32_t id);
+
+/* Takes in inputted memory and an id and returns the length of that segment */
+extern int segment_length(T memory, int id);
+
+/*
+ * Takes in inputted memory and an id and returns a pointer to the words of
+ *      that segment, valid until the segment is unmapped or replaced.
+ */
+extern uint32_t *segment_words(T memory, int id);
+
+/*
+ * Takes in inputted memory and returns segment 0 in decoded form, valid until
+ *      the next segment_load_program. Stores into segment 0 keep it current;
+ *      entries still NOT_DECODED are filled in by segment_decode.
+ */
+extern Instruction_T segment_program(T memory);
+
+/*
+ * Takes in inputted memory and an offset into segment 0, decodes that word
+ *      and returns its entry in the decoded segment 0. Returns NULL for the
+ *      offset just past the end, whose entry is always left NOT_DECODED.
  */
-extern void segment_store(T memory, int id, int offset, uint32_t word);
+extern Instruction_T segment_decode(T memory, int offset);
 
 /*
  * Takes in inputted memory and an index to load a new program into the
- *      specified segment index.
+ *      specified segment index, which has to be mapped. The two segments
+ *      share storage until one of them is stored into.
  */
 extern void segment_load_program(T memory, int id);
 
@@ -48,9 +108,45 @@ extern uint32_t segment_map(T memory, int size);
 
 /*
  * Takes in inputted memory and an id and unmaps and frees a segment in main
- *      memory.
+ *      memory. Returns false, unmapping nothing, if the id is 0 or isn't
+ *      mapped.
+ */
+extern bool segment_unmap(T memory, uint32_t id);
+
+/* Takes in inputted memory and returns the counters of its free lists */
+extern Pool_stats segment_pool_stats(T memory);
+
+/* Takes in inputted memory and returns how much of it is mapped */
+extern Segment_usage segment_usage(T memory);
+
+/*
+ * Takes in inputted memory and a census to tell about every map, unmap and
+ *      load program from now on, or NULL to stop. The segments already mapped
+ *      are passed to it first.
+ */
+extern void segment_observe(T memory, Seghist_T seghist);
+
+/*
+ * Takes in inputted memory, an engine and its state, and keeps the state
+ *      with the memory, telling the engine whenever segment 0 is replaced
+ *      or stored into, and releasing the state along with the memory.
+ *      Whatever engine was attached before is released first; a NULL engine
+ *      just does that.
+ */
+extern void segment_attach(T memory, const Segment_engine *engine,
+                           void *state);
+
+/*
+ * Takes in inputted memory and an engine and returns the state it attached,
+ *      or NULL if another engine, or none, is attached.
+ */
+extern void *segment_engine_state(T memory, const Segment_engine *engine);
+
+/*
+ * Takes in inputted memory and returns a hash of the id, length and words of
+ *      every mapped segment, so two machines can be compared cheaply.
  */
-extern void segment_unmap(T memory, int id);
+extern uint64_t segment_digest(T memory);
 
 #undef T
 #endif
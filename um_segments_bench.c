@@ -0,0 +1,341 @@
+/*
+ * um_segments_bench.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Microbenchmarks for the um_segments.h interface, run through a "main()"
+ * and linked against um_segments.c alone, so changes to the segment table
+ * and its free lists can be timed without an engine in the way. Each
+ * pattern reports nanoseconds per operation and how many of its segments
+ * needed a fresh malloc rather than a block off a free list, per operation.
+ *
+ * Usage: um_segments_bench [operations]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "um_segments.h"
+
+/* macros ================================================================== */
+#define DEFAULT_OPS 10000000
+#define LIVE 1024             /* segments kept mapped by the churn patterns */
+#define LARGE (1024 * 1024)   /* words in a segment too big for the pools */
+
+/* every load feeds this, so none can be optimized away */
+static volatile uint32_t sink;
+
+/* function declarations =================================================== */
+static void bench_lifo(uint64_t ops);
+static void bench_fifo(uint64_t ops);
+static void bench_mixed(uint64_t ops);
+static void bench_large(uint64_t ops);
+static void bench_access(uint64_t ops);
+static void bench_load_program(uint64_t ops);
+static void report(const char *name, uint64_t ops, double seconds,
+                   Memory_T memory, Pool_stats before);
+static double now(void);
+static uint32_t next_random(uint32_t *state);
+
+/* function definitions ==================================================== */
+int main(int argc, char *argv[])
+{
+    uint64_t ops = (argc > 1) ? strtoull(argv[1], NULL, 0) : DEFAULT_OPS;
+
+    printf("%-28s %12s %10s %12s\n", "pattern", "operations", "ns/op",
+           "mallocs/op");
+    bench_lifo(ops);
+    bench_fifo(ops);
+    bench_mixed(ops);
+    bench_large(ops / 1000 + 1);
+    bench_access(ops);
+    bench_load_program(ops);
+
+    return 0;
+}
+
+/* bench_lifo
+ *
+ *      Purpose: Time mapping a segment and unmapping it straight away, with
+ *               LIVE others mapped, the way a program uses a scratch buffer.
+ *               The id and the block both come back off a stack.
+ *
+ *   Parameters: How many map and unmap pairs to time.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void bench_lifo(uint64_t ops)
+{
+    Memory_T memory = segment_new();
+    for (int i = 0; i < LIVE; i++) {
+        segment_map(memory, 8);
+    }
+
+    Pool_stats before = segment_pool_stats(memory);
+    double start = now();
+    for (uint64_t i = 0; i < ops; i++) {
+        uint32_t id = segment_map(memory, 8);
+        segment_unmap(memory, id);
+    }
+    report("lifo churn, 8 words", ops, now() - start, memory, before);
+
+    segment_free(memory);
+}
+
+/* bench_fifo
+ *
+ *      Purpose: Time replacing the oldest of LIVE mapped segments with a
+ *               new one, so each block is reused long after it was freed.
+ *
+ *   Parameters: How many unmap and map pairs to time.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void bench_fifo(uint64_t ops)
+{
+    Memory_T memory = segment_new();
+    uint32_t ring[LIVE];
+    for (int i = 0; i < LIVE; i++) {
+        ring[i] = segment_map(memory, 8);
+    }
+
+    Pool_stats before = segment_pool_stats(memory);
+    double start = now();
+    for (uint64_t i = 0; i < ops; i++) {
+        segment_unmap(memory, ring[i % LIVE]);
+        ring[i % LIVE] = segment_map(memory, 8);
+    }
+    report("fifo churn, 8 words", ops, now() - start, memory, before);
+
+    segment_free(memory);
+}
+
+/* bench_mixed
+ *
+ *      Purpose: Time the fifo pattern with sizes from 1 to 4096 words, each
+ *               power of two range equally likely, so most segments are
+ *               small but some miss the pools entirely.
+ *
+ *   Parameters: How many unmap and map pairs to time.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void bench_mixed(uint64_t ops)
+{
+    Memory_T memory = segment_new();
+    uint32_t ring[LIVE];
+    uint32_t sizes[4096];
+    uint32_t state = 1;
+
+    /* drawn up front so the generator isn't timed */
+    for (int i = 0; i < 4096; i++) {
+        int bits = next_random(&state) % 12;
+        sizes[i] = (1u << bits) + next_random(&state) % (1u << bits);
+    }
+    for (int i = 0; i < LIVE; i++) {
+        ring[i] = segment_map(memory, sizes[i]);
+    }
+
+    Pool_stats before = segment_pool_stats(memory);
+    double start = now();
+    for (uint64_t i = 0; i < ops; i++) {
+        segment_unmap(memory, ring[i % LIVE]);
+        ring[i % LIVE] = segment_map(memory, sizes[i % 4096]);
+    }
+    report("fifo churn, 1-4096 words", ops, now() - start, memory, before);
+
+    segment_free(memory);
+}
+
+/* bench_large
+ *
+ *      Purpose: Time mapping, touching every page of and unmapping
+ *               segments too large for the free lists.
+ *
+ *   Parameters: How many map and unmap pairs to time.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void bench_large(uint64_t ops)
+{
+    Memory_T memory = segment_new();
+
+    Pool_stats before = segment_pool_stats(memory);
+    double start = now();
+    for (uint64_t i = 0; i < ops; i++) {
+        uint32_t id = segment_map(memory, LARGE);
+        for (int offset = 0; offset < LARGE; offset += 1024) {
+            segment_store(memory, id, offset, offset);
+        }
+        segment_unmap(memory, id);
+    }
+    report("map/unmap, 1M words", ops, now() - start, memory, before);
+
+    segment_free(memory);
+}
+
+/* bench_access
+ *
+ *      Purpose: Time loads and stores at random offsets of random segments
+ *               among LIVE, with the addresses drawn up front.
+ *
+ *   Parameters: How many loads, and how many stores, to time.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void bench_access(uint64_t ops)
+{
+    enum { WORDS = 256, PAIRS = 1 << 16 };
+    Memory_T memory = segment_new();
+    uint32_t *ids = malloc(PAIRS * sizeof(uint32_t));
+    uint32_t *offsets = malloc(PAIRS * sizeof(uint32_t));
+    uint32_t state = 7;
+
+    for (int i = 0; i < LIVE; i++) {
+        segment_map(memory, WORDS);
+    }
+    for (int i = 0; i < PAIRS; i++) {
+        ids[i] = next_random(&state) % LIVE;
+        offsets[i] = next_random(&state) % WORDS;
+    }
+
+    Pool_stats before = segment_pool_stats(memory);
+    double start = now();
+    for (uint64_t i = 0; i < ops; i++) {
+        segment_store(memory, ids[i % PAIRS], offsets[i % PAIRS], i);
+    }
+    report("store, random", ops, now() - start, memory, before);
+
+    uint32_t sum = 0;
+    uint32_t word = 0;
+    start = now();
+    for (uint64_t i = 0; i < ops; i++) {
+        segment_load(memory, ids[i % PAIRS], offsets[i % PAIRS], &word);
+        sum += word;
+    }
+    sink = sum;
+    report("load, random", ops, now() - start, memory, before);
+
+    start = now();
+    for (uint64_t i = 0; i < ops; i++) {
+        segment_load(memory, 1, i % WORDS, &word);
+        sum += word;
+    }
+    sink = sum;
+    report("load, sequential", ops, now() - start, memory, before);
+
+    free(ids);
+    free(offsets);
+    segment_free(memory);
+}
+
+/* bench_load_program
+ *
+ *      Purpose: Time LOADP of segment 0, which is only a jump, and loading
+ *               another segment as the program and then storing into it,
+ *               which makes the shared storage be copied.
+ *
+ *   Parameters: How many jumps to time; a thousandth as many program
+ *               loads are timed.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void bench_load_program(uint64_t ops)
+{
+    Memory_T memory = segment_new();
+    segment_map(memory, 1024);
+    uint32_t id = segment_map(memory, 1024);
+
+    Pool_stats before = segment_pool_stats(memory);
+    double start = now();
+    for (uint64_t i = 0; i < ops; i++) {
+        segment_load_program(memory, 0);
+    }
+    report("load program 0", ops, now() - start, memory, before);
+
+    uint64_t loads = ops / 1000 + 1;
+    before = segment_pool_stats(memory);
+    start = now();
+    for (uint64_t i = 0; i < loads; i++) {
+        segment_load_program(memory, id);
+        segment_store(memory, id, 0, i);
+    }
+    report("load program, 1K words + store", loads, now() - start, memory,
+           before);
+
+    segment_free(memory);
+}
+
+/* report
+ *
+ *      Purpose: Print one line of results.
+ *
+ *   Parameters: Name of the pattern, operations timed, seconds taken, the
+ *               memory, and its free list counters from before timing.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void report(const char *name, uint64_t ops, double seconds,
+                   Memory_T memory, Pool_stats before)
+{
+    Pool_stats after = segment_pool_stats(memory);
+
+    printf("%-28s %12llu %10.2f %12.4f\n", name, (unsigned long long)ops,
+           seconds * 1e9 / (double)ops,
+           (double)(after.misses - before.misses) / (double)ops);
+}
+
+/* now
+ *
+ *      Purpose: Read the monotonic clock.
+ *
+ *   Parameters: None
+ *
+ *      Returns: Seconds since some fixed point.
+ *
+ * Expectations: None
+*/
+static double now(void)
+{
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+/* next_random
+ *
+ *      Purpose: xorshift32, so every run draws the same patterns.
+ *
+ *   Parameters: The generator's state.
+ *
+ *      Returns: The next number.
+ *
+ * Expectations: None
+*/
+static uint32_t next_random(uint32_t *state)
+{
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
@@ -6,28 +6,19 @@
  * Contains all declarations and definitions of functions to test the
  * architecture of our main memory set up in um_segments.h interface.
  * Tests each function in that interface through a "main()" and considers
- * many edge cases.
+ * many edge cases. Like um_segments_bench.c, it is linked against
+ * um_segments.c alone and sees memory only through the interface.
 */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <assert.h>
 
-#include <seq.h>
-#include <uarray.h>
-
 #include "um_segments.h"
 
-/* redefinition for testing purposes ====================================== */
-#define T Memory_T
-
-#define SEQ_SEGMENT 1000
-#define SEQ_UNMAPPED 500
-
-struct T {
-    Seq_T segments;
-    Seq_T unmapped_segments;
-};
+/* macros ================================================================== */
+#define MANY_SEGMENTS 1000 /* well past the table's starting size */
 
 /* function declarations =================================================== */
 void test_segment_new();
@@ -38,7 +29,18 @@ void test_segment_map_unmap();
 void test_segment_store();
 void test_segment_load();
 void test_segment_load_program();
-
+void test_segment_many();
+void test_segment_pools();
+void test_segment_attach();
+static uint32_t word_at(Memory_T memory, uint32_t id, uint32_t offset);
+static void count_loaded(void *state);
+static void count_stored(void *state, uint32_t offset);
+static void count_release(void *state);
+
+/* engine whose state is counters: loads, stores into 0, then releases */
+static const Segment_engine counting = {
+    count_loaded, count_stored, count_release
+};
 
 /* function definitions ==================================================== */
 int main()
@@ -51,6 +53,9 @@ int main()
     test_segment_store();
     test_segment_load();
     test_segment_load_program();
+    test_segment_many();
+    test_segment_pools();
+    test_segment_attach();
 
     return 0;
 }
@@ -62,7 +67,7 @@ int main()
  * Parameters: None
  *    Returns: None
  *
- *      Tests: Memory allocation succesful
+ *      Tests: Memory allocation succesful, and nothing mapped yet
  *
 */
 void test_segment_new()
@@ -70,8 +75,8 @@ void test_segment_new()
     Memory_T new_memory = segment_new();
 
     assert(new_memory != NULL);
-    assert(new_memory->segments != NULL);
-    assert(new_memory->unmapped_segments != NULL);
+    Segment_usage usage = segment_usage(new_memory);
+    assert(usage.live == 0 && usage.words == 0);
 
     segment_free(new_memory);
 }
@@ -106,7 +111,8 @@ void test_segment_free()
  *    Returns: None
  *
  *      Tests: Can map segments onto the end of main memory in the correct
- *             location and return the correct index of segment.
+ *             location and return the correct index of segment, with every
+ *             word zeroed.
  *
 */
 void test_segment_map()
@@ -118,20 +124,28 @@ void test_segment_map()
     indexOfSegment = segment_map(new_memory, 6);
     assert(indexOfSegment == 1);
 
-    assert(UArray_length(Seq_get(new_memory->segments, 0)) == 4);
-    segment_free(new_memory);
+    assert(segment_length(new_memory, 0) == 4);
+    assert(segment_length(new_memory, 1) == 6);
+    for (int i = 0; i < 6; i++) {
+        assert(word_at(new_memory, 1, i) == 0);
+    }
 
+    Segment_usage usage = segment_usage(new_memory);
+    assert(usage.live == 2 && usage.words == 10);
+
+    segment_free(new_memory);
 }
 
 /* test_segment_unmap
  *
- *    Purpose: Make sure memory is unmapped and set to NULL
+ *    Purpose: Make sure memory is unmapped and its id handed out again
  *
  * Parameters: None
  *    Returns: None
  *
- *      Tests: Unmap the end of memory and assert correct state of memory and
- *             unmapped segments gains an element.
+ *      Tests: Unmap the end of memory and assert it no longer counts as
+ *             mapped, and that the next map reuses its id. Unmapping it
+ *             twice, an id never mapped, or segment 0 does nothing.
  *
 */
 void test_segment_unmap()
@@ -141,10 +155,21 @@ void test_segment_unmap()
     segment_map(new_memory, 3);
     segment_map(new_memory, 8);
 
-    segment_unmap(new_memory, 1);
+    bool unmapped = segment_unmap(new_memory, 1);
+    assert(unmapped);
+    unmapped = segment_unmap(new_memory, 1);
+    assert(!unmapped);
+    unmapped = segment_unmap(new_memory, 2);
+    assert(!unmapped);
+    unmapped = segment_unmap(new_memory, 0);
+    assert(!unmapped);
 
-    assert(Seq_get(new_memory->segments, 1) == NULL);
-    assert(Seq_length(new_memory->unmapped_segments) == 1);
+    Segment_usage usage = segment_usage(new_memory);
+    assert(usage.live == 1 && usage.words == 3);
+    assert(segment_mapped(new_memory, 0) && !segment_mapped(new_memory, 1));
+
+    uint32_t id = segment_map(new_memory, 2);
+    assert(id == 1);
 
     segment_free(new_memory);
 }
@@ -172,14 +197,20 @@ void test_segment_map_unmap()
 
     /* segment_unmap(new_memory, 1000); */
 
-    assert(Seq_length(new_memory->segments) == 3);
-    assert(Seq_length(new_memory->unmapped_segments) == 1);
+    Segment_usage usage = segment_usage(new_memory);
+    assert(usage.live == 2 && usage.words == 20);
 
     /* segment_free(new_memory); */
 
-    segment_map(new_memory, 12);
-    assert(Seq_length(new_memory->segments) == 3);
-    assert(Seq_length(new_memory->unmapped_segments) == 0);
+    uint32_t id = segment_map(new_memory, 12);
+    assert(id == 1);
+    assert(segment_length(new_memory, 1) == 12);
+
+    id = segment_map(new_memory, 1);
+    assert(id == 3);
+
+    usage = segment_usage(new_memory);
+    assert(usage.live == 4 && usage.words == 33);
 
     segment_free(new_memory);
 }
@@ -191,8 +222,9 @@ void test_segment_map_unmap()
  * Parameters: None
  *    Returns: None
  *
- *      Tests: Store values in spots, store with offset out of bounds (208),
- *             store with ID out of bounds (209), store on NULL segment (210).
+ *      Tests: Store values in spots, store with offset out of bounds,
+ *             store with ID out of bounds, store on NULL segment, none of
+ *             which store anything.
  *
 */
 void test_segment_store()
@@ -207,15 +239,23 @@ void test_segment_store()
     segment_store(new_memory, 1, 4, 58);
     segment_store(new_memory, 0, 0, 31);
     segment_store(new_memory, 2, 3, 22);
-    assert(*((int *)UArray_at(Seq_get(new_memory->segments, 1), 4)) == 58);
-    assert(*((int *)UArray_at(Seq_get(new_memory->segments, 0), 0)) == 31);
-    assert(*((int *)UArray_at(Seq_get(new_memory->segments, 2), 3)) == 22);
+    assert(segment_words(new_memory, 1)[4] == 58);
+    assert(segment_words(new_memory, 0)[0] == 31);
+    assert(segment_words(new_memory, 2)[3] == 22);
+
+    bool stored = segment_store(new_memory, 2, -1, 22);
+    assert(!stored);
+    stored = segment_store(new_memory, 2, 4, 22);
+    assert(!stored);
+    stored = segment_store(new_memory, 3, 4, 58);
+    assert(!stored);
+    stored = segment_store(new_memory, 1000, 0, 58);
+    assert(!stored);
 
-    /* segment_store(new_memory, 2, -1, 22); */
-    /* segment_store(new_memory, 3, 4, 58); */
-
-    /* segment_unmap(new_memory, 1);
-       segment_store(new_memory, 1, 4, 58); */
+    segment_unmap(new_memory, 1);
+    stored = segment_store(new_memory, 1, 4, 58);
+    assert(!stored);
+    assert(word_at(new_memory, 2, 3) == 22);
 
     segment_free(new_memory);
 }
@@ -227,9 +267,10 @@ void test_segment_store()
  * Parameters: None
  *    Returns: None
  *
- *      Tests: Load values in spots, load from offset out of bounds (245),
- *             load from ID out of bounds (246), load on NULL segment (247),
- *             try to load from empty spot in segment(249).
+ *      Tests: Load values in spots, load from offset out of bounds,
+ *             load from ID out of bounds, load on NULL segment, none of
+ *             which touch the word given, and load from empty spot in
+ *             segment.
  *
 */
 void test_segment_load()
@@ -243,15 +284,21 @@ void test_segment_load()
     segment_store(new_memory, 0, 0, 31);
     segment_store(new_memory, 2, 3, 22);
 
-    assert(segment_load(new_memory, 0, 0) == 31);
-    assert(segment_load(new_memory, 0, 0) == 31);
-    assert(segment_load(new_memory, 0, 0) == 31);
-
-    /* segment_load(new_memory, 0, 100); */
-    /* segment_load(new_memory, 3, 2); */
-    /* segment_unmap(new_memory, 1);
-       segment_load(new_memory, 1, 0); */
-    /* assert(segment_load(new_memory, 0, 1) == 0); */
+    assert(word_at(new_memory, 0, 0) == 31);
+    assert(word_at(new_memory, 0, 0) == 31);
+    assert(word_at(new_memory, 0, 0) == 31);
+
+    uint32_t word = 99;
+    bool loaded = segment_load(new_memory, 0, 100, &word);
+    assert(!loaded);
+    loaded = segment_load(new_memory, 0, 10, &word);
+    assert(!loaded);
+    loaded = segment_load(new_memory, 3, 2, &word);
+    assert(!loaded);
+    segment_unmap(new_memory, 1);
+    loaded = segment_load(new_memory, 1, 0, &word);
+    assert(!loaded && word == 99);
+    assert(word_at(new_memory, 0, 1) == 0);
 
     segment_free(new_memory);
 }
@@ -266,7 +313,8 @@ void test_segment_load()
  *
  *      Tests: Make sure new program is loaded in correctly and old memory
  *             associated with old program was deleted. Tests invallid id (283)
- *             Tests to make sure deep copy is made.
+ *             Tests that the two segments share storage until either is
+ *             stored into, after which each keeps its own words.
  *
 */
 void test_segment_load_program()
@@ -281,12 +329,218 @@ void test_segment_load_program()
     segment_store(new_memory, 1, 2, 100);
 
     segment_load_program(new_memory, 1);
-    assert(segment_load(new_memory, 0, 2) == 100);
+    assert(word_at(new_memory, 0, 2) == 100);
+    assert(segment_length(new_memory, 0) == 5);
+    assert(segment_words(new_memory, 0) == segment_words(new_memory, 1));
 
     /* segment_load_program(new_memory, 1000); */
+    assert(!segment_mapped(new_memory, 1000));
 
     segment_store(new_memory, 1, 0, 100);
-    assert(segment_load(new_memory, 0, 0) != 100);
+    assert(word_at(new_memory, 0, 0) != 100);
+    assert(word_at(new_memory, 1, 2) == 100);
+
+    segment_store(new_memory, 0, 1, 7);
+    assert(word_at(new_memory, 1, 1) != 7);
+
+    /* the decoded copy follows the words of the new program, and ends
+     * with an entry that never decodes */
+    Instruction_T program = segment_program(new_memory);
+    assert(program != NULL);
+    assert(segment_decode(new_memory, 1) == &program[1]);
+    assert(program[5].opcode == NOT_DECODED);
+    assert(segment_decode(new_memory, 5) == NULL);
+
+    Segment_usage usage = segment_usage(new_memory);
+    assert(usage.live == 3 && usage.words == 14);
 
     segment_free(new_memory);
 }
+
+/* test_segment_many
+ *
+ *    Purpose: Test that the segment table grows as ids run out.
+ *
+ * Parameters: None
+ *    Returns: None
+ *
+ *      Tests: Map far more segments than the table starts with, check each
+ *             one kept its id and its words, then unmap them all and map
+ *             them again, getting the most recently unmapped id first.
+ *
+*/
+void test_segment_many()
+{
+    Memory_T new_memory = segment_new();
+
+    for (int i = 0; i < MANY_SEGMENTS; i++) {
+        uint32_t id = segment_map(new_memory, i % 7 + 1);
+        assert(id == (uint32_t)i);
+        segment_store(new_memory, i, i % 7, i);
+    }
+    for (int i = 0; i < MANY_SEGMENTS; i++) {
+        assert(segment_length(new_memory, i) == i % 7 + 1);
+        assert(word_at(new_memory, i, i % 7) == (uint32_t)i);
+    }
+
+    for (int i = 1; i < MANY_SEGMENTS; i++) {
+        segment_unmap(new_memory, i);
+    }
+    Segment_usage usage = segment_usage(new_memory);
+    assert(usage.live == 1 && usage.words == 1);
+
+    for (int i = MANY_SEGMENTS - 1; i > 0; i--) {
+        uint32_t id = segment_map(new_memory, 3);
+        assert(id == (uint32_t)i);
+    }
+
+    segment_free(new_memory);
+}
+
+/* test_segment_pools
+ *
+ *    Purpose: Test that unmapped segments are recycled through the free
+ *             lists, and come back zeroed.
+ *
+ * Parameters: None
+ *    Returns: None
+ *
+ *      Tests: Unmapping a small segment holds its block, mapping one of the
+ *             same size class takes it back as a hit with every word 0, and
+ *             a segment too big for the pools always misses.
+ *
+*/
+void test_segment_pools()
+{
+    Memory_T new_memory = segment_new();
+    segment_map(new_memory, 1);
+
+    uint32_t id = segment_map(new_memory, 30);
+    for (int i = 0; i < 30; i++) {
+        segment_store(new_memory, id, i, 0xdeadbeef);
+    }
+    segment_unmap(new_memory, id);
+
+    Pool_stats before = segment_pool_stats(new_memory);
+    assert(before.bytes > 0);
+
+    id = segment_map(new_memory, 32);
+    Pool_stats after = segment_pool_stats(new_memory);
+    assert(after.hits == before.hits + 1);
+    assert(after.misses == before.misses);
+    assert(after.bytes == 0);
+    for (int i = 0; i < 32; i++) {
+        assert(word_at(new_memory, id, i) == 0);
+    }
+
+    id = segment_map(new_memory, 1 << 20);
+    segment_unmap(new_memory, id);
+    segment_map(new_memory, 1 << 20);
+    Pool_stats large = segment_pool_stats(new_memory);
+    assert(large.hits == after.hits);
+    assert(large.misses == after.misses + 2);
+
+    segment_free(new_memory);
+}
+
+/* test_segment_attach
+ *
+ *    Purpose: Test keeping an engine's state with the memory
+ *
+ * Parameters: None
+ *    Returns: None
+ *
+ *      Tests: Loading a new program tells the engine, reloading segment 0
+ *             does not, it is told of stores into segment 0 alone, only the
+ *             attached engine finds its state, and the state is released
+ *             when replaced and when the memory is freed
+ *
+*/
+void test_segment_attach()
+{
+    Memory_T new_memory = segment_new();
+    segment_map(new_memory, 1);
+    uint32_t id = segment_map(new_memory, 2);
+    int first[3] = { 0, 0, 0 };
+    int second[3] = { 0, 0, 0 };
+
+    assert(segment_engine_state(new_memory, &counting) == NULL);
+    segment_attach(new_memory, &counting, first);
+    assert(segment_engine_state(new_memory, &counting) == first);
+
+    segment_store(new_memory, 0, 0, 7);
+    segment_store(new_memory, id, 1, 7);
+    assert(first[1] == 1);
+
+    segment_load_program(new_memory, id);
+    segment_load_program(new_memory, 0);
+    assert(first[0] == 1 && first[2] == 0);
+
+    segment_attach(new_memory, &counting, second);
+    assert(first[2] == 1);
+    assert(segment_engine_state(new_memory, &counting) == second);
+
+    segment_free(new_memory);
+    assert(second[0] == 0 && second[2] == 1);
+    assert(first[0] == 1 && first[2] == 1);
+}
+
+/* static function definitions============================================== */
+
+/* word_at
+ *
+ *    Purpose: Load a word the test knows is in a segment
+ *
+ * Parameters: The memory, the id and the offset
+ *    Returns: The word
+ *
+*/
+static uint32_t word_at(Memory_T memory, uint32_t id, uint32_t offset)
+{
+    uint32_t word = 0;
+    bool loaded = segment_load(memory, id, offset, &word);
+    assert(loaded);
+    (void)loaded;
+
+    return word;
+}
+
+/* count_loaded
+ *
+ *    Purpose: Count a program load for test_segment_attach
+ *
+ * Parameters: The counters
+ *    Returns: None
+ *
+*/
+static void count_loaded(void *state)
+{
+    ((int *)state)[0]++;
+}
+
+/* count_stored
+ *
+ *    Purpose: Count a store into segment 0 for test_segment_attach
+ *
+ * Parameters: The counters and the offset stored into
+ *    Returns: None
+ *
+*/
+static void count_stored(void *state, uint32_t offset)
+{
+    (void)offset;
+    ((int *)state)[1]++;
+}
+
+/* count_release
+ *
+ *    Purpose: Count a release for test_segment_attach
+ *
+ * Parameters: The counters
+ *    Returns: None
+ *
+*/
+static void count_release(void *state)
+{
+    ((int *)state)[2]++;
+}
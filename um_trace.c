@@ -0,0 +1,352 @@
+/*
+ * um_trace.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Implementation of the um_trace.h interface. A recorder belongs to the one
+ * thread running its machine, so it needs no locks; it keeps a shadow copy
+ * of the registers to know when one was written and what to XOR against.
+ *
+ * The buffer is a single one, streamed out by the machine's own thread when
+ * it fills rather than drained by a background thread. That is deliberate:
+ * one write of 1 MiB per roughly a million instructions is well under a
+ * nanosecond an instruction, while a drain thread would need a second
+ * buffer, a hand-off and a thread to stop on every exit path. The cost is
+ * that whatever is buffered when the process dies is lost unless someone
+ * flushes it, so um_main flushes at HALT, on a fault, and from the fatal
+ * signal handler. tracer_flush can be called from that handler: a flush it
+ * interrupts is left to finish, and records are only counted once whole.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <unistd.h>
+
+#include "um_trace.h"
+
+/* macros ================================================================== */
+#define TRACE_BUFFER_SIZE (1024 * 1024)
+#define MAX_RECORD 16          /* header, pc varint, register, value varint */
+#define JUMP 0x10
+#define WRITE 0x20
+#define REGISTERS_FLAG 0x01
+
+/* which register each decoded opcode writes */
+enum { WRITES_A = 0, WRITES_B, WRITES_C, WRITES_NONE };
+static const uint8_t writes[17] = {
+    WRITES_NONE,
+    WRITES_A, WRITES_A, WRITES_NONE, WRITES_A, WRITES_A, WRITES_A,  /* cmov-div */
+    WRITES_A, WRITES_NONE, WRITES_B, WRITES_NONE, WRITES_NONE,      /* nand-out */
+    WRITES_C, WRITES_NONE, WRITES_A, WRITES_NONE, WRITES_NONE       /* in-op15 */
+};
+
+/* struct definitions ====================================================== */
+struct Tracer_T {
+    int fd;
+    bool registers;
+    uint32_t expected_pc;   /* one past the previous pc */
+    uint32_t shadow[8];     /* register values as last recorded */
+    size_t used;            /* stored with release, for a signal handler */
+    bool flushing;          /* a flush is under way; another leaves it be */
+    uint8_t buffer[TRACE_BUFFER_SIZE];
+};
+
+struct Trace_reader {
+    FILE *in;
+    bool registers;
+    uint32_t expected_pc;
+    uint32_t shadow[8];
+};
+
+/* function declarations =================================================== */
+static uint8_t *put_varint(uint8_t *end, uint64_t value);
+static bool get_varint(FILE *in, uint64_t *value);
+
+/* function definitions ==================================================== */
+
+/* tracer_new
+ *
+ *      Purpose: Create a recorder and write the trace header.
+ *
+ *   Parameters: Descriptor to write to and whether to record registers.
+ *
+ *      Returns: New instance of Tracer_T.
+ *
+ * Expectations: fd is open for writing. The header is written at once, so
+ *               even a run that dies before its first flush leaves a
+ *               readable trace.
+*/
+extern Tracer_T tracer_new(int fd, bool registers)
+{
+    Tracer_T tracer = malloc(sizeof(*tracer));
+    assert(tracer != NULL);
+
+    tracer->fd = fd;
+    tracer->registers = registers;
+    tracer->expected_pc = 0;
+    memset(tracer->shadow, 0, sizeof(tracer->shadow));
+
+    memcpy(tracer->buffer, "UMTR", 4);
+    tracer->buffer[4] = TRACE_VERSION;
+    tracer->buffer[5] = registers ? REGISTERS_FLAG : 0;
+    tracer->used = 6;
+    tracer->flushing = false;
+    tracer_flush(tracer);
+
+    return tracer;
+}
+
+/* tracer_free
+ *
+ *      Purpose: Write the buffered records and free the recorder. The
+ *               descriptor is left open.
+ *
+ *   Parameters: Pointer to an instance of Tracer_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: tracer and *tracer are not null.
+*/
+extern void tracer_free(Tracer_T *tracer)
+{
+    assert(tracer != NULL && *tracer != NULL);
+
+    tracer_flush(*tracer);
+    free(*tracer);
+    *tracer = NULL;
+}
+
+/* tracer_step
+ *
+ *      Purpose: Append the record of one instruction.
+ *
+ *   Parameters: Instance of Tracer_T, offset the instruction ran at, the
+ *               instruction, and the registers after it ran.
+ *
+ *      Returns: None
+ *
+ * Expectations: The instruction has been decoded.
+*/
+extern void tracer_step(Tracer_T tracer, uint32_t pc,
+                        Instruction_T instruction, const uint32_t *registers)
+{
+    if (tracer->used > TRACE_BUFFER_SIZE - MAX_RECORD) {
+        tracer_flush(tracer);
+        if (tracer->used > TRACE_BUFFER_SIZE - MAX_RECORD) {
+            return; /* a signal handler is writing it out, before dying */
+        }
+    }
+
+    uint8_t *header = &tracer->buffer[tracer->used];
+    uint8_t *end = header + 1;
+    unsigned opcode = instruction->opcode;
+
+    *header = (uint8_t)((opcode - 1) & 0xf);
+
+    if (pc != tracer->expected_pc) {
+        int64_t delta = (int64_t)pc - (int64_t)tracer->expected_pc;
+        *header |= JUMP;
+        end = put_varint(end, ((uint64_t)delta << 1) ^ (uint64_t)(delta >> 63));
+    }
+    tracer->expected_pc = pc + 1;
+
+    if (tracer->registers && writes[opcode] != WRITES_NONE) {
+        unsigned reg = (writes[opcode] == WRITES_A) ? instruction->register_A
+                     : (writes[opcode] == WRITES_B) ? instruction->register_B
+                     : instruction->register_C;
+        uint32_t value = registers[reg];
+
+        if (value != tracer->shadow[reg]) {
+            *header |= WRITE;
+            *end++ = (uint8_t)reg;
+            end = put_varint(end, value ^ tracer->shadow[reg]);
+            tracer->shadow[reg] = value;
+        }
+    }
+
+    __atomic_store_n(&tracer->used, (size_t)(end - tracer->buffer),
+                     __ATOMIC_RELEASE);
+}
+
+/* tracer_flush
+ *
+ *      Purpose: Write every buffered record to the descriptor.
+ *
+ *   Parameters: Instance of Tracer_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: None. Records are dropped if the descriptor fails. Safe to
+ *               call from a signal handler; it does nothing if it
+ *               interrupted another flush of the same recorder.
+*/
+extern void tracer_flush(Tracer_T tracer)
+{
+    if (__atomic_exchange_n(&tracer->flushing, true, __ATOMIC_SEQ_CST)) {
+        return;
+    }
+
+    uint8_t *bytes = tracer->buffer;
+    size_t size = __atomic_load_n(&tracer->used, __ATOMIC_ACQUIRE);
+
+    while (size > 0) {
+        ssize_t written = write(tracer->fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        bytes += written;
+        size -= (size_t)written;
+    }
+
+    __atomic_store_n(&tracer->used, 0, __ATOMIC_RELEASE);
+    __atomic_store_n(&tracer->flushing, false, __ATOMIC_SEQ_CST);
+}
+
+/* trace_reader_new
+ *
+ *      Purpose: Check the trace header and create a reader.
+ *
+ *   Parameters: Stream holding a trace.
+ *
+ *      Returns: New instance of Trace_reader, or NULL if it is not a trace
+ *               of this version.
+ *
+ * Expectations: in is not null.
+*/
+extern Trace_reader trace_reader_new(FILE *in)
+{
+    uint8_t header[6];
+
+    assert(in != NULL);
+    if (fread(header, 1, sizeof(header), in) != sizeof(header) ||
+        memcmp(header, "UMTR", 4) != 0 || header[4] != TRACE_VERSION) {
+        return NULL;
+    }
+
+    Trace_reader reader = calloc(1, sizeof(*reader));
+    assert(reader != NULL);
+
+    reader->in = in;
+    reader->registers = (header[5] & REGISTERS_FLAG) != 0;
+    return reader;
+}
+
+/* trace_reader_free
+ *
+ *      Purpose: Free a reader. The stream is left open.
+ *
+ *   Parameters: Pointer to an instance of Trace_reader.
+ *
+ *      Returns: None
+ *
+ * Expectations: reader and *reader are not null.
+*/
+extern void trace_reader_free(Trace_reader *reader)
+{
+    assert(reader != NULL && *reader != NULL);
+
+    free(*reader);
+    *reader = NULL;
+}
+
+/* trace_reader_next
+ *
+ *      Purpose: Decode the next record.
+ *
+ *   Parameters: Instance of Trace_reader and where to put the record.
+ *
+ *      Returns: True if a record was read, false at the end of the trace or
+ *               at a record cut short.
+ *
+ * Expectations: record is not null.
+*/
+extern bool trace_reader_next(Trace_reader reader, Trace_record *record)
+{
+    int header = getc(reader->in);
+    if (header == EOF) {
+        return false;
+    }
+
+    record->opcode = (uint8_t)(header & 0xf);
+    record->pc = reader->expected_pc;
+    record->reg = -1;
+    record->value = 0;
+
+    if (header & JUMP) {
+        uint64_t zigzag;
+        if (!get_varint(reader->in, &zigzag)) {
+            return false;
+        }
+        int64_t delta = (int64_t)(zigzag >> 1) ^ -(int64_t)(zigzag & 1);
+        record->pc = (uint32_t)((int64_t)reader->expected_pc + delta);
+    }
+    reader->expected_pc = record->pc + 1;
+
+    if (header & WRITE) {
+        int reg = getc(reader->in);
+        uint64_t change;
+        if (reg == EOF || reg >= 8 || !get_varint(reader->in, &change)) {
+            return false;
+        }
+        reader->shadow[reg] ^= (uint32_t)change;
+        record->reg = (int8_t)reg;
+        record->value = reader->shadow[reg];
+    }
+
+    return true;
+}
+
+/* static function definitions============================================== */
+
+/* put_varint
+ *
+ *      Purpose: Write a number as a varint.
+ *
+ *   Parameters: Where to write and the number.
+ *
+ *      Returns: One past the last byte written.
+ *
+ * Expectations: There is room for 10 bytes.
+*/
+static uint8_t *put_varint(uint8_t *end, uint64_t value)
+{
+    while (value >= 0x80) {
+        *end++ = (uint8_t)(value | 0x80);
+        value >>= 7;
+    }
+    *end++ = (uint8_t)value;
+    return end;
+}
+
+/* get_varint
+ *
+ *      Purpose: Read a varint.
+ *
+ *   Parameters: Stream to read and where to put the number.
+ *
+ *      Returns: False if the stream ended in the middle of it.
+ *
+ * Expectations: None
+*/
+static bool get_varint(FILE *in, uint64_t *value)
+{
+    *value = 0;
+
+    for (int shift = 0; shift < 64; shift += 7) {
+        int byte = getc(in);
+        if (byte == EOF) {
+            return false;
+        }
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,84 @@
+/*
+ * um_trace.h
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Provides an interface for recording and reading execution traces. The
+ * tracing engine (execute_trace() in um_execution.h) hands every retired
+ * instruction to a Tracer_T, which packs it into a buffer and writes the
+ * buffer out, from the same thread, whenever it fills. A Trace_reader turns a trace back into one
+ * Trace_record per instruction; umtrace.c prints them.
+ *
+ * A trace is the bytes "UMTR", a version byte and a flags byte (bit 0 set
+ * when register writes are recorded), then one record per instruction:
+ *
+ *   byte      opcode in bits 0-3, bit 4 set if the pc is not one past the
+ *             previous pc, bit 5 set if a register write follows
+ *   varint    (bit 4) pc minus the expected pc, zigzag encoded
+ *   byte      (bit 5) the register written
+ *   varint    (bit 5) the new value XORed with the register's previous one
+ *
+ * where varints are little-endian groups of 7 bits, the high bit of each
+ * byte marking that another follows. Straight-line code without register
+ * writes costs one byte per instruction.
+*/
+
+#ifndef UM_TRACE_
+#define UM_TRACE_
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "um_decode.h"
+
+#define TRACE_VERSION 1
+
+/* One instruction read back from a trace */
+typedef struct Trace_record {
+    uint32_t pc;
+    uint8_t opcode;     /* as in the word, 0 through 15 */
+    int8_t reg;         /* register written, or -1 */
+    uint32_t value;     /* value written to reg */
+} Trace_record;
+
+#define T Tracer_T
+typedef struct T *T; /* pointer to a trace being recorded */
+
+/*
+ * Takes in a descriptor and whether to record register writes, writes the
+ *      trace header, and returns a new recorder
+ */
+extern T tracer_new(int fd, bool registers);
+
+/* Takes in a pointer to a recorder, writes what it holds, and frees it */
+extern void tracer_free(T *tracer);
+
+/*
+ * Takes in a recorder, the offset of an instruction that just ran, the
+ *      instruction, and the registers as it left them, and records it
+ */
+extern void tracer_step(T tracer, uint32_t pc, Instruction_T instruction,
+                        const uint32_t *registers);
+
+/*
+ * Takes in a recorder and writes every buffered record. Can be called from
+ *      a signal handler.
+ */
+extern void tracer_flush(T tracer);
+
+#undef T
+
+#define T Trace_reader
+typedef struct T *T; /* pointer to a trace being read */
+
+/* Takes in an open trace and returns a reader, or NULL if the header is bad */
+extern T trace_reader_new(FILE *in);
+
+/* Takes in a pointer to a reader and frees it, leaving the stream open */
+extern void trace_reader_free(T *reader);
+
+/* Takes in a reader and fills in the next record; false at the end */
+extern bool trace_reader_next(T reader, Trace_record *record);
+
+#undef T
+#endif
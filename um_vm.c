@@ -0,0 +1,290 @@
+/*
+ * um_vm.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Implementation of the um_vm.h interface. A machine is the state um_main.c
+ * keeps in locals, gathered into one struct and run with execute(), so it
+ * uses whichever engine was selected at build time. Machines share nothing
+ * but the list of live I/O states um_io.c keeps for its signal handler,
+ * which it locks, so different threads can each make, run and free their
+ * own. A machine that stops out of budget or waiting for input is still
+ * running, so its status is only ever set at HALT or a fault.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "um_vm.h"
+#include "um_initialize.h"
+#include "um_io.h"
+
+#define T Um_vm_T
+
+/* struct definition ======================================================= */
+struct T {
+    uint32_t registers[8];
+    int prog_counter;
+    Exec_status status;
+    Memory_T memory;
+    Io_T io;
+    int in_fd;
+    Exec_stats stats;
+};
+
+/* function declarations =================================================== */
+static T vm_new(Memory_T memory, int in_fd, int out_fd);
+
+/* function definitions ==================================================== */
+
+/* um_vm_new
+ *
+ *      Purpose: Create a machine with a program in segment 0.
+ *
+ *   Parameters: The program's words in host order, how many there are, and
+ *               the descriptors IN reads from and OUT writes to.
+ *
+ *      Returns: New instance of Um_vm_T.
+ *
+ * Expectations: program holds length words; both descriptors are open and
+ *               outlive the machine.
+*/
+extern T um_vm_new(const uint32_t *program, uint32_t length, int in_fd,
+                   int out_fd)
+{
+    assert(program != NULL || length == 0);
+
+    Memory_T memory = segment_new();
+    uint32_t segment_0 = segment_map(memory, length);
+    memcpy(segment_words(memory, segment_0), program,
+           (size_t)length * sizeof(uint32_t));
+
+    return vm_new(memory, in_fd, out_fd);
+}
+
+/* um_vm_load
+ *
+ *      Purpose: Create a machine with a program file in segment 0.
+ *
+ *   Parameters: The program file, how many words it holds, and the
+ *               descriptors IN reads from and OUT writes to.
+ *
+ *      Returns: New instance of Um_vm_T.
+ *
+ * Expectations: fp holds at least length words; both descriptors are open
+ *               and outlive the machine.
+*/
+extern T um_vm_load(FILE *fp, uint32_t length, int in_fd, int out_fd)
+{
+    assert(fp != NULL);
+    return vm_new(initialize(fp, length), in_fd, out_fd);
+}
+
+/* um_vm_run
+ *
+ *      Purpose: Run a machine until it halts or faults.
+ *
+ *   Parameters: The machine.
+ *
+ *      Returns: EXEC_HALTED or the fault, as the engine returned it, or
+ *               EXEC_BLOCKED if its input is non-blocking and ran dry.
+ *
+ * Expectations: vm is not null.
+*/
+extern Exec_status um_vm_run(T vm)
+{
+    assert(vm != NULL);
+
+    if (vm->status != EXEC_RUNNING) {
+        return vm->status;
+    }
+
+    Exec_status status = execute(vm->memory, vm->registers,
+                                 &vm->prog_counter, vm->io, &vm->stats);
+    if (status != EXEC_BLOCKED) {
+        vm->status = status;
+    }
+    return status;
+}
+
+/* um_vm_run_for
+ *
+ *      Purpose: Run a machine for a slice of about budget instructions.
+ *
+ *   Parameters: The machine and the budget.
+ *
+ *      Returns: EXEC_OUT_OF_BUDGET, EXEC_BLOCKED, or EXEC_HALTED or the
+ *               fault, as the engine returned it.
+ *
+ * Expectations: vm is not null and budget is not 0. The slice ends at the
+ *               first LOADP past the budget, so it can run over by up to
+ *               one straight-line block.
+*/
+extern Exec_status um_vm_run_for(T vm, uint64_t budget)
+{
+    assert(vm != NULL && budget > 0);
+
+    if (vm->status != EXEC_RUNNING) {
+        return vm->status;
+    }
+
+    vm->stats.budget_end = vm->stats.instructions + budget;
+    Exec_status status = execute(vm->memory, vm->registers,
+                                 &vm->prog_counter, vm->io, &vm->stats);
+    vm->stats.budget_end = 0;
+
+    if (status != EXEC_OUT_OF_BUDGET && status != EXEC_BLOCKED) {
+        vm->status = status;
+    }
+    return status;
+}
+
+/* um_vm_free
+ *
+ *      Purpose: Write out a machine's queued output and free it with its
+ *               memory.
+ *
+ *   Parameters: Pointer to an instance of Um_vm_T.
+ *
+ *      Returns: None
+ *
+ * Expectations: vm and *vm are not null. The descriptors are left open.
+*/
+extern void um_vm_free(T *vm)
+{
+    assert(vm != NULL && *vm != NULL);
+
+    io_free(&(*vm)->io);
+    segment_free((*vm)->memory);
+
+    free(*vm);
+    *vm = NULL;
+}
+
+/* um_vm_status
+ *
+ *      Purpose: Tell whether a machine has stopped, and why.
+ *
+ *   Parameters: The machine.
+ *
+ *      Returns: EXEC_RUNNING, also between slices and while waiting for
+ *               input, EXEC_HALTED or a fault.
+ *
+ * Expectations: vm is not null.
+*/
+extern Exec_status um_vm_status(T vm)
+{
+    assert(vm != NULL);
+    return vm->status;
+}
+
+/* um_vm_pc
+ *
+ *      Purpose: Get a machine's program counter.
+ *
+ *   Parameters: The machine.
+ *
+ *      Returns: Offset in segment 0 of the next instruction to run, or of
+ *               the HALT or fault the machine stopped on.
+ *
+ * Expectations: vm is not null.
+*/
+extern uint32_t um_vm_pc(T vm)
+{
+    assert(vm != NULL);
+    return (uint32_t)vm->prog_counter;
+}
+
+/* um_vm_registers
+ *
+ *      Purpose: Get a machine's registers.
+ *
+ *   Parameters: The machine.
+ *
+ *      Returns: Its eight registers, valid until it is run again or freed.
+ *
+ * Expectations: vm is not null.
+*/
+extern const uint32_t *um_vm_registers(T vm)
+{
+    assert(vm != NULL);
+    return vm->registers;
+}
+
+/* um_vm_stats
+ *
+ *      Purpose: Get a machine's counters.
+ *
+ *   Parameters: The machine.
+ *
+ *      Returns: Its counters, valid until it is freed.
+ *
+ * Expectations: vm is not null.
+*/
+extern const Exec_stats *um_vm_stats(T vm)
+{
+    assert(vm != NULL);
+    return &vm->stats;
+}
+
+/* um_vm_input_fd
+ *
+ *      Purpose: Get the descriptor a machine's IN reads from.
+ *
+ *   Parameters: The machine.
+ *
+ *      Returns: The descriptor it was made with.
+ *
+ * Expectations: vm is not null.
+*/
+extern int um_vm_input_fd(T vm)
+{
+    assert(vm != NULL);
+    return vm->in_fd;
+}
+
+/* um_vm_memory
+ *
+ *      Purpose: Get a machine's memory.
+ *
+ *   Parameters: The machine.
+ *
+ *      Returns: Its memory, valid until it is freed.
+ *
+ * Expectations: vm is not null. The caller doesn't change it while the
+ *               machine is running.
+*/
+extern Memory_T um_vm_memory(T vm)
+{
+    assert(vm != NULL);
+    return vm->memory;
+}
+
+/* static function definitions============================================== */
+
+/* vm_new
+ *
+ *      Purpose: Wrap a loaded program in a machine about to run its first
+ *               instruction.
+ *
+ *   Parameters: Program memory and the descriptors for IN and OUT.
+ *
+ *      Returns: New instance of Um_vm_T.
+ *
+ * Expectations: Segment 0 is mapped.
+*/
+static T vm_new(Memory_T memory, int in_fd, int out_fd)
+{
+    T vm = calloc(1, sizeof(*vm));
+    assert(vm != NULL);
+
+    vm->memory = memory;
+    vm->io = io_new(in_fd, out_fd);
+    vm->in_fd = in_fd;
+    vm->prog_counter = 0;
+    vm->status = EXEC_RUNNING;
+
+    return vm;
+}
@@ -0,0 +1,73 @@
+/*
+ * um_vm.h
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Provides an interface for a whole universal machine as one object: its
+ * registers, program counter, memory, I/O state and counters. Running one
+ * returns at HALT or at a fault rather than ending the process, so a
+ * program can hold any number of machines and run each of them in turn,
+ * either to the end or a slice of instructions at a time. Given a
+ * non-blocking input, a machine also returns at an IN with nothing to read,
+ * to be run again once there is.
+*/
+
+#ifndef UM_VM_
+#define UM_VM_
+
+#include <stdio.h>
+#include <stdint.h>
+#include "um_segments.h"
+#include "um_execution.h"
+
+#define T Um_vm_T
+typedef struct T *T; /* pointer to one machine */
+
+/*
+ * Takes in a program of length words and the descriptors IN reads from and
+ *      OUT writes to, and returns a machine ready to run it. The machine
+ *      doesn't close the descriptors.
+ */
+extern T um_vm_new(const uint32_t *program, uint32_t length, int in_fd,
+                   int out_fd);
+
+/* Same as um_vm_new(), reading length big-endian words from a .um file */
+extern T um_vm_load(FILE *fp, uint32_t length, int in_fd, int out_fd);
+
+/*
+ * Takes in a machine and runs it until HALT or a fault, returning which.
+ *      A machine that has stopped returns the same status again. One that
+ *      returns EXEC_BLOCKED is still running and carries on from its IN.
+ */
+extern Exec_status um_vm_run(T vm);
+
+/*
+ * Takes in a machine and runs it until HALT, a fault, or the first LOADP
+ *      after budget more instructions, returning which. A machine out of
+ *      budget is still running and carries on from where it stopped.
+ */
+extern Exec_status um_vm_run_for(T vm, uint64_t budget);
+
+/* Takes in a pointer to a machine, writes out its queued output, frees it */
+extern void um_vm_free(T *vm);
+
+/* Takes in a machine and returns its status, EXEC_RUNNING until it stops */
+extern Exec_status um_vm_status(T vm);
+
+/* Takes in a machine and returns its program counter */
+extern uint32_t um_vm_pc(T vm);
+
+/* Takes in a machine and returns its eight registers */
+extern const uint32_t *um_vm_registers(T vm);
+
+/* Takes in a machine and returns its counters */
+extern const Exec_stats *um_vm_stats(T vm);
+
+/* Takes in a machine and returns the descriptor its IN reads from */
+extern int um_vm_input_fd(T vm);
+
+/* Takes in a machine and returns its memory, for inspection */
+extern Memory_T um_vm_memory(T vm);
+
+#undef T
+#endif
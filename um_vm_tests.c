@@ -0,0 +1,519 @@
+/*
+ * um_vm_tests.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Contains all declarations and definitions of functions to test running
+ * machines through the um_vm.h interface. Tests through a "main()" that
+ * HALT and every fault come back to the caller with the machine's state,
+ * that many machines can live in one process, and that they can be run a
+ * slice at a time or left waiting on non-blocking input, and that code
+ * rewriting itself runs as written.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "um_vm.h"
+#include "um_encode.h"
+
+/* macros ================================================================== */
+#define MANY 1000
+
+/* function declarations =================================================== */
+void test_um_vm_halt();
+void test_um_vm_faults();
+void test_um_vm_many();
+void test_um_vm_slices();
+void test_um_vm_blocked();
+void test_um_vm_long_blocks();
+void test_um_vm_selfmod();
+static void run_fault(const uint32_t *program, uint32_t length,
+                      Exec_status fault, uint32_t pc);
+
+/* function definitions ==================================================== */
+int main()
+{
+    test_um_vm_halt();
+    test_um_vm_faults();
+    test_um_vm_many();
+    test_um_vm_slices();
+    test_um_vm_blocked();
+    test_um_vm_long_blocks();
+    test_um_vm_selfmod();
+
+    return 0;
+}
+
+/* test_um_vm_halt
+ *
+ *    Purpose: Test that HALT returns to the caller with the machine intact
+ *
+ * Parameters: None
+ *    Returns: None
+ *
+ *      Tests: Status, pc, registers, counters and the output written
+ *
+*/
+void test_um_vm_halt()
+{
+    const uint32_t program[] = {
+        encode_lv(1, 'u'),
+        encode_lv(2, 'm'),
+        encode_word(OUT, 0, 0, 1),
+        encode_word(OUT, 0, 0, 2),
+        encode_word(HALT, 0, 0, 0)
+    };
+    FILE *output = tmpfile();
+    assert(output != NULL);
+
+    Um_vm_T vm = um_vm_new(program, 5, 0, fileno(output));
+    assert(um_vm_status(vm) == EXEC_RUNNING);
+    Exec_status first = um_vm_run(vm);
+    Exec_status again = um_vm_run(vm);
+    assert(first == EXEC_HALTED && again == EXEC_HALTED);
+    assert(um_vm_pc(vm) == 4);
+    assert(um_vm_registers(vm)[1] == 'u' && um_vm_registers(vm)[2] == 'm');
+    assert(um_vm_stats(vm)->instructions == 5);
+    um_vm_free(&vm);
+    assert(vm == NULL);
+
+    char text[3] = { 0 };
+    rewind(output);
+    size_t got = fread(text, 1, 2, output);
+    assert(got == 2);
+    assert(strcmp(text, "um") == 0);
+    fclose(output);
+}
+
+/* test_um_vm_faults
+ *
+ *    Purpose: Test that each fault returns without running the instruction
+ *
+ * Parameters: None
+ *    Returns: None
+ *
+ *      Tests: Division by zero, output over 255, both invalid opcodes,
+ *             jumping or running past the end, and loads, stores, unmaps
+ *             and load programs of segments that aren't there
+ *
+*/
+void test_um_vm_faults()
+{
+    const uint32_t divide[] = {
+        encode_lv(1, 7),
+        encode_word(DIV, 2, 1, 0),
+        encode_word(HALT, 0, 0, 0)
+    };
+    run_fault(divide, 3, EXEC_DIVIDE_BY_ZERO, 1);
+
+    const uint32_t output[] = {
+        encode_lv(1, 256),
+        encode_word(OUT, 0, 0, 1),
+        encode_word(HALT, 0, 0, 0)
+    };
+    run_fault(output, 3, EXEC_BAD_OUTPUT, 1);
+
+    /* past a LOADP, so the fault is in a block of its own */
+    const uint32_t opcode[] = {
+        encode_lv(1, 2),
+        encode_word(LOADP, 0, 0, 1),
+        encode_word(LV + 1, 0, 0, 0),           /* opcode 14 */
+        encode_word(HALT, 0, 0, 0)
+    };
+    run_fault(opcode, 4, EXEC_BAD_OPCODE, 2);
+
+    const uint32_t opcode_15[] = { 0xf0000000 };
+    run_fault(opcode_15, 1, EXEC_BAD_OPCODE, 0);
+
+    const uint32_t jump[] = {
+        encode_lv(1, 2),
+        encode_word(LOADP, 0, 0, 1)             /* loadp past the end */
+    };
+    run_fault(jump, 2, EXEC_BAD_PC, 2);
+
+    const uint32_t run_off[] = {
+        encode_lv(1, 2),
+        encode_word(LOADP, 0, 0, 1),
+        encode_lv(2, 0)                         /* a block with no end */
+    };
+    run_fault(run_off, 3, EXEC_BAD_PC, 3);
+
+    /* past the entry that catches running off the end, so the LOADP has
+     * to; the pc isn't the count of instructions run, as run_fault has */
+    const uint32_t far[] = {
+        encode_lv(1, 1000),
+        encode_word(LOADP, 0, 0, 1)
+    };
+    Um_vm_T vm = um_vm_new(far, 2, 0, 1);
+    Exec_status status = um_vm_run(vm);
+    assert(status == EXEC_BAD_PC && um_vm_pc(vm) == 1000);
+    assert(um_vm_stats(vm)->instructions == 2);
+    um_vm_free(&vm);
+
+    /* r1 holds 1, mapped in the first two and never in the rest */
+    const uint32_t load_offset[] = {
+        encode_lv(1, 1),
+        encode_word(ACTIVATE, 0, 2, 1),         /* r2 = map 1 word */
+        encode_word(SLOAD, 3, 2, 1),            /* m[r2][1] */
+        encode_word(HALT, 0, 0, 0)
+    };
+    run_fault(load_offset, 4, EXEC_BAD_SEGMENT, 2);
+
+    const uint32_t store_offset[] = {
+        encode_lv(1, 1),
+        encode_word(ACTIVATE, 0, 2, 1),
+        encode_word(SSTORE, 2, 1, 1),           /* m[r2][1] = 1 */
+        encode_word(HALT, 0, 0, 0)
+    };
+    run_fault(store_offset, 4, EXEC_BAD_SEGMENT, 2);
+
+    const uint32_t load_id[] = {
+        encode_lv(1, 1),
+        encode_word(SLOAD, 3, 1, 0),            /* m[1][0] */
+        encode_word(HALT, 0, 0, 0)
+    };
+    run_fault(load_id, 3, EXEC_BAD_SEGMENT, 1);
+
+    const uint32_t store_id[] = {
+        encode_lv(1, 1),
+        encode_word(SSTORE, 1, 0, 0),           /* m[1][0] = 0 */
+        encode_word(HALT, 0, 0, 0)
+    };
+    run_fault(store_id, 3, EXEC_BAD_SEGMENT, 1);
+
+    const uint32_t unmap_twice[] = {
+        encode_lv(1, 1),
+        encode_word(ACTIVATE, 0, 2, 1),
+        encode_word(INACTIVATE, 0, 0, 2),
+        encode_word(INACTIVATE, 0, 0, 2),       /* already unmapped */
+        encode_word(HALT, 0, 0, 0)
+    };
+    run_fault(unmap_twice, 5, EXEC_BAD_SEGMENT, 3);
+
+    const uint32_t unmap_0[] = {
+        encode_word(INACTIVATE, 0, 0, 0),       /* r0 is 0 */
+        encode_word(HALT, 0, 0, 0)
+    };
+    run_fault(unmap_0, 2, EXEC_BAD_SEGMENT, 0);
+
+    const uint32_t loadp_id[] = {
+        encode_lv(1, 1),
+        encode_word(LOADP, 0, 1, 0),            /* load program 1 */
+        encode_word(HALT, 0, 0, 0)
+    };
+    run_fault(loadp_id, 3, EXEC_BAD_SEGMENT, 1);
+}
+
+/* test_um_vm_many
+ *
+ *    Purpose: Test that machines in one process don't share state
+ *
+ * Parameters: None
+ *    Returns: None
+ *
+ *      Tests: MANY machines, each mapping a segment and summing into it,
+ *             all made before any is run and run in reverse order
+ *
+*/
+void test_um_vm_many()
+{
+    static Um_vm_T vms[MANY];
+    FILE *output = tmpfile();
+    assert(output != NULL);
+
+    for (uint32_t i = 0; i < MANY; i++) {
+        const uint32_t program[] = {
+            encode_lv(1, 4),
+            encode_word(ACTIVATE, 0, 2, 1),     /* r2 = map 4 words */
+            encode_lv(3, i),
+            encode_lv(4, 1),
+            encode_word(SSTORE, 2, 4, 3),       /* m[r2][1] = i */
+            encode_word(SLOAD, 5, 2, 4),        /* r5 = m[r2][1] */
+            encode_word(ADD, 5, 5, 5),          /* r5 += r5 */
+            encode_word(HALT, 0, 0, 0)
+        };
+        vms[i] = um_vm_new(program, 8, 0, fileno(output));
+    }
+
+    for (int i = MANY - 1; i >= 0; i--) {
+        Exec_status status = um_vm_run(vms[i]);
+        assert(status == EXEC_HALTED);
+        assert(um_vm_registers(vms[i])[5] == 2 * (uint32_t)i);
+        uint32_t word = 0;
+        bool loaded = segment_load(um_vm_memory(vms[i]),
+                                   um_vm_registers(vms[i])[2], 1, &word);
+        assert(loaded && word == (uint32_t)i);
+    }
+
+    for (int i = 0; i < MANY; i++) {
+        um_vm_free(&vms[i]);
+    }
+    fclose(output);
+}
+
+/* test_um_vm_slices
+ *
+ *    Purpose: Test running machines a budget at a time
+ *
+ * Parameters: None
+ *    Returns: None
+ *
+ *      Tests: A loop of 1000 run in slices of 7 ends as if run at once,
+ *             never stopping more than a block past a budget, and an
+ *             endless loop comes back every slice still running
+ *
+*/
+void test_um_vm_slices()
+{
+    const uint32_t loop[] = {
+        encode_word(NAND, 2, 0, 0),             /* r2 = ~0 */
+        encode_lv(3, 1000),
+        encode_lv(4, 1),
+        encode_lv(5, 5),                        /* top */
+        encode_lv(6, 10),                       /* out */
+        encode_word(ADD, 3, 3, 2),              /* top: r3 -= 1 */
+        encode_word(ADD, 1, 1, 4),              /* r1 += 1 */
+        encode_word(ADD, 7, 6, 0),              /* r7 = out */
+        encode_word(CMOV, 7, 5, 3),             /* r7 = top if r3 */
+        encode_word(LOADP, 0, 0, 7),            /* loadp r7 */
+        encode_word(HALT, 0, 0, 0)              /* out: halt */
+    };
+    FILE *output = tmpfile();
+    assert(output != NULL);
+
+    Um_vm_T vm = um_vm_new(loop, 11, 0, fileno(output));
+    Exec_status status;
+    int slices = 0;
+    do {
+        uint64_t before = um_vm_stats(vm)->instructions;
+        status = um_vm_run_for(vm, 7);
+        uint64_t ran = um_vm_stats(vm)->instructions - before;
+
+        if (status == EXEC_OUT_OF_BUDGET) {
+            assert(ran >= 7 && ran < 7 + 10);
+            assert(um_vm_status(vm) == EXEC_RUNNING);
+            assert(um_vm_pc(vm) == 5);
+        }
+        slices++;
+    } while (status == EXEC_OUT_OF_BUDGET);
+
+    assert(status == EXEC_HALTED && um_vm_status(vm) == EXEC_HALTED);
+    assert(um_vm_registers(vm)[1] == 1000);
+    assert(um_vm_stats(vm)->instructions == 5 + 1000 * 5 + 1);
+    assert(slices > 1000 / 2);
+    status = um_vm_run_for(vm, 7);
+    assert(status == EXEC_HALTED);
+    um_vm_free(&vm);
+
+    const uint32_t endless[] = {
+        encode_lv(1, 0),
+        encode_word(LOADP, 0, 0, 1)
+    };
+    vm = um_vm_new(endless, 2, 0, fileno(output));
+    for (uint64_t i = 1; i <= 3; i++) {
+        status = um_vm_run_for(vm, 100);
+        assert(status == EXEC_OUT_OF_BUDGET);
+        assert(um_vm_stats(vm)->instructions == 100 * i);
+        assert(um_vm_pc(vm) == 0);
+    }
+    um_vm_free(&vm);
+    fclose(output);
+}
+
+/* test_um_vm_blocked
+ *
+ *    Purpose: Test that an IN with nothing to read returns and resumes
+ *
+ * Parameters: None
+ *    Returns: None
+ *
+ *      Tests: A machine summing a non-blocking pipe stops on its IN, still
+ *             running, until bytes come, and halts once the pipe closes
+ *
+*/
+void test_um_vm_blocked()
+{
+    const uint32_t sum[] = {
+        encode_lv(5, 2),                        /* top */
+        encode_lv(6, 8),                        /* end */
+        encode_word(IN, 0, 0, 3),               /* top: in r3 */
+        encode_word(NAND, 4, 3, 3),             /* r4 = 0 at the end */
+        encode_word(ADD, 7, 6, 0),              /* r7 = end */
+        encode_word(CMOV, 7, 5, 4),             /* r7 = top if r4 */
+        encode_word(ADD, 1, 1, 3),              /* r1 += r3 */
+        encode_word(LOADP, 0, 0, 7),            /* loadp r7 */
+        encode_word(HALT, 0, 0, 0)              /* end: halt */
+    };
+    int ends[2];
+    int made = pipe(ends);
+    assert(made == 0);
+    int set = fcntl(ends[0], F_SETFL, O_NONBLOCK);
+    assert(set == 0);
+    FILE *output = tmpfile();
+    assert(output != NULL);
+
+    Um_vm_T vm = um_vm_new(sum, 9, ends[0], fileno(output));
+    assert(um_vm_input_fd(vm) == ends[0]);
+    Exec_status status = um_vm_run(vm);
+    assert(status == EXEC_BLOCKED);
+    assert(um_vm_status(vm) == EXEC_RUNNING);
+    assert(um_vm_pc(vm) == 2);
+    assert(um_vm_stats(vm)->instructions == 2);
+
+    ssize_t wrote = write(ends[1], "ab", 2);
+    assert(wrote == 2);
+    status = um_vm_run_for(vm, 1000);
+    assert(status == EXEC_BLOCKED);
+    assert(um_vm_pc(vm) == 2 && um_vm_registers(vm)[1] == 'a' + 'b');
+    status = um_vm_run(vm);
+    assert(status == EXEC_BLOCKED);
+
+    wrote = write(ends[1], "c", 1);
+    assert(wrote == 1);
+    close(ends[1]);
+    status = um_vm_run(vm);
+    assert(status == EXEC_HALTED);
+    assert(um_vm_pc(vm) == 8);
+
+    /* the EOF adds ~0, taking one off */
+    assert(um_vm_registers(vm)[1] == 'a' + 'b' + 'c' - 1);
+    assert(um_vm_stats(vm)->instructions == 2 + 4 * 6 + 1);
+    um_vm_free(&vm);
+    close(ends[0]);
+    fclose(output);
+}
+
+/* test_um_vm_long_blocks
+ *
+ *    Purpose: Test that the longest blocks fit where the JIT puts them
+ *
+ * Parameters: None
+ *    Returns: None
+ *
+ *      Tests: STORES stores into a mapped segment, the longest instruction
+ *             the JIT emits, entered by LOADP at ENTRIES offsets in turn, so
+ *             full blocks of them fill the code buffer over and over
+ *
+*/
+void test_um_vm_long_blocks()
+{
+    enum { STORES = 1243, ENTRIES = 1200, FIRST = 7 };
+    enum { AFTER = FIRST + STORES, END = AFTER + 5, LENGTH = END + 1 };
+    static uint32_t program[LENGTH];
+
+    program[0] = encode_lv(1, 8);
+    program[1] = encode_word(ACTIVATE, 0, 7, 1);    /* r7 = map 8 words */
+    program[2] = encode_lv(3, 1);
+    program[3] = encode_lv(2, ENTRIES);             /* entries left */
+    program[4] = encode_lv(4, FIRST);               /* next entry */
+    program[5] = encode_word(NAND, 1, 0, 0);        /* r1 = ~0 */
+    program[6] = encode_word(LOADP, 0, 0, 4);       /* loadp r4 */
+    for (int i = FIRST; i < AFTER; i++) {
+        program[i] = encode_word(SSTORE, 7, 6, 5);  /* m[r7][r6] = r5 */
+    }
+    program[AFTER] = encode_word(ADD, 4, 4, 3);         /* r4 += 1 */
+    program[AFTER + 1] = encode_word(ADD, 2, 2, 1);     /* r2 -= 1 */
+    program[AFTER + 2] = encode_lv(5, END);
+    program[AFTER + 3] = encode_word(CMOV, 5, 4, 2);    /* r5 = r4 if r2 */
+    program[AFTER + 4] = encode_word(LOADP, 0, 0, 5);   /* loadp r5 */
+    program[END] = encode_word(HALT, 0, 0, 0);
+
+    FILE *output = tmpfile();
+    assert(output != NULL);
+
+    Um_vm_T vm = um_vm_new(program, LENGTH, 0, fileno(output));
+    Exec_status status = um_vm_run(vm);
+    assert(status == EXEC_HALTED);
+    assert(um_vm_pc(vm) == END);
+    assert(um_vm_registers(vm)[2] == 0);
+    assert(um_vm_registers(vm)[4] == FIRST + ENTRIES);
+    um_vm_free(&vm);
+    fclose(output);
+}
+
+/* test_um_vm_selfmod
+ *
+ *    Purpose: Test a loop that rewrites an instruction of its own body
+ *
+ * Parameters: None
+ *    Returns: None
+ *
+ *      Tests: Each pass stores r1 += 1 and r1 += r1 over the instruction
+ *             after the store in turn, more times than the JIT translates
+ *             a word again, and every pass runs the word just stored
+ *
+*/
+void test_um_vm_selfmod()
+{
+    enum { TOP = 3, SLOT = 6, OUT = 17, ALT = OUT + 1, LENGTH = ALT + 2 };
+    const uint32_t program[LENGTH] = {
+        encode_lv(7, 1),
+        encode_lv(3, 10),                       /* passes left */
+        encode_lv(4, ALT),                      /* word to store next */
+        encode_word(SLOAD, 5, 0, 4),            /* top: r5 = m[0][r4] */
+        encode_lv(6, SLOT),
+        encode_word(SSTORE, 0, 6, 5),           /* m[0][slot] = r5 */
+        encode_word(HALT, 0, 0, 0),             /* slot */
+        encode_word(NAND, 2, 4, 4),
+        encode_word(ADD, 2, 2, 7),              /* r2 = -r4 */
+        encode_lv(5, 2 * ALT + 1),
+        encode_word(ADD, 4, 5, 2),              /* r4 = the other word */
+        encode_word(NAND, 2, 0, 0),
+        encode_word(ADD, 3, 3, 2),              /* r3 -= 1 */
+        encode_lv(5, TOP),
+        encode_lv(6, OUT),
+        encode_word(CMOV, 6, 5, 3),             /* r6 = top if r3 */
+        encode_word(LOADP, 0, 0, 6),            /* loadp r6 */
+        encode_word(HALT, 0, 0, 0),             /* out: halt */
+        encode_word(ADD, 1, 1, 7),              /* alt: r1 += 1 */
+        encode_word(ADD, 1, 1, 1)               /* r1 += r1 */
+    };
+    FILE *output = tmpfile();
+    assert(output != NULL);
+
+    Um_vm_T vm = um_vm_new(program, LENGTH, 0, fileno(output));
+    Exec_status status = um_vm_run(vm);
+    assert(status == EXEC_HALTED);
+    assert(um_vm_pc(vm) == OUT);
+    assert(um_vm_registers(vm)[1] == 62);
+    um_vm_free(&vm);
+    fclose(output);
+}
+
+/* static function definitions============================================== */
+
+/* run_fault
+ *
+ *    Purpose: Run a program that should fault and check where it stopped
+ *
+ * Parameters: The program, its length, the fault and its pc
+ *    Returns: None
+ *
+*/
+static void run_fault(const uint32_t *program, uint32_t length,
+                      Exec_status fault, uint32_t pc)
+{
+    FILE *output = tmpfile();
+    assert(output != NULL);
+
+    Um_vm_T vm = um_vm_new(program, length, 0, fileno(output));
+    Exec_status first = um_vm_run(vm);
+    assert(first == fault);
+    assert(um_vm_status(vm) == fault);
+    Exec_status again = um_vm_run(vm);
+    assert(again == fault);
+    assert(um_vm_pc(vm) == pc);
+    assert(um_vm_stats(vm)->instructions == pc);
+    um_vm_free(&vm);
+
+    /* nothing was written by the faulting OUT */
+    fseek(output, 0, SEEK_END);
+    assert(ftell(output) == 0);
+    fclose(output);
+}
@@ -0,0 +1,419 @@
+/*
+ * umbench.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Benchmark harness. Runs each program several times under a um binary
+ * and reports the median wall time, instructions per second and peak
+ * resident set size. For PROGRAM.um it feeds PROGRAM.0 as input when there
+ * is one and checks the output against PROGRAM.1 when there is one, the
+ * layout umlabwrite and umworkload both write. Instruction counts come from
+ * one extra run with um --stats.
+ *
+ * The results are written as JSON, one program per line. Given a baseline
+ * written the same way, every program whose median grew by more than the
+ * threshold is reported as a regression and the exit status is 1.
+ *
+ * Usage: umbench [-u um] [-n runs] [-o results.json] [-b baseline.json]
+ *                [-t percent] program.um ...
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+/* macros ================================================================== */
+#define MAX_RUNS 101
+#define NAME_LENGTH 256
+
+/* struct definition ======================================================= */
+typedef struct Result {
+    const char *path;
+    uint64_t instructions;
+    double median, fastest, slowest;   /* seconds */
+    long peak_rss;                     /* KiB */
+    const char *output;                /* "ok", "mismatch" or "unchecked" */
+} Result;
+
+/* function declarations =================================================== */
+static bool run_once(const char *um, const char *path, const char *stats,
+                     const char *output, double *seconds, long *rss);
+static bool bench(const char *um, const char *path, int runs,
+                  Result *result);
+static bool same_file(const char *a, const char *b);
+static char *sibling(const char *path, char suffix);
+static void write_result(FILE *out, const Result *result, bool last);
+static int compare_baseline(const char *baseline, const Result *results,
+                            int num_results, double threshold);
+static int compare_doubles(const void *a, const void *b);
+
+int main(int argc, char *argv[])
+{
+    const char *um = "./um";
+    const char *out_path = NULL;
+    const char *baseline = NULL;
+    double threshold = 5.0;
+    int runs = 5;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "u:n:o:b:t:")) != -1) {
+        switch (opt) {
+        case 'u': um = optarg;                  break;
+        case 'n': runs = atoi(optarg);          break;
+        case 'o': out_path = optarg;            break;
+        case 'b': baseline = optarg;            break;
+        case 't': threshold = atof(optarg);     break;
+        default:
+            fprintf(stderr, "Usage: %s [-u um] [-n runs] [-o results.json] "
+                            "[-b baseline.json] [-t percent] program.um "
+                            "...\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind == argc || runs < 1 || runs > MAX_RUNS) {
+        fprintf(stderr, "Need at least one program and 1 to %d runs\n",
+                MAX_RUNS);
+        return 1;
+    }
+
+    int num_results = argc - optind;
+    Result *results = calloc(num_results, sizeof(Result));
+    bool failed = false;
+
+    for (int i = 0; i < num_results; i++) {
+        if (!bench(um, argv[optind + i], runs, &results[i])) {
+            return 1;
+        }
+        Result *r = &results[i];
+        fprintf(stderr, "%-32s %10.3f s %10.1f M/s %8ld KiB  %s\n", r->path,
+                r->median, r->median > 0 ? r->instructions / r->median / 1e6
+                                         : 0.0,
+                r->peak_rss, r->output);
+        failed |= (strcmp(r->output, "mismatch") == 0);
+    }
+
+    FILE *out = stdout;
+    if (out_path != NULL && (out = fopen(out_path, "w")) == NULL) {
+        fprintf(stderr, "Could not open %s\n", out_path);
+        return 1;
+    }
+    fprintf(out, "{\"um\": \"%s\", \"runs\": %d, \"programs\": [\n", um,
+            runs);
+    for (int i = 0; i < num_results; i++) {
+        write_result(out, &results[i], i == num_results - 1);
+    }
+    fprintf(out, "]}\n");
+    if (out != stdout) {
+        fclose(out);
+    }
+
+    int regressions = 0;
+    if (baseline != NULL) {
+        regressions = compare_baseline(baseline, results, num_results,
+                                       threshold);
+        if (regressions < 0) {
+            return 1;
+        }
+    }
+
+    free(results);
+    return (failed || regressions > 0) ? 1 : 0;
+}
+
+/* bench
+ *
+ *      Purpose: Count one program's instructions, then time it runs times,
+ *               checking its output each time.
+ *
+ *   Parameters: The um binary, the program, how many timed runs, and where
+ *               to put the result.
+ *
+ *      Returns: false if the program could not be run or did not exit 0.
+ *
+ * Expectations: runs is between 1 and MAX_RUNS.
+*/
+static bool bench(const char *um, const char *path, int runs,
+                  Result *result)
+{
+    char stats[] = "/tmp/umbench-stats-XXXXXX";
+    char output[] = "/tmp/umbench-output-XXXXXX";
+    double times[MAX_RUNS];
+    char *expected = sibling(path, '1');
+    bool checked = (access(expected, R_OK) == 0);
+    bool ok = true;
+
+    close(mkstemp(stats));
+    close(mkstemp(output));
+
+    result->path = path;
+    result->output = checked ? "ok" : "unchecked";
+    result->peak_rss = 0;
+
+    /* the counting run doubles as a warm-up */
+    double seconds;
+    long rss;
+    ok = run_once(um, path, stats, output, &seconds, &rss);
+
+    FILE *fp = fopen(stats, "r");
+    unsigned long long instructions = 0;
+    if (ok && (fp == NULL ||
+               fscanf(fp, "instructions=%llu", &instructions) != 1)) {
+        fprintf(stderr, "%s did not report its counters for %s\n", um, path);
+        ok = false;
+    }
+    if (fp != NULL) {
+        fclose(fp);
+    }
+    result->instructions = instructions;
+
+    for (int i = 0; ok && i < runs; i++) {
+        ok = run_once(um, path, NULL, output, &times[i], &rss);
+        if (rss > result->peak_rss) {
+            result->peak_rss = rss;
+        }
+        if (ok && checked && !same_file(output, expected)) {
+            result->output = "mismatch";
+        }
+    }
+
+    if (ok) {
+        qsort(times, runs, sizeof(double), compare_doubles);
+        result->fastest = times[0];
+        result->slowest = times[runs - 1];
+        result->median = (runs % 2 == 1)
+                         ? times[runs / 2]
+                         : (times[runs / 2 - 1] + times[runs / 2]) / 2;
+    }
+
+    unlink(stats);
+    unlink(output);
+    free(expected);
+    return ok;
+}
+
+/* run_once
+ *
+ *      Purpose: Run um on a program with its input and time it.
+ *
+ *   Parameters: The um binary, the program, the file to have um write its
+ *               counters to or NULL, the file for its output, and where to
+ *               put the wall time and peak resident set size.
+ *
+ *      Returns: false if um could not be started or did not exit 0.
+ *
+ * Expectations: None
+*/
+static bool run_once(const char *um, const char *path, const char *stats,
+                     const char *output, double *seconds, long *rss)
+{
+    char *input = sibling(path, '0');
+    char stats_option[NAME_LENGTH + 16];
+    struct timespec start, end;
+    struct rusage usage;
+    int status;
+
+    if (stats != NULL) {
+        snprintf(stats_option, sizeof(stats_option), "--stats=%s", stats);
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t child = fork();
+    if (child == 0) {
+        int in = open(input, O_RDONLY);
+        if (in < 0) {
+            in = open("/dev/null", O_RDONLY);
+        }
+        int out = open(output, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+
+        if (stats != NULL) {
+            execl(um, um, stats_option, path, (char *)NULL);
+        } else {
+            execl(um, um, path, (char *)NULL);
+        }
+        _exit(127);
+    }
+    free(input);
+
+    if (child < 0 || wait4(child, &status, 0, &usage) != child) {
+        perror(um);
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    *seconds = (double)(end.tv_sec - start.tv_sec) +
+               (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    *rss = usage.ru_maxrss;
+
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s %s failed (status %d)\n", um, path, status);
+        return false;
+    }
+    return true;
+}
+
+/* same_file
+ *
+ *      Purpose: Compare two files byte for byte.
+ *
+ *   Parameters: Their paths.
+ *
+ *      Returns: true if both open and hold the same bytes.
+ *
+ * Expectations: None
+*/
+static bool same_file(const char *a, const char *b)
+{
+    FILE *fa = fopen(a, "rb");
+    FILE *fb = fopen(b, "rb");
+    bool same = (fa != NULL && fb != NULL);
+
+    while (same) {
+        int ca = getc(fa);
+        int cb = getc(fb);
+        same = (ca == cb);
+        if (ca == EOF) {
+            break;
+        }
+    }
+
+    if (fa != NULL) {
+        fclose(fa);
+    }
+    if (fb != NULL) {
+        fclose(fb);
+    }
+    return same;
+}
+
+/* sibling
+ *
+ *      Purpose: Name the input or expected output file of a program.
+ *
+ *   Parameters: Path of the program and the suffix digit, '0' for input and
+ *               '1' for expected output.
+ *
+ *      Returns: The path with .um (if present) replaced by the suffix. The
+ *               caller frees it.
+ *
+ * Expectations: None
+*/
+static char *sibling(const char *path, char suffix)
+{
+    size_t length = strlen(path);
+    char *name = malloc(length + 3);
+
+    if (length > 3 && strcmp(path + length - 3, ".um") == 0) {
+        length -= 3;
+    }
+    memcpy(name, path, length);
+    name[length] = '.';
+    name[length + 1] = suffix;
+    name[length + 2] = '\0';
+    return name;
+}
+
+/* write_result
+ *
+ *      Purpose: Write one program's result as a line of JSON.
+ *
+ *   Parameters: Stream, the result, and whether it is the last one.
+ *
+ *      Returns: None
+ *
+ * Expectations: Paths don't need escaping.
+*/
+static void write_result(FILE *out, const Result *result, bool last)
+{
+    double mips = result->median > 0
+                  ? (double)result->instructions / result->median / 1e6
+                  : 0.0;
+
+    fprintf(out, "  {\"name\": \"%s\", \"median_seconds\": %.6f, "
+            "\"min_seconds\": %.6f, \"max_seconds\": %.6f, "
+            "\"instructions\": %llu, \"mips\": %.2f, \"peak_rss_kib\": %ld, "
+            "\"output\": \"%s\"}%s\n", result->path, result->median,
+            result->fastest, result->slowest,
+            (unsigned long long)result->instructions, mips,
+            result->peak_rss, result->output, last ? "" : ",");
+}
+
+/* compare_baseline
+ *
+ *      Purpose: Compare medians against a baseline written by umbench and
+ *               report what got slower by more than the threshold.
+ *
+ *   Parameters: Path of the baseline, the results, how many, and the
+ *               threshold in percent.
+ *
+ *      Returns: How many programs regressed, or -1 if the baseline can't be
+ *               read. Programs missing from the baseline are skipped.
+ *
+ * Expectations: The baseline has one program per line, as write_result
+ *               writes them.
+*/
+static int compare_baseline(const char *baseline, const Result *results,
+                            int num_results, double threshold)
+{
+    FILE *in = fopen(baseline, "r");
+    if (in == NULL) {
+        fprintf(stderr, "Could not open %s\n", baseline);
+        return -1;
+    }
+
+    char line[1024];
+    char name[NAME_LENGTH];
+    double median;
+    int regressions = 0;
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+        if (sscanf(line, " {\"name\": \"%255[^\"]\", \"median_seconds\": %lf",
+                   name, &median) != 2) {
+            continue;
+        }
+
+        for (int i = 0; i < num_results; i++) {
+            if (strcmp(results[i].path, name) != 0 || median <= 0) {
+                continue;
+            }
+
+            double change = 100.0 * (results[i].median - median) / median;
+            bool regressed = change > threshold;
+            regressions += regressed;
+            fprintf(stderr, "%-32s %10.3f s -> %10.3f s %+7.1f%%%s\n", name,
+                    median, results[i].median, change,
+                    regressed ? "  REGRESSION" : "");
+        }
+    }
+
+    fclose(in);
+    return regressions;
+}
+
+/* compare_doubles
+ *
+ *      Purpose: Order wall times for qsort.
+ *
+ *   Parameters: Pointers to two doubles.
+ *
+ *      Returns: Negative, zero or positive as the first is less, equal or
+ *               greater.
+ *
+ * Expectations: None
+*/
+static int compare_doubles(const void *a, const void *b)
+{
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
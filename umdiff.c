@@ -0,0 +1,625 @@
+/*
+ * umdiff.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Differential runner. Runs a program under two engines at once, each in a
+ * child process, and compares the instructions retired, the pc, the
+ * registers and a digest of every mapped segment (segment_digest) at a
+ * LOADP or HALT once every interval instructions, and where each stops,
+ * which may be a fault, then the output. Engines only bring their state up
+ * to date at LOADP and HALT (see Exec_checkpoint in um_execution.h), so a
+ * divergence is narrowed down by running both again from the last
+ * checkpoint that matched, comparing at every LOADP, to the first
+ * straight-line block whose end state differs.
+ * The reference engine then lists that block, marking the instructions
+ * that write the state that differs.
+ *
+ * Usage: umdiff [-r engine] [-e engine] [-n interval] program.um [input]
+ *
+ * where engines are switch (the default reference), threaded and native
+ * (the default under test, where available). Exits 0 when the engines
+ * agree, 1 when they don't and 2 when they can't be run.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "um_initialize.h"
+#include "um_execution.h"
+#include "um_jit.h"
+#include "um_io.h"
+
+/* macros ================================================================== */
+#define DEFAULT_INTERVAL 1000000
+
+/* struct definition ======================================================= */
+typedef Exec_status (*Engine)(Memory_T program, uint32_t *registers,
+                              int *prog_counter, Io_T io, Exec_stats *stats);
+
+/* the state a child reports at a checkpoint */
+typedef struct Record {
+    uint64_t instructions;
+    uint64_t digest;
+    uint32_t registers[8];
+    uint32_t pc;            /* of the LOADP, HALT or fault */
+    uint32_t block_start;   /* where the block ending here started */
+    uint32_t status;        /* EXEC_RUNNING at a LOADP */
+} Record;
+
+/* a running engine */
+typedef struct Child {
+    const char *engine;
+    pid_t pid;
+    int records;            /* read end of its pipe */
+    char output[32];        /* file its output goes to */
+} Child;
+
+static const struct {
+    const char *name;
+    Engine run;
+} engines[] = {
+    { "switch", execute_switch },
+#ifdef UM_HAVE_THREADED
+    { "threaded", execute_threaded },
+#endif
+#ifdef UM_HAVE_JIT
+    { "native", execute_jit },
+#endif
+};
+
+#define NUM_ENGINES (int)(sizeof(engines) / sizeof(engines[0]))
+
+static const char *opcode_names[17] = {
+    "?", "cmov", "sload", "sstore", "add", "mul", "div", "nand", "halt",
+    "map", "unmap", "out", "in", "loadp", "lv", "op14", "op15"
+};
+
+/* settings of the child, read by its checkpoint */
+static int child_pipe;
+static uint64_t child_interval;
+static uint64_t child_list_at;      /* list the block ending here, or 0 */
+static uint32_t child_list_pc;
+static struct {
+    bool pc, segments, registers[8];
+} child_differs;                    /* what the engines disagree on */
+static uint32_t child_block_start;
+
+/* function declarations =================================================== */
+static Engine find_engine(const char *name);
+static bool start(Child *child, const char *engine, const char *program,
+                  const char *input, uint64_t first, uint64_t interval);
+static void stop(Child *child, bool clean_up);
+static void checkpoint(Exec_stats *stats, Memory_T memory,
+                       const uint32_t *registers, uint32_t pc);
+static void list(Memory_T memory, uint32_t block_start, uint32_t pc,
+                 uint64_t instructions);
+static bool same(const Record *a, const Record *b);
+static bool read_record(Child *child, Record *record);
+static int compare(const char *reference, const char *test,
+                   const char *program, const char *input,
+                   uint64_t interval);
+static void report(const Child *children, const Record *a, const Record *b);
+static void list_block(const char *reference, const char *program,
+                       const char *input, const Record *a, const Record *b);
+static long first_difference(const char *a, const char *b);
+
+int main(int argc, char *argv[])
+{
+    const char *reference = "switch";
+    const char *test = engines[NUM_ENGINES - 1].name;
+    uint64_t interval = DEFAULT_INTERVAL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "r:e:n:")) != -1) {
+        switch (opt) {
+        case 'r': reference = optarg;                           break;
+        case 'e': test = optarg;                                break;
+        case 'n': interval = strtoull(optarg, NULL, 0);         break;
+        default:
+            fprintf(stderr, "Usage: %s [-r engine] [-e engine] "
+                            "[-n interval] program.um [input]\n", argv[0]);
+            return 2;
+        }
+    }
+    if (argc - optind < 1 || argc - optind > 2 || interval == 0) {
+        fprintf(stderr, "Usage: %s [-r engine] [-e engine] [-n interval] "
+                        "program.um [input]\n", argv[0]);
+        return 2;
+    }
+    if (find_engine(reference) == NULL || find_engine(test) == NULL) {
+        fprintf(stderr, "Engines built in:");
+        for (int i = 0; i < NUM_ENGINES; i++) {
+            fprintf(stderr, " %s", engines[i].name);
+        }
+        fprintf(stderr, "\n");
+        return 2;
+    }
+
+    const char *input = (argc - optind == 2) ? argv[optind + 1]
+                                             : "/dev/null";
+    signal(SIGPIPE, SIG_IGN);
+    return compare(reference, test, argv[optind], input, interval);
+}
+
+/* compare
+ *
+ *      Purpose: Run both engines checkpoint by checkpoint and, when they
+ *               part ways, narrow it down to a block and list it.
+ *
+ *   Parameters: The two engines, the program, its input, and how many
+ *               instructions to let go by between checkpoints.
+ *
+ *      Returns: 0 if the engines agree, 1 if not, 2 if they can't be run.
+ *
+ * Expectations: Both engines are built in.
+*/
+static int compare(const char *reference, const char *test,
+                   const char *program, const char *input,
+                   uint64_t interval)
+{
+    Child children[2];
+    Record a, b;
+    uint64_t agreed = 0;        /* instructions at the last match */
+    uint64_t checkpoints = 0;
+
+    /* first at the given interval, then at every LOADP past the match */
+    for (int pass = 0; pass < 2; pass++) {
+        if (!start(&children[0], reference, program, input,
+                   pass == 0 ? interval : agreed, pass == 0 ? interval : 1) ||
+            !start(&children[1], test, program, input,
+                   pass == 0 ? interval : agreed, pass == 0 ? interval : 1)) {
+            return 2;
+        }
+
+        bool got_a, got_b;
+        while (true) {
+            got_a = read_record(&children[0], &a);
+            got_b = read_record(&children[1], &b);
+            if (!got_a || !got_b || !same(&a, &b) ||
+                a.status != EXEC_RUNNING) {
+                break;
+            }
+            agreed = a.instructions;
+            checkpoints++;
+        }
+
+        if (got_a && got_b && same(&a, &b)) {
+            /* both stopped in the same state; outputs are all that's left */
+            stop(&children[0], false);
+            stop(&children[1], false);
+            long at = first_difference(children[0].output,
+                                       children[1].output);
+            unlink(children[0].output);
+            unlink(children[1].output);
+
+            if (at >= 0) {
+                printf("outputs differ at byte %ld\n", at);
+                return 1;
+            }
+            printf("%s and %s agree: %llu instructions, %llu checkpoints",
+                   reference, test, (unsigned long long)a.instructions,
+                   (unsigned long long)checkpoints + 1);
+            if (a.status != EXEC_HALTED) {
+                printf(", both stopping on %s at pc %u",
+                       exec_status_name(a.status), a.pc);
+            }
+            printf("\n");
+            return 0;
+        }
+
+        if (pass == 1) {
+            report(children, got_a ? &a : NULL, got_b ? &b : NULL);
+            if (got_a && got_b) {
+                list_block(reference, program, input, &a, &b);
+            }
+        }
+        stop(&children[0], true);
+        stop(&children[1], true);
+    }
+
+    return 1;
+}
+
+/* start
+ *
+ *      Purpose: Start an engine on the program in a child process.
+ *
+ *   Parameters: The child to fill in, the engine, the program, its input,
+ *               the first instruction count to report at, and the interval
+ *               after that.
+ *
+ *      Returns: false if the child could not be started.
+ *
+ * Expectations: None
+*/
+static bool start(Child *child, const char *engine, const char *program,
+                  const char *input, uint64_t first, uint64_t interval)
+{
+    int fds[2];
+    strcpy(child->output, "/tmp/umdiff-XXXXXX");
+    int out = mkstemp(child->output);
+
+    if (out < 0 || pipe(fds) != 0) {
+        perror("umdiff");
+        return false;
+    }
+
+    fflush(stdout);
+    child->engine = engine;
+    child->pid = fork();
+    if (child->pid == 0) {
+        close(fds[0]);
+        child_pipe = fds[1];
+        child_interval = interval;
+        child_list_at = 0;
+
+        struct stat st;
+        FILE *fp = fopen(program, "rb");
+        if (fp == NULL || stat(program, &st) != 0) {
+            _exit(2);
+        }
+        Memory_T memory = initialize(fp, st.st_size / 4);
+        fclose(fp);
+
+        int in = open(input, O_RDONLY);
+        Io_T io = io_new(in, out);
+        uint32_t registers[8] = { 0 };
+        int prog_counter = 0;
+        Exec_stats stats = { 0 };
+        stats.checkpoint = checkpoint;
+        stats.next_checkpoint = first;
+
+        Exec_status status = find_engine(engine)(memory, registers,
+                                                 &prog_counter, io, &stats);
+        io_free(&io);
+
+        /* where the run ends, at HALT or a fault, is always reported, even
+         * short of the next checkpoint */
+        Record record = { stats.instructions, segment_digest(memory),
+                          { 0 }, (uint32_t)prog_counter, child_block_start,
+                          status };
+        memcpy(record.registers, registers, sizeof(record.registers));
+        if (write(child_pipe, &record, sizeof(record)) != sizeof(record)) {
+            _exit(2);
+        }
+        _exit(0);
+    }
+
+    close(fds[1]);
+    close(out);
+    child->records = fds[0];
+    return child->pid > 0;
+}
+
+/* stop
+ *
+ *      Purpose: Wait for a child, killing it first if it is still running
+ *               past the point of interest, and close its pipe.
+ *
+ *   Parameters: The child and whether to kill it and remove its output.
+ *
+ *      Returns: None
+ *
+ * Expectations: None
+*/
+static void stop(Child *child, bool clean_up)
+{
+    if (clean_up) {
+        kill(child->pid, SIGKILL);
+        unlink(child->output);
+    }
+    waitpid(child->pid, NULL, 0);
+    close(child->records);
+}
+
+/* checkpoint
+ *
+ *      Purpose: In a child, send the state at a LOADP to the parent, or
+ *               list the block that ends at a LOADP or HALT when asked to.
+ *
+ *   Parameters: The counters, memory, registers and pc of the LOADP or
+ *               HALT, as Exec_checkpoint.
+ *
+ *      Returns: None
+ *
+ * Expectations: Runs in a child started by start or list_block.
+*/
+static void checkpoint(Exec_stats *stats, Memory_T memory,
+                       const uint32_t *registers, uint32_t pc)
+{
+    const uint32_t *words = segment_words(memory, 0);
+    struct Instruction_T last = decode_word(words[pc]);
+    Record record;
+
+    record.instructions = stats->instructions;
+    record.pc = pc;
+    record.block_start = child_block_start;
+    record.status = (last.opcode == HALT) ? EXEC_HALTED : EXEC_RUNNING;
+    memcpy(record.registers, registers, sizeof(record.registers));
+    record.digest = segment_digest(memory);
+
+    /* start sends the record of a HALT, once the engine has returned */
+    if (record.status == EXEC_HALTED && child_list_at == 0) {
+        return;
+    }
+
+    /* a LOADP jumps to r[C], where the next block starts */
+    child_block_start = registers[last.register_C];
+    stats->next_checkpoint = stats->instructions + child_interval;
+
+    if (child_list_at == 0) {
+        if (write(child_pipe, &record, sizeof(record)) != sizeof(record)) {
+            _exit(2);
+        }
+        return;
+    }
+    if (record.instructions == child_list_at && pc == child_list_pc) {
+        list(memory, record.block_start, pc, record.instructions);
+        _exit(0);
+    }
+}
+
+/* list
+ *
+ *      Purpose: Print the block the engines part ways in, marking the
+ *               instructions that write state they disagree on.
+ *
+ *   Parameters: Memory, where the block starts, the pc it ends at, and
+ *               the instructions retired there.
+ *
+ *      Returns: None
+ *
+ * Expectations: Runs in the child started by list_block.
+*/
+static void list(Memory_T memory, uint32_t block_start, uint32_t pc,
+                 uint64_t instructions)
+{
+    const uint32_t *words = segment_words(memory, 0);
+
+    printf("\nblock run by the reference, ending at instruction %llu:\n",
+           (unsigned long long)instructions);
+    for (uint32_t at = block_start; at <= pc; at++) {
+        struct Instruction_T i = decode_word(words[at]);
+
+        /* marks what writes state the engines disagree on */
+        int writes = -1;
+        switch (i.opcode) {
+        case CMOV: case SLOAD: case ADD: case MUL: case DIV: case NAND:
+        case LV:        writes = i.register_A; break;
+        case ACTIVATE:  writes = i.register_B; break;
+        case IN:        writes = i.register_C; break;
+        default:        break;
+        }
+        bool suspect =
+            (writes >= 0 && child_differs.registers[writes]) ||
+            (child_differs.segments &&
+             (i.opcode == SSTORE || i.opcode == ACTIVATE ||
+              i.opcode == INACTIVATE)) ||
+            (child_differs.pc && at == pc);
+
+        if (i.opcode == LV) {
+            printf("%s %10u  lv r%u, %u\n", suspect ? ">>" : "  ", at,
+                   i.register_A, i.value);
+        } else {
+            printf("%s %10u  %s r%u, r%u, r%u\n", suspect ? ">>" : "  ",
+                   at, opcode_names[i.opcode], i.register_A, i.register_B,
+                   i.register_C);
+        }
+    }
+    fflush(stdout);
+}
+
+/* same
+ *
+ *      Purpose: Compare two checkpoints.
+ *
+ *   Parameters: The checkpoints.
+ *
+ *      Returns: true if every field the engines are held to matches.
+ *
+ * Expectations: None
+*/
+static bool same(const Record *a, const Record *b)
+{
+    return a->instructions == b->instructions && a->pc == b->pc &&
+           a->digest == b->digest && a->status == b->status &&
+           memcmp(a->registers, b->registers, sizeof(a->registers)) == 0;
+}
+
+/* read_record
+ *
+ *      Purpose: Read the next checkpoint from a child.
+ *
+ *   Parameters: The child and where to put the checkpoint.
+ *
+ *      Returns: false if the child stopped without sending one.
+ *
+ * Expectations: None
+*/
+static bool read_record(Child *child, Record *record)
+{
+    size_t got = 0;
+
+    while (got < sizeof(*record)) {
+        ssize_t n = read(child->records, (char *)record + got,
+                         sizeof(*record) - got);
+        if (n <= 0) {
+            return false;
+        }
+        got += n;
+    }
+    return true;
+}
+
+/* report
+ *
+ *      Purpose: Print what differs at the first checkpoint that doesn't
+ *               match.
+ *
+ *   Parameters: The two children and their checkpoints, NULL for one that
+ *               stopped without sending it.
+ *
+ *      Returns: None
+ *
+ * Expectations: At least one checkpoint is NULL or they differ.
+*/
+static void report(const Child *children, const Record *a, const Record *b)
+{
+    if (a == NULL || b == NULL) {
+        const Child *gone = (a == NULL) ? &children[0] : &children[1];
+        const Record *other = (a == NULL) ? b : a;
+        printf("%s stopped", gone->engine);
+        if (other != NULL) {
+            printf(" where %s reached instruction %llu at pc %u",
+                   (a == NULL) ? children[1].engine : children[0].engine,
+                   (unsigned long long)other->instructions, other->pc);
+        }
+        printf("\n");
+        return;
+    }
+
+    printf("%s and %s part ways in the block from pc %u", children[0].engine,
+           children[1].engine, a->block_start);
+    printf(" (instructions up to %llu and %llu)\n",
+           (unsigned long long)a->instructions,
+           (unsigned long long)b->instructions);
+    if (a->status != b->status) {
+        printf("  stopped:  %s, %s\n", a->status == EXEC_RUNNING ?
+               "no" : exec_status_name(a->status),
+               b->status == EXEC_RUNNING ? "no" : exec_status_name(b->status));
+    }
+    if (a->pc != b->pc) {
+        printf("  pc:      %10u %10u\n", a->pc, b->pc);
+    }
+    for (int i = 0; i < 8; i++) {
+        if (a->registers[i] != b->registers[i]) {
+            printf("  r%d:      %10u %10u\n", i, a->registers[i],
+                   b->registers[i]);
+        }
+    }
+    if (a->digest != b->digest) {
+        printf("  segments: %016llx %016llx\n",
+               (unsigned long long)a->digest, (unsigned long long)b->digest);
+    }
+}
+
+/* list_block
+ *
+ *      Purpose: Run the reference once more, up to the block the engines
+ *               part ways in, and have it list that block.
+ *
+ *   Parameters: The reference engine, the program, its input, and the two
+ *               checkpoints that differ.
+ *
+ *      Returns: None
+ *
+ * Expectations: The checkpoints come from the same point in the program.
+*/
+static void list_block(const char *reference, const char *program,
+                       const char *input, const Record *a, const Record *b)
+{
+    child_differs.pc = (a->pc != b->pc);
+    child_differs.segments = (a->digest != b->digest);
+    for (int i = 0; i < 8; i++) {
+        child_differs.registers[i] = (a->registers[i] != b->registers[i]);
+    }
+
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0) {
+        child_interval = 1;
+        child_list_at = a->instructions;
+        child_list_pc = a->pc;
+
+        struct stat st;
+        FILE *fp = fopen(program, "rb");
+        if (fp == NULL || stat(program, &st) != 0) {
+            _exit(2);
+        }
+        Memory_T memory = initialize(fp, st.st_size / 4);
+        fclose(fp);
+
+        Io_T io = io_new(open(input, O_RDONLY), open("/dev/null", O_WRONLY));
+        uint32_t registers[8] = { 0 };
+        int prog_counter = 0;
+        Exec_stats stats = { 0 };
+        stats.checkpoint = checkpoint;
+        stats.next_checkpoint = 0;
+
+        Exec_status status = find_engine(reference)(memory, registers,
+                                                    &prog_counter, io,
+                                                    &stats);
+        if (status != EXEC_HALTED && stats.instructions == child_list_at) {
+            list(memory, child_block_start, prog_counter,
+                 stats.instructions);
+        }
+        _exit(0);
+    }
+    waitpid(pid, NULL, 0);
+}
+
+/* first_difference
+ *
+ *      Purpose: Compare two output files.
+ *
+ *   Parameters: Their paths.
+ *
+ *      Returns: Offset of the first byte that differs, -1 if none does.
+ *
+ * Expectations: Both files exist.
+*/
+static long first_difference(const char *a, const char *b)
+{
+    FILE *fa = fopen(a, "rb");
+    FILE *fb = fopen(b, "rb");
+    long at = -1;
+
+    for (long i = 0; fa != NULL && fb != NULL; i++) {
+        int ca = getc(fa);
+        int cb = getc(fb);
+        if (ca != cb) {
+            at = i;
+            break;
+        }
+        if (ca == EOF) {
+            break;
+        }
+    }
+
+    if (fa != NULL) {
+        fclose(fa);
+    }
+    if (fb != NULL) {
+        fclose(fb);
+    }
+    return at;
+}
+
+/* find_engine
+ *
+ *      Purpose: Look up an engine by name.
+ *
+ *   Parameters: The name.
+ *
+ *      Returns: The engine, or NULL if none by that name is built in.
+ *
+ * Expectations: None
+*/
+static Engine find_engine(const char *name)
+{
+    for (int i = 0; i < NUM_ENGINES; i++) {
+        if (strcmp(engines[i].name, name) == 0) {
+            return engines[i].run;
+        }
+    }
+    return NULL;
+}
@@ -346,10 +346,313 @@ void build_segment_load_test(Seq_T stream)
 }
 
 
+/*
+ * Benchmark workloads. Unlike the unit tests above these are built from
+ * parameters, loop with LOADP instead of running straight through, and
+ * return what they will print (or leave the printing to the caller, for
+ * the filter), so umworkload.c can write the expected output next to them.
+ *
+ * Every workload keeps r0 at 0, so load_program(r0, r0, rX) jumps to the
+ * offset in rX, and loops count r2 down to 0. A loop ends with
+ * loop_back(), which jumps to the top while r2 is nonzero.
+ */
+
+/* loads any 32-bit value, using tmp when it doesn't fit in 25 bits */
+static void load_constant(Seq_T stream, Um_register reg, Um_register tmp,
+                          uint32_t value)
+{
+        if (value < (1u << 25)) {
+                append(stream, loadval(reg, value));
+                return;
+        }
+
+        append(stream, loadval(reg, value >> 16));
+        append(stream, loadval(tmp, 1u << 16));
+        append(stream, multiply(reg, reg, tmp));
+        append(stream, loadval(tmp, value & 0xffff));
+        append(stream, add(reg, reg, tmp));
+}
+
+/* r2 = r2 - 1, then jump to top unless r2 is 0; clobbers r6 and r7 */
+static void loop_back(Seq_T stream, uint32_t top)
+{
+        append(stream, bitwise_nand(r7, r0, r0));
+        append(stream, add(r2, r2, r7));
+
+        /* the jump falls through to just past itself when r2 is 0 */
+        uint32_t exit = Seq_length(stream) + 4;
+        append(stream, loadval(r6, exit));
+        append(stream, loadval(r7, top));
+        append(stream, conditional_move(r6, r7, r2));
+        append(stream, load_program(r0, r0, r6));
+}
+
+/* reg = reg & mask, for a mask that fits in 25 bits; clobbers tmp */
+static void and_mask(Seq_T stream, Um_register reg, Um_register tmp,
+                     uint32_t mask)
+{
+        append(stream, loadval(tmp, mask));
+        append(stream, bitwise_nand(reg, reg, tmp));
+        append(stream, bitwise_nand(reg, reg, reg));
+}
+
+/* prints value as 4 bytes, most significant first; clobbers r4 to r6 */
+static void output_word(Seq_T stream, Um_register value)
+{
+        for (int shift = 24; shift >= 0; shift -= 8) {
+                /* r4 = (value >> shift) % 256, by way of division */
+                append(stream, loadval(r5, 1u << shift));
+                append(stream, divide(r4, value, r5));
+                append(stream, loadval(r6, 256));
+                append(stream, divide(r5, r4, r6));
+                append(stream, multiply(r5, r5, r6));
+                append(stream, bitwise_nand(r5, r5, r5));
+                append(stream, add(r4, r4, r5));
+                append(stream, loadval(r6, 1));
+                append(stream, add(r4, r4, r6));
+                append(stream, output(r4));
+        }
+}
+
+/*
+ * Arithmetic loop: iterations passes over ops multiply, add, nand and
+ * negate steps on an accumulator, then the accumulator is printed
+ */
+uint32_t build_arith_workload(Seq_T stream, uint32_t iterations, int ops)
+{
+        uint32_t acc = 1;
+
+        assert(iterations > 0 && ops > 0);
+        append(stream, loadval(r1, 1));
+        append(stream, loadval(r3, 1));
+        append(stream, loadval(r5, 69069));
+        load_constant(stream, r2, r4, iterations);
+
+        uint32_t top = Seq_length(stream);
+        for (int i = 0; i < ops; i++) {
+                switch (i % 4) {
+                case 0:
+                        append(stream, multiply(r1, r1, r5));
+                        break;
+                case 1:
+                        append(stream, add(r1, r1, r2));
+                        break;
+                case 2:
+                        append(stream, bitwise_nand(r4, r1, r5));
+                        append(stream, add(r1, r1, r4));
+                        break;
+                default:
+                        append(stream, bitwise_nand(r1, r1, r1));
+                        append(stream, add(r1, r1, r3));
+                        break;
+                }
+        }
+        loop_back(stream, top);
+
+        output_word(stream, r1);
+        append(stream, halt());
+
+        /* the same steps, in C */
+        for (uint32_t n = iterations; n > 0; n--) {
+                for (int i = 0; i < ops; i++) {
+                        switch (i % 4) {
+                        case 0:  acc *= 69069;              break;
+                        case 1:  acc += n;                  break;
+                        case 2:  acc += ~(acc & 69069);     break;
+                        default: acc = ~acc + 1;            break;
+                        }
+                }
+        }
+        return acc;
+}
+
+/*
+ * MAP/UNMAP churn: a ring of live segments, each iteration unmapping one
+ * and mapping a replacement whose size comes from sizes, the table being
+ * kept in segment 0 after the code. The sum of the sizes is printed.
+ * live and num_sizes must be powers of two and sizes at least 1.
+ */
+uint32_t build_churn_workload(Seq_T stream, uint32_t iterations,
+                              uint32_t live, const uint32_t *sizes,
+                              uint32_t num_sizes)
+{
+        uint32_t sum = 0;
+
+        assert(iterations > 0);
+        assert(live > 0 && (live & (live - 1)) == 0 && live < (1u << 25));
+        assert(num_sizes > 0 && (num_sizes & (num_sizes - 1)) == 0);
+
+        /* r3 holds the ring, filled with one-word segments to begin with */
+        append(stream, loadval(r5, live));
+        append(stream, map_segment(r0, r3, r5));
+        append(stream, loadval(r5, 1));
+        for (uint32_t i = 0; i < live; i++) {
+                append(stream, map_segment(r0, r6, r5));
+                append(stream, loadval(r4, i));
+                append(stream, segment_store(r3, r4, r6));
+        }
+        append(stream, loadval(r1, 0));
+        load_constant(stream, r2, r4, iterations);
+
+        /* the table sits just past the halt; its offset is patched in */
+        uint32_t top = Seq_length(stream);
+        append(stream, add(r4, r2, r0));
+        and_mask(stream, r4, r5, live - 1);
+        append(stream, segment_load(r5, r3, r4));
+        append(stream, unmap_segment(r0, r0, r5));
+
+        append(stream, add(r5, r2, r0));
+        and_mask(stream, r5, r6, num_sizes - 1);
+        uint32_t table_at = Seq_length(stream);
+        append(stream, loadval(r6, 0));
+        append(stream, add(r5, r5, r6));
+        append(stream, segment_load(r5, r0, r5));
+
+        append(stream, map_segment(r0, r6, r5));
+        append(stream, segment_store(r3, r4, r6));
+        append(stream, segment_store(r6, r0, r5));
+        append(stream, segment_load(r7, r6, r0));
+        append(stream, add(r1, r1, r7));
+        loop_back(stream, top);
+
+        output_word(stream, r1);
+        append(stream, halt());
 
+        uint32_t table = Seq_length(stream);
+        assert(table < (1u << 25));
+        Seq_put(stream, table_at, (void *)(uintptr_t)loadval(r6, table));
+        for (uint32_t i = 0; i < num_sizes; i++) {
+                assert(sizes[i] > 0);
+                append(stream, sizes[i]);
+        }
+
+        for (uint32_t n = iterations; n > 0; n--) {
+                sum += sizes[n & (num_sizes - 1)];
+        }
+        return sum;
+}
+
+/*
+ * Computed jumps: each iteration jumps through LOADP to one of targets
+ * stubs, picked by the counter, which adds its addend and jumps back. The
+ * sum is printed. targets must be a power of two and addends below 2^25.
+ */
+uint32_t build_jump_workload(Seq_T stream, uint32_t iterations,
+                             uint32_t targets, const uint32_t *addends)
+{
+        const uint32_t stub_length = 4;
+        uint32_t sum = 0;
+
+        assert(iterations > 0);
+        assert(targets > 0 && (targets & (targets - 1)) == 0);
+
+        append(stream, loadval(r1, 0));
+        append(stream, loadval(r3, stub_length));
+        load_constant(stream, r2, r4, iterations);
+
+        /* the stubs sit just past the halt; their offset is patched in */
+        uint32_t top = Seq_length(stream);
+        append(stream, add(r4, r2, r0));
+        and_mask(stream, r4, r5, targets - 1);
+        append(stream, multiply(r4, r4, r3));
+        uint32_t stubs_at = Seq_length(stream);
+        append(stream, loadval(r5, 0));
+        append(stream, add(r4, r4, r5));
+        append(stream, load_program(r0, r0, r4));
+
+        /* the stubs come back to here */
+        uint32_t back = Seq_length(stream);
+        loop_back(stream, top);
+        output_word(stream, r1);
+        append(stream, halt());
 
+        uint32_t stubs = Seq_length(stream);
+        assert(stubs + targets * stub_length < (1u << 25));
+        Seq_put(stream, stubs_at, (void *)(uintptr_t)loadval(r5, stubs));
 
+        for (uint32_t i = 0; i < targets; i++) {
+                assert(addends[i] < (1u << 25));
+                append(stream, loadval(r5, addends[i]));
+                append(stream, add(r1, r1, r5));
+                append(stream, loadval(r6, back));
+                append(stream, load_program(r0, r0, r6));
+        }
 
+        for (uint32_t n = iterations; n > 0; n--) {
+                sum += addends[n & (targets - 1)];
+        }
+        return sum;
+}
 
+/*
+ * Self-modifying code: each iteration rewrites a loadval further down the
+ * loop to load the low 16 bits of the counter, then runs it. The sum of
+ * what it loaded is printed.
+ */
+uint32_t build_selfmod_workload(Seq_T stream, uint32_t iterations)
+{
+        uint32_t sum = 0;
+
+        assert(iterations > 0);
+        append(stream, loadval(r1, 0));
+        load_constant(stream, r2, r4, iterations);
+
+        uint32_t top = Seq_length(stream);
+        uint32_t patched = top + 10;
+
+        /* r4 = loadval(r5, 0), built up since it needs all 32 bits */
+        append(stream, loadval(r4, ((LV << 3) | r5) << 1));
+        append(stream, loadval(r6, 1u << 24));
+        append(stream, multiply(r4, r4, r6));
+        append(stream, add(r6, r2, r0));
+        and_mask(stream, r6, r7, 0xffff);
+        append(stream, add(r4, r4, r6));
+        append(stream, loadval(r6, patched));
+        append(stream, segment_store(r0, r6, r4));
+        assert((uint32_t)Seq_length(stream) == patched);
+        append(stream, loadval(r5, 0));
+        append(stream, add(r1, r1, r5));
+        loop_back(stream, top);
+
+        output_word(stream, r1);
+        append(stream, halt());
 
+        for (uint32_t n = iterations; n > 0; n--) {
+                sum += n & 0xffff;
+        }
+        return sum;
+}
 
+/*
+ * I/O filter: copies input to output a byte at a time, XORing each byte
+ * with key, until end of input
+ */
+void build_filter_workload(Seq_T stream, uint32_t key)
+{
+        assert(key < 256);
+        append(stream, loadval(r5, key));
+        append(stream, loadval(r3, 1));
+
+        uint32_t top = Seq_length(stream);
+        uint32_t body = top + 6;
+        uint32_t exit = body + 7;
+
+        /* r4 is 0 only at end of input, where IN gives all ones */
+        append(stream, input(r0, r0, r2));
+        append(stream, add(r4, r2, r3));
+        append(stream, loadval(r6, exit));
+        append(stream, loadval(r7, body));
+        append(stream, conditional_move(r6, r7, r4));
+        append(stream, load_program(r0, r0, r6));
+
+        /* r4 = r2 ^ r5, out of four nands */
+        append(stream, bitwise_nand(r7, r2, r5));
+        append(stream, bitwise_nand(r4, r2, r7));
+        append(stream, bitwise_nand(r6, r5, r7));
+        append(stream, bitwise_nand(r4, r4, r6));
+        append(stream, output(r4));
+        append(stream, loadval(r6, top));
+        append(stream, load_program(r0, r0, r6));
+        assert((uint32_t)Seq_length(stream) == exit);
+        append(stream, halt());
+}
@@ -0,0 +1,83 @@
+/*
+ * umtrace.c
+ * by Rachel Scrivanich and Andrew Maynard, 4/14/22
+ * um
+ *
+ * Decoder for traces written by um --trace. Prints one line per retired
+ * instruction: the offset in segment 0, the opcode, and the register it
+ * wrote when the trace has register writes, e.g.
+ *
+ *   12 add r3=42
+ *
+ * With -c it prints how many instructions of each opcode the trace holds
+ * instead.
+ *
+ * Usage: umtrace [-c] trace
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "um_trace.h"
+
+static const char *opcode_names[16] = {
+    "cmov", "sload", "sstore", "add", "mul", "div", "nand", "halt",
+    "map", "unmap", "out", "in", "loadp", "lv", "op14", "op15"
+};
+
+int main(int argc, char *argv[])
+{
+    bool count_only = (argc == 3 && strcmp(argv[1], "-c") == 0);
+
+    if (argc != 2 && !count_only) {
+        fprintf(stderr, "Usage: %s [-c] trace\n", argv[0]);
+        return 1;
+    }
+
+    FILE *in = fopen(argv[argc - 1], "rb");
+    if (in == NULL) {
+        fprintf(stderr, "Could not open %s\n", argv[argc - 1]);
+        return 1;
+    }
+
+    Trace_reader reader = trace_reader_new(in);
+    if (reader == NULL) {
+        fprintf(stderr, "%s is not a version %d trace\n", argv[argc - 1],
+                TRACE_VERSION);
+        fclose(in);
+        return 1;
+    }
+
+    Trace_record record;
+    uint64_t counts[16] = { 0 };
+    uint64_t total = 0;
+
+    while (trace_reader_next(reader, &record)) {
+        total++;
+        if (count_only) {
+            counts[record.opcode]++;
+        } else if (record.reg >= 0) {
+            printf("%u %s r%d=%u\n", record.pc, opcode_names[record.opcode],
+                   record.reg, record.value);
+        } else {
+            printf("%u %s\n", record.pc, opcode_names[record.opcode]);
+        }
+    }
+
+    if (count_only) {
+        for (int i = 0; i < 16; i++) {
+            if (counts[i] != 0) {
+                printf("%-8s %16llu\n", opcode_names[i],
+                       (unsigned long long)counts[i]);
+            }
+        }
+        printf("%-8s %16llu\n", "total", (unsigned long long)total);
+    }
+
+    trace_reader_free(&reader);
+    fclose(in);
+    return 0;
+}
@@ -0,0 +1,272 @@
+/*
+ * umworkload.c
+ *
+ * Writes benchmark programs built by the workload builders in umlab.c,
+ * which this is linked against in place of umlabwrite.c. Each workload
+ * is written as NAME.um with its expected output in NAME.1 and, for the
+ * filter, its input in NAME.0, same as the unit tests.
+ *
+ * Usage: umworkload KIND [name=value ...]
+ *
+ *   arith    n=ITERATIONS ops=STEPS
+ *   churn    n=ITERATIONS live=SEGMENTS dist=fixed|uniform|log
+ *            min=WORDS max=WORDS table=SIZES seed=SEED
+ *   jump     n=ITERATIONS targets=STUBS seed=SEED
+ *   selfmod  n=ITERATIONS
+ *   filter   bytes=LENGTH key=BYTE seed=SEED
+ *
+ * and out=NAME for any of them (the default is KIND). The same parameters
+ * always give the same program.
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "assert.h"
+#include "fmt.h"
+#include "seq.h"
+
+extern void Um_write_sequence(FILE *output, Seq_T instructions);
+
+extern uint32_t build_arith_workload(Seq_T stream, uint32_t iterations,
+                                     int ops);
+extern uint32_t build_churn_workload(Seq_T stream, uint32_t iterations,
+                                     uint32_t live, const uint32_t *sizes,
+                                     uint32_t num_sizes);
+extern uint32_t build_jump_workload(Seq_T stream, uint32_t iterations,
+                                    uint32_t targets,
+                                    const uint32_t *addends);
+extern uint32_t build_selfmod_workload(Seq_T stream, uint32_t iterations);
+extern void build_filter_workload(Seq_T stream, uint32_t key);
+
+
+/* Parameters, with their defaults; not every workload reads every one */
+static struct param {
+        const char *name;
+        const char *value;
+} params[] = {
+        { "out",     NULL },
+        { "n",       "10000000" },
+        { "ops",     "16" },
+        { "live",    "64" },
+        { "dist",    "log" },
+        { "min",     "1" },
+        { "max",     "1024" },
+        { "table",   "1024" },
+        { "targets", "64" },
+        { "bytes",   "16777216" },
+        { "key",     "42" },
+        { "seed",    "1" }
+};
+
+#define NPARAMS (sizeof(params)/sizeof(params[0]))
+
+static const char *param(const char *name);
+static uint32_t number(const char *name);
+static uint32_t next_random(uint32_t *state);
+static uint32_t draw_size(uint32_t *state, const char *dist,
+                          uint32_t min, uint32_t max);
+static void write_program(const char *name, Seq_T instructions);
+static void write_bytes(char *path, const unsigned char *bytes,
+                        size_t length);
+static void write_word(const char *name, uint32_t word);
+
+
+int main(int argc, char *argv[])
+{
+        if (argc < 2) {
+                fprintf(stderr,
+                        "Usage: %s arith|churn|jump|selfmod|filter "
+                        "[name=value ...]\n", argv[0]);
+                return 1;
+        }
+        const char *kind = argv[1];
+
+        for (int j = 2; j < argc; j++) {
+                char *equals = strchr(argv[j], '=');
+                bool known = false;
+                for (unsigned i = 0; equals != NULL && i < NPARAMS; i++)
+                        if (strlen(params[i].name) ==
+                                    (size_t)(equals - argv[j]) &&
+                            !strncmp(params[i].name, argv[j],
+                                     equals - argv[j])) {
+                                params[i].value = equals + 1;
+                                known = true;
+                        }
+                if (!known) {
+                        fprintf(stderr, "***** No parameter %s *****\n",
+                                argv[j]);
+                        return 1;
+                }
+        }
+
+        const char *name = param("out") != NULL ? param("out") : kind;
+        uint32_t seed = number("seed") | 1; /* xorshift never leaves 0 */
+        Seq_T instructions = Seq_new(0);
+
+        if (!strcmp(kind, "arith")) {
+                uint32_t sum = build_arith_workload(instructions, number("n"),
+                                                    number("ops"));
+                write_word(name, sum);
+        } else if (!strcmp(kind, "churn")) {
+                uint32_t table = number("table");
+                uint32_t *sizes = malloc(table * sizeof(uint32_t));
+                assert(sizes != NULL);
+                for (uint32_t i = 0; i < table; i++)
+                        sizes[i] = draw_size(&seed, param("dist"),
+                                             number("min"), number("max"));
+
+                uint32_t sum = build_churn_workload(instructions, number("n"),
+                                                    number("live"), sizes,
+                                                    table);
+                write_word(name, sum);
+                free(sizes);
+        } else if (!strcmp(kind, "jump")) {
+                uint32_t targets = number("targets");
+                uint32_t *addends = malloc(targets * sizeof(uint32_t));
+                assert(addends != NULL);
+                for (uint32_t i = 0; i < targets; i++)
+                        addends[i] = next_random(&seed) & 0xffffff;
+
+                uint32_t sum = build_jump_workload(instructions, number("n"),
+                                                   targets, addends);
+                write_word(name, sum);
+                free(addends);
+        } else if (!strcmp(kind, "selfmod")) {
+                write_word(name, build_selfmod_workload(instructions,
+                                                        number("n")));
+        } else if (!strcmp(kind, "filter")) {
+                uint32_t key = number("key");
+                size_t length = number("bytes");
+                unsigned char *input = malloc(length + 1);
+                unsigned char *expected = malloc(length + 1);
+                assert(input != NULL && expected != NULL);
+
+                /* printable text, so the files are easy to look at */
+                for (size_t i = 0; i < length; i++) {
+                        input[i] = ' ' + next_random(&seed) % 95;
+                        expected[i] = input[i] ^ key;
+                }
+
+                build_filter_workload(instructions, key);
+                write_bytes(Fmt_string("%s.0", name), input, length);
+                write_bytes(Fmt_string("%s.1", name), expected, length);
+                free(input);
+                free(expected);
+        } else {
+                fprintf(stderr, "***** No workload named %s *****\n", kind);
+                Seq_free(&instructions);
+                return 1;
+        }
+
+        write_program(name, instructions);
+        Seq_free(&instructions);
+        return 0;
+}
+
+
+/* value given for a parameter, or its default */
+static const char *param(const char *name)
+{
+        for (unsigned i = 0; i < NPARAMS; i++)
+                if (!strcmp(params[i].name, name))
+                        return params[i].value;
+        assert(0);
+        return NULL;
+}
+
+
+/* numeric parameter; a bad number is a checked runtime error */
+static uint32_t number(const char *name)
+{
+        char *end;
+        unsigned long value = strtoul(param(name), &end, 0);
+
+        assert(*param(name) != '\0' && *end == '\0');
+        assert(value <= UINT32_MAX);
+        return (uint32_t)value;
+}
+
+
+/* xorshift32, so the same seed gives the same program everywhere */
+static uint32_t next_random(uint32_t *state)
+{
+        uint32_t x = *state;
+
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        *state = x;
+        return x;
+}
+
+
+/*
+ * a segment size between min and max: always min for "fixed", equally
+ * likely for "uniform", and for "log" with every power of two range
+ * equally likely, so small segments dominate as they do in practice
+ */
+static uint32_t draw_size(uint32_t *state, const char *dist,
+                          uint32_t min, uint32_t max)
+{
+        assert(min > 0 && min <= max);
+
+        if (!strcmp(dist, "fixed"))
+                return min;
+        if (!strcmp(dist, "uniform"))
+                return min + next_random(state) % (max - min + 1);
+
+        assert(!strcmp(dist, "log"));
+        int low = 31 - __builtin_clz(min);
+        int high = 31 - __builtin_clz(max);
+        int bits = low + next_random(state) % (high - low + 1);
+
+        uint64_t size = ((uint64_t)1 << bits) +
+                        next_random(state) % ((uint64_t)1 << bits);
+        if (size < min)
+                size = min;
+        if (size > max)
+                size = max;
+        return (uint32_t)size;
+}
+
+
+static void write_program(const char *name, Seq_T instructions)
+{
+        char *path = Fmt_string("%s.um", name);
+        FILE *binary = fopen(path, "wb");
+        assert(binary != NULL);
+
+        Um_write_sequence(binary, instructions);
+        fclose(binary);
+        free(path);
+}
+
+
+/* writes length bytes into path, then frees path */
+static void write_bytes(char *path, const unsigned char *bytes,
+                        size_t length)
+{
+        FILE *output = fopen(path, "wb");
+        assert(output != NULL);
+
+        size_t written = fwrite(bytes, 1, length, output);
+        assert(written == length);
+        fclose(output);
+        free(path);
+}
+
+
+/* expected output of a workload that prints a word, most significant first */
+static void write_word(const char *name, uint32_t word)
+{
+        unsigned char bytes[4] = {
+                word >> 24, (word >> 16) & 0xff, (word >> 8) & 0xff,
+                word & 0xff
+        };
+
+        write_bytes(Fmt_string("%s.1", name), bytes, sizeof(bytes));
+}